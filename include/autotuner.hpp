@@ -0,0 +1,55 @@
+#ifndef __AUTOTUNER_HPP_
+#define __AUTOTUNER_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Workgroup shape of the per pixel passes, specialized into compute.comp and tonemapping.comp
+struct tile_shape {
+    uint32_t x = 8;
+    uint32_t y = 8;
+};
+
+// Times the raytracing dispatch with each candidate shape and keeps the fastest.
+// The winner is saved per device UUID, so later runs on the same GPU start with it.
+class tile_autotuner {
+    public:
+
+    // Frames rendered before measuring a candidate, they cover the pipeline creation
+    // and the timestamps still in flight for the previous candidate
+    static constexpr uint32_t warmup_frames = 8;
+    static constexpr uint32_t measured_frames = 32;
+
+    tile_autotuner(std::filesystem::path cache_path, const uint8_t* device_uuid, uint32_t max_invocations);
+
+    // Drops the cached shape and measures every candidate again
+    void start();
+
+    [[nodiscard]] bool tuning() const { return candidate_index < candidates.size(); }
+
+    // Candidate being measured while tuning, the best shape known otherwise
+    [[nodiscard]] tile_shape shape() const;
+
+    // GPU time of one sample with the current shape. Moves on once the candidate was
+    // measured long enough, and saves the best one after the last candidate.
+    void record(float sample_ms);
+
+    private:
+
+    void save() const;
+
+    std::filesystem::path cache_path;
+    std::string device_key;
+
+    std::vector<tile_shape> candidates;
+    size_t candidate_index = SIZE_MAX;
+    uint32_t candidate_frames = 0;
+    float candidate_ms = 0.f;
+
+    tile_shape best;
+    float best_ms = 0.f;
+};
+
+#endif // !__AUTOTUNER_HPP_
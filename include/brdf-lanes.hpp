@@ -0,0 +1,46 @@
+#ifndef __BRDF_LANES_HPP_
+#define __BRDF_LANES_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// BRDF lobe selection and sampling for many hits at once, laid out as a structure
+// of arrays so a SIMD kernel shades 8 hits per iteration.
+// Directions are in the tangent space of the shading normal, like the *_local
+// variables of compute.comp.
+struct brdf_lanes {
+    static constexpr size_t width = 8;
+
+    // Rounds the storage up to a multiple of the SIMD width, lanes past count are ignored
+    void resize(size_t new_count);
+
+    size_t                  count = 0;
+
+    // Inputs
+    std::vector<float>      view[3];
+    std::vector<float>      base_color[3];
+    std::vector<float>      metalness;
+    std::vector<float>      roughness;
+
+    // Uniform random numbers, the first picks the lobe and the others sample it
+    std::vector<float>      random[3];
+
+    // Results, a zero weight means the path ends
+    std::vector<float>      direction[3];
+    std::vector<float>      weight[3];
+    std::vector<uint32_t>   type;
+};
+
+// Runs the AVX2 kernel when the CPU supports it, the scalar reference otherwise
+void sample_brdf(brdf_lanes& lanes);
+
+// Reference built on the brdf.hpp functions mirroring shaders/include/brdf.h
+void sample_brdf_scalar(brdf_lanes& lanes, size_t first, size_t count);
+
+// Shades the 8 lanes starting at first, which must be a multiple of the SIMD width
+void sample_brdf_avx2(brdf_lanes& lanes, size_t first);
+
+[[nodiscard]] bool supports_avx2();
+
+#endif // !__BRDF_LANES_HPP_
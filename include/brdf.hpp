@@ -0,0 +1,47 @@
+#ifndef __BRDF_HPP_
+#define __BRDF_HPP_
+
+#include <cstdint>
+
+#include "vec3.hpp"
+
+// CPU mirror of shaders/include/brdf.h and math.h, both sides must stay in sync
+// for CPU samples to converge to the same image as the GPU ones
+
+enum BRDF_TYPE: uint32_t {
+    DIFFUSE     = 1,
+    SPECULAR    = 2,
+};
+
+struct quaternion {
+    vec3 axis;
+    float w;
+};
+
+vec3 sample_hemisphere(float u, float v);
+
+vec3 disk_vec(float u, float v);
+
+quaternion rotation_to_z_axis(const vec3& axis);
+
+quaternion invert_rotation(const quaternion& q);
+
+vec3 rotate_point(const quaternion& q, const vec3& v);
+
+vec3 sample_ggx_vndf(const vec3& view, float alpha, uint32_t& seed);
+
+vec3 sample_ggx_vndf(const vec3& view, float alpha, float u1, float u2);
+
+float specular_sample_weight_ggx_vndf(float alpha_squared, float n_dot_l);
+
+color base_color_to_specular_f0(const color& base_color, float metalness);
+
+color base_color_to_diffuse_reflectance(const color& base_color, float metalness);
+
+color eval_fresnel(const color& f0, float f90, float n_dot_s);
+
+float shadowed_f90(const color& f0);
+
+float get_brdf_probability(const color& base_color, float metalness, const vec3& view, const vec3& shading_normal);
+
+#endif // !__BRDF_HPP_
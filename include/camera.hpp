@@ -1,19 +1,30 @@
 #ifndef __CAMERA_HPP_
 #define __CAMERA_HPP_
 
+#include <array>
+
 #include "vec3.hpp"
 
 class camera {
     public:
+        camera() = default;
+
         camera(
             point3 position,
             point3 target,
             float v_fov,
             float aspect_ratio,
             float aperture,
-            float focus_dist
+            float focus_dist,
+            vec3 world_up = vec3{ 0.f, 1.f, 0.f }
         );
 
+        // Six 90 degrees square views ordered as +X, -X, +Y, -Y, +Z, -Z
+        static std::array<camera, 6> cubemap(point3 position, float focus_dist);
+
+        // Left and right eye views, offset along the right vector of the given camera
+        static std::array<camera, 2> stereo(const camera& center, float eye_separation);
+
         void set_aspect_ratio(float ratio);
 
         void move(const vec3& v);
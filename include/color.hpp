@@ -7,4 +7,10 @@ using color = class vec3;
 
 void write_color(std::ostream& out, const color& pixel_color);
 
+float luminance(const color& rgb);
+
+color srgb_to_linear(const color& rgb);
+
+color linear_to_srgb(const color& rgb);
+
 #endif // !__COLOR_HPP_
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "renderpass.hpp"
 #include "vk-api.hpp"
 
@@ -12,7 +16,16 @@ class ComputeRenderpass : public Renderpass {
     ComputeRenderpass(vkapi& api);
     ~ComputeRenderpass() override;
 
-    void set_pipeline(const char* shader_name);
+    // Permutations kept per pass, past it the least recently used one is destroyed once
+    // the frames in flight are done with it
+    static constexpr size_t max_permutations = 16;
+
+    // Selects the permutation of the shader with the given specialization constants.
+    // Permutations are built once and kept until the shader changes or is reloaded
+    void set_pipeline(const char* shader_name, const std::vector<uint32_t>& specialization_constants = {});
+
+    // Rebuilds the current permutation from the shader on disk, dropping the others
+    void reload_pipelines();
 
     void set_dispatch_size(size_t count_x, size_t count_y, size_t count_z);
 
@@ -20,7 +33,19 @@ class ComputeRenderpass : public Renderpass {
 
     void set_constant(off_t offset, uint64_t* constant);
     void set_constant(off_t offset, Texture* texture);
-    void set_constant(off_t offset, Buffer* buffer);
+    void set_constant(off_t offset, Buffer* buffer, size_t buffer_offset = 0);
+
+    // Textures read by the pass without having their index in the constants
+    void add_input_texture(Texture* texture);
+
+    // Buffers zeroed before every dispatch, like the work counter of persistent threads
+    void add_cleared_buffer(Buffer* buffer);
+
+    // Measures the dispatch with GPU timestamps
+    void enable_timing();
+
+    // GPU duration of the last dispatch whose timestamps came back, 0 before the first one
+    [[nodiscard]] float dispatch_duration() const { return dispatch_duration_ms; }
 
     // TODO: Do not use vulkan api type
     void execute(vkrenderer& renderer, VkCommandBuffer command_buffer) final;
@@ -31,11 +56,41 @@ class ComputeRenderpass : public Renderpass {
 
     std::vector<Texture*> input_textures;
 
+    std::vector<Buffer*> cleared_buffers;
+
+    // Two timestamps per virtual frame, read back once the frame is reused
+    VkQueryPool timing_pool = VK_NULL_HANDLE;
+    std::vector<bool> timing_pending;
+    float dispatch_duration_ms = 0.f;
+
     uint8_t constants[64];
 
     size_t group_count_x;
     size_t group_count_y;
     size_t group_count_z;
 
-    pipeline pipeline;
+    void destroy_pipelines();
+
+    // Destroys the evicted permutations no frame in flight uses anymore
+    void destroy_retired_pipelines();
+
+    struct pipeline_permutation {
+        pipeline    compiled;
+        uint64_t    last_used = 0;
+    };
+
+    // Evicted permutations may still be bound by the frames in flight
+    struct retired_pipeline {
+        pipeline    compiled;
+        uint64_t    execution;
+    };
+
+    std::string shader_name;
+    std::vector<uint32_t> specialization;
+    std::map<std::vector<uint32_t>, pipeline_permutation> pipelines;
+    std::vector<retired_pipeline> retired_pipelines;
+    pipeline* current_pipeline = nullptr;
+
+    // Frames the pass was recorded in
+    uint64_t executions = 0;
 };
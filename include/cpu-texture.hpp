@@ -0,0 +1,73 @@
+#ifndef __CPU_TEXTURE_HPP_
+#define __CPU_TEXTURE_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "vec3.hpp"
+
+// Filters and address modes of the sampler a texture is read with on the GPU, mirrors
+// sampler_settings without the Vulkan types
+struct cpu_sampler {
+    enum class address_mode {
+        REPEAT,
+        CLAMP_TO_EDGE,
+        MIRRORED_REPEAT,
+    };
+
+    address_mode    address_u = address_mode::REPEAT;
+    address_mode    address_v = address_mode::REPEAT;
+    bool            nearest_mag = false;
+    bool            nearest_min = false;
+    bool            nearest_mip = false;
+};
+
+// RGBA8 texture laid out for CPU sampling.
+// Texels are stored in 8x8 tiles, Morton ordered inside a tile, so the four taps
+// of a bilinear lookup land in the same 256 bytes most of the time instead of two
+// rows apart. Every mip level down to 1x1 is box filtered at creation.
+class cpu_texture {
+public:
+    // Level 0 in RGBA8 rows, the smaller levels are filtered from it
+    cpu_texture(const uint32_t* rgba, uint32_t width, uint32_t height);
+
+    // Bilinear lookup of the base level with repeat addressing, like texture() in compute.comp
+    [[nodiscard]] color sample(float u, float v) const;
+
+    // Lookup of the mip levels around lod with the filters and address modes of the sampler, like textureLod()
+    [[nodiscard]] color sample(float u, float v, float lod, const cpu_sampler& sampler = {}) const;
+
+    // Level of detail of a footprint covering one unit of uv space, to add to a
+    // texture independent ray cone lod
+    [[nodiscard]] float lod_offset() const { return base_lod_offset; }
+
+    [[nodiscard]] uint32_t levels_count() const { return (uint32_t)levels.size(); }
+
+    static constexpr uint32_t tile_size = 8;
+
+private:
+    struct level {
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    tiles_x;
+        size_t      offset;
+    };
+
+    void add_level(uint32_t width, uint32_t height);
+
+    [[nodiscard]] size_t texel_index(const level& mip, uint32_t x, uint32_t y) const;
+
+    [[nodiscard]] uint32_t fetch(const level& mip, int64_t x, int64_t y, const cpu_sampler& sampler) const;
+
+    [[nodiscard]] color nearest(const level& mip, float u, float v, const cpu_sampler& sampler) const;
+
+    [[nodiscard]] color bilinear(const level& mip, float u, float v, const cpu_sampler& sampler) const;
+
+    [[nodiscard]] color filter(const level& mip, float u, float v, const cpu_sampler& sampler, bool nearest_filter) const;
+
+    std::vector<level>      levels;
+    std::vector<uint32_t>   texels;
+    float                   base_lod_offset = 0.f;
+};
+
+#endif // !__CPU_TEXTURE_HPP_
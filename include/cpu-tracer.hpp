@@ -0,0 +1,121 @@
+#ifndef __CPU_TRACER_HPP_
+#define __CPU_TRACER_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "brdf-lanes.hpp"
+#include "brdf.hpp"
+#include "cpu-texture.hpp"
+#include "ray-query.hpp"
+#include "ray.hpp"
+#include "scene.hpp"
+
+class Sampler;
+class Texture;
+
+// Traces extra samples on worker threads while the GPU renders the frame.
+// Samples are summed per pixel and uploaded once per frame, compute.comp merges
+// them into the accumulation image using the per pixel sample count.
+class cpu_tracer {
+public:
+    // Without workers nothing is traced, the frames only hold the GPU samples
+    explicit cpu_tracer(const scene& traced_scene, uint32_t worker_count = default_worker_count());
+    ~cpu_tracer();
+
+    // Drops every sample traced with older settings, to call whenever the accumulation restarts
+    void reset(const scene::metadata& new_meta);
+
+    // Hands the finished samples over to the texture and sizes the next batch of tiles
+    // from the measured throughput so the CPU keeps tracing for about one frame.
+    // Returns false when there was nothing to upload.
+    bool flush(Texture* samples_texture, float frame_time);
+
+    [[nodiscard]] float samples_per_ms() const { return throughput; }
+
+    // One per core but the one of the render thread
+    [[nodiscard]] static uint32_t default_worker_count() { return std::max(std::thread::hardware_concurrency(), 2U) - 1U; }
+
+    static constexpr uint32_t tile_size = 16;
+
+private:
+    void work();
+
+    struct path_state {
+        color       throughput;
+        uint32_t    seed;
+        uint32_t    pixel;
+
+        // Ray cone picking the mip level of texture lookups
+        float       cone_width;
+        float       cone_spread;
+    };
+
+    // What the second half of a bounce needs from the first, once per hit
+    struct surface {
+        quaternion  to_local;
+        vec3        geometry_normal;
+        point3      point;
+        uint32_t    path;
+    };
+
+    // Paths of the tile still alive, reused across tiles by each worker
+    struct wavefront {
+        std::vector<ray>        rays;
+        std::vector<hit_info>   hits;
+        std::vector<path_state> states;
+        std::vector<surface>    surfaces;
+        brdf_lanes              lanes;
+    };
+
+    void trace_tile(uint32_t view, uint32_t tile_x, uint32_t tile_y, uint32_t tile_pass, const scene::metadata& tile_meta, wavefront& paths, std::vector<float>& tile_samples) const;
+
+    [[nodiscard]] ray generate_camera_ray(const camera& cam, uint32_t x, uint32_t y, uint32_t& seed, const scene::metadata& tile_meta) const;
+
+    void prepare_surface(const ray& r, hit_info info, path_state& state, surface& hit_surface, brdf_lanes& lanes, size_t lane) const;
+
+    [[nodiscard]] bool scatter(const surface& hit_surface, const brdf_lanes& lanes, size_t lane, uint32_t bounce, const scene::metadata& tile_meta, path_state& state, ray& next_ray) const;
+
+    [[nodiscard]] color sample_texture(const Texture* texture, const Sampler* sampler, float u, float v, float cone_lod) const;
+
+    [[nodiscard]] bool enabled() const { return meta.downscale_factor == 1 && meta.debug_bvh == (uint32_t)false; }
+
+    const scene&                traced_scene;
+    ray_query                   query;
+
+    // Tiled copies of the material textures, built once since the scene never changes them
+    std::unordered_map<const Texture*, cpu_texture> textures;
+
+    std::vector<std::thread>    workers;
+    std::mutex                  mutex;
+    std::condition_variable     work_available;
+
+    // Guarded by the mutex
+    bool                        running = true;
+    scene::metadata             meta;
+    uint64_t                    generation = 0;
+
+    // rgb sum and sample count for each pixel, views are stored one after the other
+    std::vector<float>          samples;
+    bool                        has_samples = false;
+
+    uint32_t                    tiles_x = 0;
+    uint32_t                    tiles_y = 0;
+    uint32_t                    next_tile = 0;
+    uint32_t                    pass = 0;
+    uint32_t                    tile_budget = 0;
+
+    uint64_t                    traced_samples = 0;
+    float                       busy_time = 0.f;
+
+    // Samples per ms for all the workers, smoothed over frames
+    float                       throughput = 0.f;
+};
+
+#endif // !__CPU_TRACER_HPP_
@@ -20,6 +20,8 @@ struct raw_image {
     int32_t height;
     int32_t channels;
     uint8_t *data;
+    // Points into the texture cache mapping instead of a heap allocation
+    bool mapped = false;
 };
 
 namespace std::filesystem {
@@ -50,6 +52,7 @@ private:
     std::vector<Mesh> meshes;
     std::vector<material> materials;
     std::vector<Texture*> textures;
+    std::vector<Sampler*> texture_samplers;
     std::vector<std::vector<uint8_t>> buffers;
 };
 
@@ -4,12 +4,16 @@
 
 #include "vec3.hpp"
 
+class Sampler;
 class Texture;
 
 struct material {
     color base_color;
     Texture* base_color_texture;
     Texture* metallic_roughness_texture;
+    // glTF textures sharing an image share its Texture, each keeps its own sampler
+    Sampler* base_color_sampler = nullptr;
+    Sampler* metallic_roughness_sampler = nullptr;
     float metalness = 1.f;
     float roughness = 1.f;
 };
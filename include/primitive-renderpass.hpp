@@ -43,7 +43,8 @@ class PrimitiveRenderpass : public Renderpass {
     std::vector<VkImageView> color_attachments_view;
     std::vector<VkFormat> color_attachments_format;
 
-    framebuffer framebuffers[vkrenderer::virtual_frames_count];
+    // One per virtual frame
+    std::vector<framebuffer> framebuffers;
 
     std::vector<Primitive*> primitives;
 };
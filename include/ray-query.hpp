@@ -0,0 +1,57 @@
+#ifndef __RAY_QUERY_HPP_
+#define __RAY_QUERY_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "ray.hpp"
+
+class scene;
+
+// Ray queries against the scene BVH on the CPU, for picking, baking or any tool
+// that needs visibility without going through the GPU.
+// Batches are split in chunks traced in parallel, each chunk traverses the
+// stackless BVH with packets of 4 rays.
+class ray_query {
+public:
+    ray_query(const std::vector<packed_bvh_node>& nodes, const std::vector<uint32_t>& indices, const std::vector<float>& positions);
+
+    explicit ray_query(const scene& traced_scene);
+
+    // Fills one hit record per ray, primitive_id is hit_info::miss for rays hitting nothing
+    void closest_hit(const std::vector<ray>& rays, std::vector<hit_info>& hits) const;
+
+    // Fills one flag per ray, set when anything lies between min_t and max_t
+    void any_hit(const std::vector<ray>& rays, std::vector<uint8_t>& occluded) const;
+
+    // Scalar traversal mirroring hit_node of shaders/include/ray.h, reference for the packet path
+    bool closest_hit(const ray& r, hit_info& info) const;
+
+    bool any_hit(const ray& r) const;
+
+    // Rays per chunk handed to a thread, smaller batches are traced on the calling thread
+    static constexpr size_t chunk_size = 256;
+
+private:
+    static constexpr size_t packet_size = 4;
+
+    template<bool any>
+    void trace_chunk(const ray* rays, size_t count, hit_info* hits, uint8_t* occluded) const;
+
+    template<bool any>
+    void trace_packet(const ray* rays, size_t count, hit_info* hits, uint8_t* occluded) const;
+
+    template<bool any>
+    bool traverse(ray r, hit_info& info) const;
+
+    bool hit_triangle(uint32_t id, const ray& r, hit_info& info) const;
+
+    void fill_hit(const ray& r, hit_info& info) const;
+
+    const std::vector<packed_bvh_node>& nodes;
+    const std::vector<uint32_t>&        indices;
+    const std::vector<float>&           positions;
+};
+
+#endif // !__RAY_QUERY_HPP_
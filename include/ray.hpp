@@ -0,0 +1,35 @@
+#ifndef __RAY_HPP_
+#define __RAY_HPP_
+
+#include <cstdint>
+
+#include "vec3.hpp"
+
+// CPU counterparts of the ray and hit_info structs of shaders/include/ray.h
+struct ray {
+    ray() = default;
+    ray(const point3& origin, const vec3& direction, float min_t, float max_t)
+        : origin(origin), direction(direction), min_t(min_t), max_t(max_t)
+    {}
+
+    [[nodiscard]] point3 at(float t) const { return origin + direction * t; }
+
+    point3 origin;
+    vec3 direction;
+    float min_t = 0.f;
+    float max_t = 0.f;
+};
+
+struct hit_info {
+    static constexpr uint32_t miss = UINT32_MAX;
+
+    [[nodiscard]] bool hit() const { return primitive_id != miss; }
+
+    point3 point;
+    vec3 barycentrics;
+    vec3 geometry_normal;
+    float t = 0.f;
+    uint32_t primitive_id = miss;
+};
+
+#endif // !__RAY_HPP_
@@ -2,14 +2,21 @@
 #define __SCENE_HPP_
 
 #include <cstdint>
+#include <vector>
 
+#include "bvh.hpp"
 #include "camera.hpp"
+#include "material.hpp"
 
 class Buffer;
 
 class scene {
+public:
+    static constexpr uint32_t max_views = 6;
+
     struct metadata {
-        camera cam;
+        // Views rendered in the same dispatch, the z dispatch index selects the camera
+        camera cameras[max_views];
 
         uint32_t max_bounce = 3;
         uint32_t min_bounce = 1;
@@ -23,14 +30,51 @@ class scene {
         uint32_t debug_bvh  = (uint32_t)false;
         int32_t downscale_factor = 1;
 
+        uint32_t view_count = 1;
+
+        // Storage image holding the samples traced on the CPU since the last frame, 0 when there are none
+        uint32_t cpu_samples_image_index = 0;
+
+        // Accumulation stored as RGBA16F means instead of RGBA32F sums, both with the sample count in alpha
+        uint32_t compact_accumulation = (uint32_t)false;
+
+        // Samples traced per pixel by each raytracing dispatch, summed in a single accumulation write
+        uint32_t samples_per_dispatch = 1;
+
+        // Device address of the counter the persistent threads fetch pixels from
+        uint64_t work_counter_address = 0;
+
+        // Device addresses of the streamed texture table and feedback of the frame, see texture-streamer.hpp
+        uint64_t texture_table_address = 0;
+        uint64_t texture_feedback_address = 0;
+
         metadata(const camera &cam, uint32_t width, uint32_t height);
     };
 
+private:
     // void random_scene();
 
 public:
     scene(const camera& cam, uint32_t width, uint32_t height);
 
+    void set_views(const camera* views, uint32_t count);
+
+    void move_views(const vec3& v);
+
+    void rotate_views_y(float theta);
+
+    void set_views_aspect_ratio(float ratio);
+
+    // Settings baked in the raytracing pipeline, in the constant_id order of shaders/include/scene.h
+    [[nodiscard]] std::vector<uint32_t> specialization_constants() const;
+
+    // SCENE_VALUE of shaders/include/scene.h, the shaders read the setting from the metadata
+    static constexpr uint32_t scene_value = 0xffffffffU;
+
+    // Cleared while the max bounces slider is dragged, baking each value it goes through
+    // would build a pipeline per value
+    bool bake_max_bounce = true;
+
     metadata meta;
 
     Buffer*                 scene_buffer;
@@ -40,6 +84,14 @@ public:
     Buffer*                 uvs_buffer;
     Buffer*                 bvh_buffer;
     Buffer*                 materials_buffer;
+
+    // Host copies of the GPU buffers for the CPU side queries
+    std::vector<uint32_t>           indices;
+    std::vector<float>              positions;
+    std::vector<float>              normals;
+    std::vector<float>              uvs;
+    std::vector<packed_bvh_node>    bvh_nodes;
+    std::vector<material>           materials;
 };
 
 #endif // !__SCENE_HPP_
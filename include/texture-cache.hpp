@@ -0,0 +1,85 @@
+#ifndef __TEXTURE_CACHE_HPP_
+#define __TEXTURE_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Payload of a cached texture, every level of the mip chain one after the other
+enum class TEXTURE_ENCODING : uint32_t {
+    RGBA8,
+    BC5,
+    BC7,
+};
+
+struct cached_texture {
+    TEXTURE_ENCODING    encoding;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            levels;
+    const uint8_t*      payload;
+    size_t              payload_size;
+};
+
+// Decoded textures of every source image in one file, mapped in memory so warm starts
+// copy the payloads straight into the staging buffer instead of decoding the images.
+// Entries are keyed by the hash and size of the source file content.
+// Found payloads point into the mapping or the saved copies, both kept as long as the cache.
+class texture_cache {
+public:
+    // Maps the container, a missing or unreadable one starts the cache empty
+    explicit texture_cache(const std::filesystem::path& container_path);
+    texture_cache(const texture_cache&) = delete;
+    texture_cache& operator=(const texture_cache&) = delete;
+    ~texture_cache();
+
+    [[nodiscard]] bool find(uint64_t source_hash, uint64_t source_size, TEXTURE_ENCODING encoding, cached_texture& texture) const;
+
+    // Kept in memory until save, the payload is copied
+    void add(uint64_t source_hash, uint64_t source_size, const cached_texture& texture);
+
+    // Writes the mapped and added entries to a new container replacing the old file. The added
+    // entries are found from then on, a failed write keeps them for the next save
+    void save();
+
+    // FNV-1a of the source file content
+    [[nodiscard]] static uint64_t hash(const uint8_t* data, size_t size);
+
+private:
+    struct entry {
+        uint64_t    source_hash;
+        uint64_t    source_size;
+        uint32_t    encoding;
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    levels;
+        uint64_t    payload_offset;
+        uint64_t    payload_size;
+    };
+
+    void open();
+
+    void unmap();
+
+    [[nodiscard]] std::filesystem::path pending_path() const;
+
+    std::filesystem::path           path;
+
+    const uint8_t*                  mapping = nullptr;
+    size_t                          mapping_size = 0;
+#if defined(WINDOWS)
+    void*                           file_handle = nullptr;
+    void*                           mapping_handle = nullptr;
+#endif
+
+    // Entries of the container on disk, their payloads are in the mapping or in saved_payloads
+    std::vector<entry>              mapped_entries;
+    std::vector<const uint8_t*>     mapped_payloads;
+    std::vector<std::vector<uint8_t>> saved_payloads;
+
+    std::vector<entry>              added_entries;
+    std::vector<std::vector<uint8_t>> added_payloads;
+};
+
+#endif // !__TEXTURE_CACHE_HPP_
@@ -0,0 +1,43 @@
+#ifndef __TEXTURE_COMPRESSION_HPP_
+#define __TEXTURE_COMPRESSION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Block compressed encodings of the glTF textures, both store 4x4 texels in 16 bytes
+enum class BLOCK_FORMAT : uint32_t {
+    BC5,    // Two channels, red and green, for the metallic roughness textures
+    BC7,    // RGBA for the base color textures, only mode 6 blocks are written
+};
+
+static constexpr uint32_t block_side = 4;
+static constexpr size_t block_bytes = 16;
+
+// Mip chain encoded one level after the other, from the largest down to 1x1
+struct encoded_image {
+    BLOCK_FORMAT            format = BLOCK_FORMAT::BC7;
+    uint32_t                width = 0;
+    uint32_t                height = 0;
+    uint32_t                levels = 0;
+    std::vector<uint8_t>    blocks;
+};
+
+// Bytes of one level, partial blocks on the right and bottom edges are padded
+[[nodiscard]] size_t block_level_size(uint32_t width, uint32_t height);
+
+// Box filters every level of an RGBA8 image and encodes them
+[[nodiscard]] encoded_image encode_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height, BLOCK_FORMAT format);
+
+// Box filtered RGBA8 levels one after the other, level 0 included
+[[nodiscard]] std::vector<uint8_t> rgba_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+// Encoders of one RGBA8 level, the blocks are written row after row
+void encode_bc7(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+void encode_bc5(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+
+// Decoders back to RGBA8 for the CPU tracer. BC5 gives blue 0 and alpha 255 like the sampler does
+void decode_bc7(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba);
+void decode_bc5(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba);
+
+#endif // !__TEXTURE_COMPRESSION_HPP_
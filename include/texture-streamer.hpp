@@ -0,0 +1,111 @@
+#ifndef __TEXTURE_STREAMER_HPP_
+#define __TEXTURE_STREAMER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "vk-api.hpp"
+
+class Buffer;
+class Sampler;
+class Texture;
+
+// Entry of the table the shaders sample the streamed textures through, mirrored in shaders/include/scene.h
+struct streamed_texture {
+    uint32_t    image_index;    // Bindless index of the resident image
+    uint32_t    first_level;    // Level of the full chain held by the image level 0
+    float       lod_offset;     // Level of a footprint covering the whole texture
+    uint32_t    padding;
+};
+
+// Keeps the fine levels of the glTF textures resident only while the shaders ask for them.
+// Textures start with their coarse levels. The shaders record the finest level they needed in
+// a feedback buffer, and those levels are uploaded a few per frame under a device memory budget.
+// Over the budget, the least recently used textures drop back to the levels they still need.
+// The resident levels of a texture change with its image, the table tells the shaders which
+// image to sample and the chain level it starts with, the level clamp of each texture.
+// New images are copied on the transfer queue, the table switches once they are acquired.
+class texture_streamer {
+public:
+    texture_streamer();
+
+    // Takes the full mip chain in data, only the coarse levels are uploaded at first
+    Texture* create_texture(size_t width, size_t height, VkFormat format, Sampler* sampler, void* data, bool owns_data);
+
+    // Index of the texture in the table, used as the material texture id. Slot 0 samples bindless image 0
+    [[nodiscard]] uint32_t slot(const Texture* texture) const;
+
+    // Bytes of the streamed images, 0 streams every requested level
+    void set_budget(size_t bytes) { budget = bytes; }
+
+    // Called once the last frame of the virtual frame is done, after update_images. Reads the
+    // feedback written by its previous use and fills its table
+    void update(uint32_t frame_index, uint64_t frame_number);
+
+    [[nodiscard]] uint64_t table_address(uint32_t frame_index) const;
+
+    [[nodiscard]] uint64_t feedback_address(uint32_t frame_index) const;
+
+    // Images being replaced until the frames in flight are done with them are not counted
+    [[nodiscard]] size_t resident_bytes() const;
+
+    // Chain levels larger than this are streamed
+    static constexpr size_t coarse_size = 64;
+
+    // Bytes of levels queued for upload each frame, the textures asked for first go first
+    static constexpr size_t upload_bytes_per_frame = 16ULL * 1024ULL * 1024ULL;
+
+    // Frames without a request before a texture only keeps its coarse levels
+    static constexpr uint64_t idle_frames = 120;
+
+    static constexpr uint32_t no_request = 0xffffffffU;
+
+private:
+    struct slot_state {
+        Texture*    texture = nullptr;
+
+        // Image in the table, texture->device_image differs while its replacement uploads
+        handle      live_image = 0;
+        uint32_t    live_first_level = 0;
+        bool        pending = false;
+
+        uint32_t    coarse_level = 0;
+        uint32_t    requested_level = 0;
+        uint64_t    last_used_frame = 0;
+    };
+
+    // Replaced images may still be read by the frames in flight
+    struct retired_image {
+        handle      image;
+        uint64_t    frame_number;
+    };
+
+    void create_buffers();
+
+    // Level the texture should start at, coarse once unused for idle_frames
+    [[nodiscard]] uint32_t wanted_level(const slot_state& state, uint64_t frame_number) const;
+
+    [[nodiscard]] size_t image_bytes(const slot_state& state, uint32_t first_level) const;
+
+    // Creates the image of the new resident levels and queues its upload
+    void restream(slot_state& state, uint32_t first_level);
+
+    // Drops the least recently used texture keeping more levels than it needs, false when there is none
+    bool evict(const slot_state& keep, uint64_t frame_number);
+
+    std::vector<slot_state>                     slots;
+    std::unordered_map<const Texture*, uint32_t> slot_indices;
+
+    std::vector<retired_image>                  retired_images;
+
+    size_t                                      budget = 0;
+    size_t                                      queued_bytes = 0;
+
+    // One slice per virtual frame
+    Buffer*                                     table_buffer = nullptr;
+    Buffer*                                     feedback_buffer = nullptr;
+};
+
+#endif // !__TEXTURE_STREAMER_HPP_
@@ -0,0 +1,107 @@
+#ifndef __UPLOAD_ENGINE_HPP_
+#define __UPLOAD_ENGINE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "vk-api.hpp"
+
+class Buffer;
+class RingBuffer;
+class Texture;
+
+// Copies the scene buffers and the streamed textures on the transfer queue, in staging batches
+// running ahead of the frames. A timeline semaphore counts the batches done, the graphics queue
+// acquires what they copied in the frame after, then waits on the batch value it acquired.
+// Levels larger than a batch are copied a few rows at a time over several batches.
+class upload_engine {
+public:
+    void init();
+
+    // Waits for the batches in flight
+    void destroy();
+
+    // Its image is not used by the frames until upload_pending clears
+    void queue_image(Texture* texture);
+
+    // The data is copied. The frames do not read the range until it is uploaded
+    void queue_buffer(const Buffer* buffer, const void* data, size_t offset, size_t size);
+
+    // Records on the graphics command buffer the acquisition of the batches done since the last
+    // call and the mip levels generated from their images, then submits the free batches
+    void update(VkCommandBuffer command_buffer);
+
+    // Until the oldest batch in flight is done
+    void wait();
+
+    // Nothing queued nor in flight
+    [[nodiscard]] bool idle() const;
+
+    // The graphics submissions wait for it to reach acquired_value
+    [[nodiscard]] VkSemaphore semaphore() const { return timeline_semaphore; }
+
+    [[nodiscard]] uint64_t acquired_value() const { return acquired; }
+
+    static constexpr uint32_t   batch_count = 4;
+
+    static constexpr size_t     batch_size = 32ULL * 1024ULL * 1024ULL;
+
+private:
+    struct image_upload {
+        Texture*    texture;
+
+        // Next rows to copy, in image levels
+        uint32_t    level = 0;
+        uint32_t    layer = 0;
+        uint32_t    row = 0;
+    };
+
+    struct buffer_upload {
+        const Buffer*           buffer;
+        std::vector<uint8_t>    data;
+        size_t                  offset;
+        size_t                  uploaded;
+    };
+
+    struct buffer_range {
+        handle      buffer;
+        size_t      offset;
+        size_t      size;
+    };
+
+    struct batch {
+        VkCommandBuffer         command_buffer;
+        RingBuffer*             staging_buffer;
+
+        // Signaled once the batch is done, 0 while it is free
+        uint64_t                value = 0;
+
+        // Released to the graphics queue by the batch
+        std::vector<Texture*>       textures;
+        std::vector<buffer_range>   buffer_ranges;
+    };
+
+    // Copies what fits in the staging buffer of the batch and submits it
+    void fill(batch& current_batch);
+
+    // Rows of the image upload fitting in the staging buffer, false once it is full
+    bool copy_rows(batch& current_batch, image_upload& upload);
+
+    // The graphics queue gets the levels generated from level 0 and the layouts the shaders sample
+    void acquire(VkCommandBuffer command_buffer, batch& done_batch);
+
+    VkCommandPool               command_pool = VK_NULL_HANDLE;
+    VkSemaphore                 timeline_semaphore = VK_NULL_HANDLE;
+
+    batch                       batches[batch_count];
+
+    uint64_t                    submitted = 0;
+    uint64_t                    acquired = 0;
+
+    std::deque<image_upload>    image_queue;
+    std::deque<buffer_upload>   buffer_queue;
+};
+
+#endif // !__UPLOAD_ENGINE_HPP_
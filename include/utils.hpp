@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <functional>
 #include <unordered_map>
@@ -30,6 +31,18 @@ inline int32_t randi(int32_t min, int32_t max) {
     return (int32_t)(randd((float)min, (float)max + 1.f));
 }
 
+// Same generator as shaders/include/rand.h so CPU and GPU samples share a distribution
+inline uint32_t pcg_hash(uint32_t& seed) {
+    uint32_t state = seed;
+    seed *= 747796405U + 2891336453U;
+    uint32_t word = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+    return (word >> 22U) ^ word;
+}
+
+inline float randf(uint32_t& seed) {
+    return (float)pcg_hash(seed) / 4294967296.f;
+}
+
 inline float clamp(float x, float min, float max) {
     if (x < min) { return min; }
     if (x > max) { return max; }
@@ -40,6 +40,10 @@ struct image {
     VkImageLayout           previous_layout = VK_IMAGE_LAYOUT_UNDEFINED;
     VkPipelineStageFlags    previous_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
     VkAccessFlags           previous_access = 0;
+
+    // Layout the image was released from to another queue family, until the acquire is recorded
+    bool                    ownership_released = false;
+    VkImageLayout           released_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 };
 
 struct swapchain {
@@ -55,39 +59,98 @@ struct framebuffer {
     VkExtent2D              size;
 };
 
+// Value of a timeline semaphore a submission waits for or signals, nothing without a semaphore
+struct timeline_point {
+    VkSemaphore             semaphore = VK_NULL_HANDLE;
+    uint64_t                value = 0;
+};
+
 struct sampler {
     VkSampler               handle;
     bindless_index          bindless_index;
 };
 
+// Filtering and addressing of a sampler, W follows U
+struct sampler_settings {
+    VkFilter                mag_filter = VK_FILTER_LINEAR;
+    VkFilter                min_filter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode     mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode    address_mode_u = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode    address_mode_v = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    bool operator==(const sampler_settings&) const = default;
+
+    struct hash {
+        size_t operator()(const sampler_settings& settings) const {
+            size_t value = 0xcbf29ce484222325ULL;
+            for (auto field: { (uint32_t)settings.mag_filter, (uint32_t)settings.min_filter, (uint32_t)settings.mipmap_mode, (uint32_t)settings.address_mode_u, (uint32_t)settings.address_mode_v }) {
+                value = (value ^ field) * 0x100000001b3ULL;
+            }
+            return value;
+        }
+    };
+};
+
 struct global_descriptor {
     VkDescriptorSetLayout   set_layout;
     VkPipelineLayout        pipeline_layout;
     VkDescriptorSet         set;
 
-    std::vector<uint32_t>   index_pool[3];
-
-    static constexpr uint32_t pool_size = 1024U;
-
-    global_descriptor() {
-        for (int32_t index = pool_size; index > 0; index--) {
-            index_pool[0].push_back((uint32_t)index);
-            index_pool[1].push_back((uint32_t)index);
-            index_pool[2].push_back((uint32_t)index);
+    // Descriptors of the sampler, sampled image and storage image bindings
+    uint32_t                capacities[3] = {};
+
+    // Free slots of each binding. Slots get a new generation when freed, so writes
+    // queued for a resource destroyed since are told apart from the ones of its successor
+    std::vector<uint32_t>   free_indices[3];
+    std::vector<uint32_t>   generations[3];
+    std::vector<bool>       allocated[3];
+
+    // Bounds the tables on devices reporting millions of update after bind descriptors
+    static constexpr uint32_t max_samplers = 4000U;
+    static constexpr uint32_t max_images = 1U << 16U;
+
+    // Slot 0 is never handed out, an index of 0 means no descriptor
+    void init(uint32_t sampler_capacity, uint32_t sampled_image_capacity, uint32_t storage_image_capacity) {
+        capacities[0] = sampler_capacity;
+        capacities[1] = sampled_image_capacity;
+        capacities[2] = storage_image_capacity;
+
+        for (uint32_t binding { 0U }; binding < 3U; binding++) {
+            free_indices[binding].clear();
+            for (auto index = capacities[binding] - 1U; index > 0U; index--) {
+                free_indices[binding].push_back(index);
+            }
+            generations[binding].assign(capacities[binding], 0U);
+            allocated[binding].assign(capacities[binding], false);
         }
     }
 
     uint32_t allocate(VkDescriptorType type) {
-        auto &pool = index_pool[descriptor_type_binding(type)];
+        auto binding = descriptor_type_binding(type);
+        auto &pool = free_indices[binding];
+        assert(!pool.empty() && "bindless table full");
+        if (pool.empty()) {
+            return 0U;
+        }
+
         auto index = pool.back();
         pool.pop_back();
+        allocated[binding][index] = true;
 
         return index;
     }
 
     void free(uint32_t index, VkDescriptorType type) {
-        assert(index != 0);
-        index_pool[descriptor_type_binding(type)].push_back(index);
+        auto binding = descriptor_type_binding(type);
+        assert(index != 0 && index < capacities[binding] && allocated[binding][index] && "descriptor freed twice");
+
+        allocated[binding][index] = false;
+        generations[binding][index]++;
+        free_indices[binding].push_back(index);
+    }
+
+    [[nodiscard]] uint32_t generation(uint32_t index, VkDescriptorType type) const {
+        return generations[descriptor_type_binding(type)][index];
     }
 
     static int32_t descriptor_type_binding(VkDescriptorType type) {
@@ -115,11 +178,16 @@ class vkapi {
 
         handle create_buffer(size_t data_size, VkBufferUsageFlags buffer_usage, uint32_t mem_usage);
         void copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t size);
-        void copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t size, size_t buffer_offset = 0);
+        void copy_buffer_range(VkCommandBuffer cmd_buf, handle src, handle dst, size_t src_offset, size_t dst_offset, size_t size);
+        void copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t size, size_t buffer_offset = 0, uint32_t mip_level = 0);
+        // Rows of one layer of a level, tightly packed in the buffer. Compressed rows are whole block rows
+        void copy_buffer_rows(VkCommandBuffer cmd_buf, handle src, handle dst, size_t buffer_offset, uint32_t mip_level, uint32_t layer, uint32_t first_row, uint32_t row_count);
+        // Level 0 of every layer, the images are in TRANSFER_SRC and TRANSFER_DST
+        void copy_image(VkCommandBuffer command_buffer, handle src, handle dst);
         void destroy_buffer(handle buffer);
 
 
-        handle create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usages);
+        handle create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usages, VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_2D, uint32_t layer_count = 1, uint32_t mip_levels = 1);
         void destroy_image(handle image);
         std::vector<handle> create_images(VkExtent3D size, VkFormat format, VkImageUsageFlags usages, size_t image_count);
         void destroy_images(std::vector<handle>& imgs);
@@ -136,11 +204,23 @@ class vkapi {
         [[nodiscard]] std::vector<VkSemaphore> create_semaphores(size_t semaphores_count) const;
         void destroy_semaphores(VkSemaphore semaphores[], size_t semaphores_count) const;
 
-        handle create_sampler(VkFilter filter, VkSamplerAddressMode address_mode);
+        [[nodiscard]] VkSemaphore create_timeline_semaphore(uint64_t initial_value) const;
+        [[nodiscard]] uint64_t semaphore_value(VkSemaphore timeline_semaphore) const;
+        void wait_semaphore(VkSemaphore timeline_semaphore, uint64_t value) const;
+
+        [[nodiscard]] VkQueryPool create_timestamp_pool(uint32_t query_count) const;
+        void destroy_query_pool(VkQueryPool query_pool) const;
+        void reset_queries(VkCommandBuffer command_buffer, VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) const;
+        void write_timestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage, VkQueryPool query_pool, uint32_t query) const;
+        // Milliseconds between the timestamps first_query and first_query + 1, false until the GPU wrote both
+        [[nodiscard]] bool get_elapsed_time(VkQueryPool query_pool, uint32_t first_query, float& elapsed_ms) const;
+
+        handle create_sampler(const sampler_settings& settings);
         void destroy_sampler(handle sampler);
 
 
         [[nodiscard]] VkCommandPool create_command_pool() const;
+        [[nodiscard]] VkCommandPool create_command_pool(uint32_t queue_family_index) const;
 
         void allocate_command_buffers(VkCommandPool command_pool, VkCommandBuffer* command_buffers, size_t count) const;
 
@@ -156,7 +236,8 @@ class vkapi {
         void destroy_framebuffers(std::vector<framebuffer>& framebuffers) const;
 
 
-        pipeline create_compute_pipeline(const char* shader_name) const;
+        // Specialization constant i takes the value specialization_constants[i]
+        pipeline create_compute_pipeline(const char* shader_name, const std::vector<uint32_t>& specialization_constants = {}) const;
         pipeline create_graphics_pipeline(const char* shader_name, VkShaderStageFlagBits shader_stages, VkRenderPass render_pass, std::vector<VkDynamicState>& dynamic_states) const;
         void destroy_pipeline(pipeline &pipeline) const;
 
@@ -168,31 +249,66 @@ class vkapi {
         swapchain create_swapchain(VkSurfaceKHR surface, size_t min_image_count, VkImageUsageFlags usages, VkSwapchainKHR old_swapchain);
         void destroy_swapchain(swapchain& swapchain);
 
+        // Queued, written by flush_descriptor_writes
         void update_descriptor_image(handle img, VkDescriptorType type);
-        void update_descriptor_images(std::vector<handle> &images, VkDescriptorType type);
         void update_descriptor_sampler(handle sampler);
-        void update_descriptor_samplers(std::vector<handle> &samplers);
+
+        // Writes the queued descriptors in one update, the set is update after bind so the
+        // frames in flight keep running. Slots freed since they were queued are skipped
+        void flush_descriptor_writes();
 
 
         void update_constants(VkCommandBuffer command_buffer, VkShaderStageFlagBits shader_stage, off_t offset, size_t size, void* data);
 
         void start_record(VkCommandBuffer command_buffer);
 
-        void image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layout, VkPipelineStageFlagBits dst_stage, VkAccessFlags dst_access, handle image);
+        // Different families make it an ownership transfer, recorded twice with the same layout: the release on a
+        // queue of src_family, then the acquire on a queue of dst_family after a semaphore wait on the release.
+        // The release ignores dst_stage and dst_access
+        void image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, handle image, uint32_t src_family = VK_QUEUE_FAMILY_IGNORED, uint32_t dst_family = VK_QUEUE_FAMILY_IGNORED);
+
+        // The next barrier drops the contents, so another queue family can write the image without an
+        // ownership transfer. The queues that used it have to be done with it
+        void discard_image(handle image);
+
+        // Orders every memory access of the given stages, for buffers written and read on the GPU
+        void memory_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+        // Queue family ownership transfer of transfer writes. The release is recorded on the source queue, the
+        // acquire on the destination queue after a semaphore wait on the release. Within one family both record nothing
+        void release_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t src_family, uint32_t dst_family);
+        void acquire_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+        // Inline update of at most 64KB, recorded in the command buffer
+        void update_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, const void* data);
+
+        void fill_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t value);
 
         void begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass render_pass, std::vector<VkImageView>& attachments, framebuffer framebuffer, VkExtent2D size);
         void end_render_pass(VkCommandBuffer command_buffer);
 
         void run_compute_pipeline(VkCommandBuffer command_buffer, pipeline& pipeline, size_t group_count_x, size_t group_count_y, size_t group_count_z);
+        void run_compute_pipeline_indirect(VkCommandBuffer command_buffer, pipeline& pipeline, handle arguments_buffer, size_t arguments_offset);
 
         void draw(VkCommandBuffer command_buffer, pipeline& pipeline, uint32_t vertex_count, uint32_t vertex_offset);
         void draw(VkCommandBuffer command_buffer, pipeline& pipeline, handle index_buffer, uint32_t primitive_count, uint32_t indices_offset, uint32_t vertices_offset);
 
         void blit_full(VkCommandBuffer command_buffer, handle src_image, handle dst_image);
 
+        // Downsamples each level from the previous one, the image must be in TRANSFER_DST with level 0 written
+        void generate_mipmaps(VkCommandBuffer command_buffer, handle image);
+
         void end_record(VkCommandBuffer command_buffer);
 
-        VkResult submit(VkCommandBuffer command_buffers[], size_t command_buffers_count, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, VkFence submission_fence) const;
+        // The timeline wait holds the transfers and compute shaders until its semaphore reaches its value,
+        // the timeline signal is set once the command buffers complete
+        VkResult submit(VkCommandBuffer command_buffers[], size_t command_buffers_count, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, timeline_point timeline_wait = {}, timeline_point timeline_signal = {}) const;
+
+        // Signals timeline_semaphore with signal_value once the command buffer completes on the transfer queue
+        VkResult submit_transfer(VkCommandBuffer command_buffer, VkSemaphore timeline_semaphore, uint64_t signal_value) const;
+
+        // On the compute queue, the compute shaders wait for every semaphore
+        VkResult submit_compute(VkCommandBuffer command_buffer, const VkSemaphore wait_semaphores[], uint32_t wait_semaphores_count, VkSemaphore signal_semaphore, timeline_point timeline_signal = {}) const;
 
         VkResult present(swapchain& swapchain, uint32_t image_index, VkSemaphore wait_semaphore) const;
 
@@ -206,6 +322,15 @@ class vkapi {
 
         global_descriptor   bindless_descriptor;
 
+        struct descriptor_write {
+            VkDescriptorType    type;
+            uint32_t            index;
+            uint32_t            generation;
+            VkImageView         view;
+            VkSampler           sampler;
+        };
+        std::vector<descriptor_write> pending_descriptor_writes;
+
         static const char* shader_stage_extension(VkShaderStageFlags shader_stage);
 
         // TODO: Use freelists instead
@@ -215,6 +340,9 @@ class vkapi {
 
         VkDescriptorPool        descriptor_pool;
 
+        // Nanoseconds per timestamp tick
+        float                   timestamp_period;
+
 };
 
 #endif // !__VK_API_HPP_
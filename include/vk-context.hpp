@@ -25,6 +25,33 @@ class vkcontext {
 
         queue               graphics_queue;
 
+        // Family without graphics or compute when the device has one, copies there overlap the frames.
+        // Otherwise the graphics queue itself
+        queue               transfer_queue;
+
+        // Family with compute but without graphics, the post processing of a frame runs there while the
+        // next one traces. Otherwise the graphics queue itself
+        queue               compute_queue;
+
+        // Subgroup size and the operations compute shaders can use
+        VkPhysicalDeviceSubgroupProperties  subgroup_properties;
+
+        // Identifies the device across runs
+        VkPhysicalDeviceIDProperties        id_properties;
+
+        VkPhysicalDeviceLimits              limits;
+
+        // Update after bind limits the bindless tables are sized from
+        VkPhysicalDeviceDescriptorIndexingProperties descriptor_indexing_properties;
+
+        // Half precision arithmetic in shaders, enabled on the device when available
+        bool                                supports_shader_float16 = false;
+
+        // BC1 to BC7 sampled images, the glTF textures stay RGBA8 without it
+        bool                                supports_texture_compression_bc = false;
+
+        [[nodiscard]] bool supports_compute_subgroup_operations(VkSubgroupFeatureFlags operations) const;
+
     private:
         void create_instance();
 
@@ -36,7 +63,8 @@ class vkcontext {
 
         void select_physical_device();
 
-        [[nodiscard]] uint32_t select_queue(VkQueueFlags queue_usage) const;
+        // First family with one of the usages and none of the excluded ones, UINT_MAX without any
+        [[nodiscard]] uint32_t select_queue(VkQueueFlags queue_usage, VkQueueFlags excluded_usage = 0) const;
 
         static void check_available_instance_layers(const char* needed_layers[], size_t needed_layers_count);
 
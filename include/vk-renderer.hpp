@@ -3,14 +3,18 @@
 
 #include <cstdint>
 #include <format>
+#include <unordered_map>
 #include <vector>
 
 #include "vk-context.hpp"
 #include "vk-api.hpp"
+#include "texture-streamer.hpp"
+#include "upload-engine.hpp"
 
 
 class Renderpass;
 class ComputeRenderpass;
+class WavefrontRenderpass;
 class PrimitiveRenderpass;
 class Primitive;
 class window;
@@ -23,7 +27,8 @@ class RingBuffer;
 class Buffer {
     public:
 
-    Buffer(size_t size, VkBufferUsageFlagBits usage);
+    // Device local buffers are not mapped, their writes go through the staging buffers
+    Buffer(size_t size, VkBufferUsageFlags usage, bool device_local = false);
     ~Buffer();
 
     void write(void* data, off_t alloc_offset, size_t data_size) const;
@@ -34,7 +39,9 @@ class Buffer {
 
     size_t buffer_size;
 
-    VkBufferUsageFlagBits usage;
+    VkBufferUsageFlags usage;
+
+    bool device_local;
 };
 
 
@@ -53,21 +60,57 @@ class vkrenderer {
 
         void finish_frame();
 
+        // Textures with async_upload go through the transfer queue, the others are copied by the next frame
         static void queue_image_update(Texture* texture);
 
+        // Drops the copy of a texture queued for the next frame, before the texture is deleted
+        static void cancel_image_update(const Texture* texture);
+
+        // The data is copied, it is uploaded in chunks on the transfer queue
+        static void queue_buffer_update(const Buffer* buffer, const void* data, size_t offset, size_t size);
+
+        // Submits the transfer queue uploads until they are all done, the scene data has to be
+        // complete before the first frame traces it
+        void flush_uploads();
+
         static Buffer* create_buffer(size_t size);
 
         static Buffer* create_index_buffer(size_t size);
 
         static Buffer* create_staging_buffer(size_t size);
 
-        static Texture* create_2d_texture(size_t width, size_t height, VkFormat format, Sampler *sampler = nullptr);
+        // Storage buffer that can be cleared on the GPU, for atomic counters
+        static Buffer* create_counter_buffer(size_t size);
+
+        // Storage buffer of static scene data, device local unless device_local_scene_data is false
+        static Buffer* create_scene_buffer(size_t size);
+
+        static Texture* create_2d_texture(size_t width, size_t height, VkFormat format, Sampler *sampler = nullptr, uint32_t mip_levels = 1);
+
+        static Texture* create_2d_texture_array(size_t width, size_t height, size_t layers, VkFormat format);
 
         static Sampler* create_sampler(VkFilter filter, VkSamplerAddressMode address_mode);
 
+        // Samplers with the same settings are shared
+        static Sampler* create_sampler(const sampler_settings& settings);
+
 
         ComputeRenderpass* create_compute_renderpass();
 
+        // Compute pass run once the others are done, on the compute queue with async_post. It reads
+        // what they wrote through post_input, the next frame starts tracing while it runs
+        ComputeRenderpass* create_post_renderpass();
+
+        // Copy of the traced texture the post passes of this frame read, taken once the tracing is done.
+        // The traced texture itself when the post passes run on the graphics queue
+        Texture* post_input(Texture* traced);
+
+        // Compute pass writing the swapchain image acquired for the frame, it gets
+        // the image as output texture once acquired
+        void set_present_pass(ComputeRenderpass* pass) { present_pass = pass; }
+
+        WavefrontRenderpass* create_wavefront_renderpass();
+
         PrimitiveRenderpass* create_primitive_renderpass();
 
         Primitive* create_primitive(PrimitiveRenderpass& primitive_render_pass);
@@ -80,36 +123,70 @@ class vkrenderer {
 
         [[nodiscard]]VkFormat back_buffer_format() const { return swapchain.surface_format.format; }
 
-        static constexpr uint32_t       virtual_frames_count = 2;
+        // Milliseconds the last begin_frame blocked on the GPU finishing the frame of its virtual frame
+        [[nodiscard]]float frame_wait_time() const { return frame_wait_ms; }
+
+        // Frames recorded ahead of the GPU, set before the renderer and the scene are created. More of them
+        // keep the GPU busy when the CPU time varies, at the cost of a frame of latency each
+        static uint32_t                 virtual_frames_count;
+
+        // Per virtual frame, for the textures copied on the graphics queue. Their uploads have to fit in it
+        static constexpr size_t         staging_buffer_size = 4096ULL * 4096ULL * sizeof(uint32_t);
 
         static vkcontext                context;
 
         static vkapi                    api;
 
+        // Streams the glTF texture levels asked for by the shaders
+        static texture_streamer         streamer;
+
+        // Host visible scene data, to compare the traversal speed against device local memory
+        static bool                     device_local_scene_data;
+
+        // Post passes on the compute queue when the device has one, set before the renderer is created.
+        // Off by default, the copy into post_input may cost as much as the overlap saves
+        static bool                     async_post;
+
     private:
 
 
         void handle_swapchain_result(VkResult function_result);
 
+        [[nodiscard]] static bool async_post_processing() { return async_post && context.compute_queue.index != context.graphics_queue.index; }
+
         std::vector<Renderpass*>        renderpasses;
+        std::vector<Renderpass*>        post_renderpasses;
+
+        ComputeRenderpass*              present_pass = nullptr;
 
         uint32_t                        virtual_frame_index = 0;
         uint32_t                        swapchain_image_index = 0;
 
-        VkCommandBuffer                 graphics_command_buffers[virtual_frames_count];
-        VkCommandBuffer                 copy_command_buffers[virtual_frames_count];
+        std::vector<VkCommandBuffer>    graphics_command_buffers;
+        std::vector<VkCommandBuffer>    copy_command_buffers;
 
-        RingBuffer*                     staging_buffers[virtual_frames_count];
+        std::vector<RingBuffer*>        staging_buffers;
 
+        // The compute queue post processes a frame once its graphics submission signals traced_semaphores
+        VkCommandPool                   compute_command_pool;
+        std::vector<VkCommandBuffer>    compute_command_buffers;
+        std::vector<VkSemaphore>        traced_semaphores;
+        std::vector<Texture*>           post_inputs;
+        Texture*                        traced_texture = nullptr;
+        bool                            post_recorded = false;
 
-        pipeline                        tonemapping_pipeline;
+        // The last submission of each frame signals frame_semaphore with its frame number. A virtual frame
+        // is reused once the semaphore reaches the number of the frame that last used it
+        VkSemaphore                     frame_semaphore;
+        uint64_t                        submitted_frames = 0;
+        std::vector<uint64_t>           frame_numbers;
+        float                           frame_wait_ms = 0.f;
 
-        VkFence                         submission_fences[virtual_frames_count];
-        VkSemaphore                     execution_semaphores[virtual_frames_count];
-        VkSemaphore                     acquire_semaphores[virtual_frames_count];
+        std::vector<VkSemaphore>        execution_semaphores;
+        std::vector<VkSemaphore>        acquire_semaphores;
 
         VkCommandPool                   graphics_command_pool;
-        VkCommandPool                   copy_command_pools[virtual_frames_count];
+        std::vector<VkCommandPool>      copy_command_pools;
 
         VkSurfaceKHR                    platform_surface;
         swapchain                       swapchain;
@@ -119,6 +196,10 @@ class vkrenderer {
         const uint32_t                  min_swapchain_image_count = 3;
 
         static std::vector<Texture*>    upload_queue;
+
+        static upload_engine            uploads;
+
+        static std::unordered_map<sampler_settings, Sampler*, sampler_settings::hash> sampler_cache;
 };
 
 class RingBuffer {
@@ -151,6 +232,10 @@ class RingBuffer {
         ptr = 0;
     }
 
+    [[nodiscard]]size_t available() const {
+        return buffer_size - ptr;
+    }
+
     handle device_buffer;
 
     size_t buffer_size;
@@ -161,6 +246,9 @@ class Sampler {
     public:
 
     handle device_sampler;
+
+    // Filters and address modes it was created with, the CPU tracer samples the same way
+    sampler_settings settings;
 };
 
 class Texture {
@@ -171,46 +259,116 @@ class Texture {
         width = image.size.width;
         height = image.size.height;
         depth = image.size.depth;
+        layers = image.subresource_range.layerCount;
+        mip_levels = image.subresource_range.levelCount;
 
         device_image = image_handle;
     }
 
-    Texture(size_t width, size_t height, size_t depth, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, Sampler* texture_sampler = nullptr)
-        : width(width), height(height), depth(depth) {
+    // Streamed textures start with first_level as the image level 0, the finer levels are not resident
+    Texture(size_t width, size_t height, size_t depth, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, Sampler* texture_sampler = nullptr, uint32_t mip_levels = 1, uint32_t first_level = 0)
+        : width(width), height(height), depth(depth), mip_levels(mip_levels), first_level(first_level) {
         sampler = texture_sampler;
-        device_image = vkrenderer::api.create_image(
-            { .width = (uint32_t)width, .height = (uint32_t)height, .depth = 1 },
+        device_image = create_resident_image(format);
+    }
+
+    // Image holding the levels from first_level down to the end of the chain
+    [[nodiscard]]handle create_resident_image(VkFormat format) const {
+        // Compressed formats cannot be storage images
+        auto usages = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (!is_block_compressed(format)) {
+            usages |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+
+        return vkrenderer::api.create_image(
+            { .width = (uint32_t)level_extent(width, first_level), .height = (uint32_t)level_extent(height, first_level), .depth = 1 },
             format,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+            usages,
+            VK_IMAGE_VIEW_TYPE_2D,
+            1,
+            mip_levels - first_level
         );
     }
 
-    void update(void* new_data) {
-        if (data == nullptr) {
+    // Data the texture does not own, like a mapped cache payload, is never freed
+    void update(void* new_data, bool take_ownership = true) {
+        if (owns_data && data != nullptr && data != new_data) {
             free(data);
         }
         data = new_data;
+        owns_data = take_ownership;
 
         vkrenderer::queue_image_update(this);
     }
 
     ~Texture() {
+        assert(!(async_upload && upload_pending) && "the transfer queue is still copying the texture");
+        if (upload_pending) {
+            vkrenderer::cancel_image_update(this);
+        }
+
         vkrenderer::api.destroy_image(device_image);
 
-        if (data == nullptr) {
+        if (owns_data && data != nullptr) {
             free(data);
         }
     }
 
+    // Data holding level 0 only is uploaded alone, the other levels are generated on the GPU.
+    // Blits cannot write compressed images, data holds every level one after the other instead
     [[nodiscard]]size_t size() const {
         const auto& image = vkrenderer::api.get_image(device_image);
-        return width * height * depth * pixel_size(image.format);
+        if (data_levels == 1) {
+            return width * height * depth * layers * pixel_size(image.format);
+        }
+
+        return data_offset(image.format, mip_levels) - data_offset(image.format, first_level);
+    }
+
+    // Offset in data of a level of the chain
+    [[nodiscard]]size_t data_offset(VkFormat format, uint32_t level) const {
+        size_t offset = 0;
+        for (uint32_t parent_level { 0U }; parent_level < level; parent_level++) {
+            offset += level_size(format, level_extent(width, parent_level), level_extent(height, parent_level)) * layers;
+        }
+        return offset;
+    }
+
+    static size_t level_extent(size_t size, uint32_t level) {
+        return (size >> level) > 0 ? size >> level : 1;
+    }
+
+    // Bytes of one level of one layer, compressed levels are padded to whole 4x4 blocks
+    static size_t level_size(VkFormat format, size_t width, size_t height) {
+        if (is_block_compressed(format)) {
+            return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+        }
+
+        return width * height * pixel_size(format);
+    }
+
+    static bool is_block_compressed(VkFormat format) {
+        return format == VK_FORMAT_BC5_UNORM_BLOCK || format == VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+
+    // Levels of a chain down to 1x1
+    static uint32_t full_mip_levels(size_t width, size_t height) {
+        auto largest_side = width > height ? width : height;
+        uint32_t levels = 1;
+        while ((largest_side >> levels) > 0) {
+            levels++;
+        }
+        return levels;
     }
 
     static size_t pixel_size(VkFormat format) {
         switch (format) {
             case VK_FORMAT_R8G8B8A8_UNORM:
                 return 4;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return 8;
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                return 16;
             default:
                 return 0;
         }
@@ -219,10 +377,23 @@ class Texture {
     Sampler* sampler    = nullptr;
 
     void* data          = nullptr;
+    bool owns_data      = true;
 
     size_t width        = 0;
     size_t height       = 0;
     size_t depth        = 0;
+    size_t layers       = 1;
+
+    // Levels of the full chain, data holds data_levels of them and the image the ones from first_level
+    uint32_t mip_levels     = 1;
+    uint32_t data_levels    = 1;
+    uint32_t first_level    = 0;
+
+    // Queued for update_images and not copied yet
+    bool upload_pending     = false;
+
+    // Copied on the transfer queue. Only for new images the frames do not use before upload_pending clears
+    bool async_upload       = false;
 
     handle device_image;
 };
@@ -78,6 +78,7 @@ typedef struct _SECURITY_ATTRIBUTES SECURITY_ATTRIBUTES;
     X(vkCreateSemaphore)              \
     X(vkDestroySemaphore)             \
     X(vkWaitSemaphores)               \
+    X(vkGetSemaphoreCounterValue)     \
     X(vkCreateCommandPool)            \
     X(vkAllocateCommandBuffers)       \
     X(vkFreeCommandBuffers)           \
@@ -100,6 +101,14 @@ typedef struct _SECURITY_ATTRIBUTES SECURITY_ATTRIBUTES;
     X(vkCmdDraw)                      \
     X(vkCmdDrawIndexed)               \
     X(vkCmdDispatch)                  \
+    X(vkCmdDispatchIndirect)          \
+    X(vkCmdUpdateBuffer)              \
+    X(vkCmdFillBuffer)                \
+    X(vkCmdResetQueryPool)            \
+    X(vkCmdWriteTimestamp)            \
+    X(vkCreateQueryPool)              \
+    X(vkDestroyQueryPool)             \
+    X(vkGetQueryPoolResults)          \
     X(vkCmdEndRenderPass)             \
     X(vkEndCommandBuffer)             \
     X(vkResetCommandBuffer)           \
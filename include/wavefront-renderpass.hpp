@@ -0,0 +1,113 @@
+#pragma once
+
+#include "renderpass.hpp"
+#include "vk-api.hpp"
+
+class Texture;
+class Buffer;
+
+// Mirrors wavefront_state in shaders/include/wavefront.h
+struct wavefront_state {
+    static constexpr uint32_t bin_count = 16;
+
+    uint32_t        dispatch_args[3];
+    uint32_t        ray_count;
+    uint32_t        next_ray_count;
+    uint32_t        path_count;
+    uint32_t        accumulation_image_index;
+    uint32_t        bin_mode;
+    uint32_t        bin_counts[bin_count];
+    uint32_t        bin_cursors[bin_count];
+
+    // Queues of the paths, swapped on the GPU after each bounce
+    VkDeviceAddress current;
+    VkDeviceAddress next;
+    VkDeviceAddress hits;
+    VkDeviceAddress keys;
+    VkDeviceAddress order;
+    VkDeviceAddress radiance;
+};
+
+static_assert(sizeof(wavefront_state) == 208, "wavefront_state must match the shader layout");
+
+// Stage the paths are sorted before, by a counting sort into the order queue
+enum class BIN_MODE : uint32_t {
+    NONE,
+    DIRECTION,  // Rays by direction octant before the BVH traversal
+    MATERIAL,   // Hits by material before the shading
+};
+
+// Path tracing split in one dispatch per stage instead of the compute.comp megakernel.
+// Paths start in raygen, then each bounce finds the closest hits (extend), samples
+// the BRDFs (shade) and compacts the survivors in the next queue (advance). The
+// bounce dispatches are indirect, sized on the GPU by the rays still alive.
+class WavefrontRenderpass : public Renderpass {
+    public:
+
+    WavefrontRenderpass(vkapi& api);
+    ~WavefrontRenderpass() override;
+
+    // Allocates the queues for one path per pixel of every view
+    void resize(size_t width, size_t height, size_t view_count);
+
+    // Traces the paths of a reduced resolution only, at most the size given to resize
+    void set_render_extent(size_t width, size_t height, size_t view_count);
+
+    // Accumulation updated in place with the radiance of the paths
+    void set_ouput_texture(Texture* out_texture);
+
+    // Same scene constants as compute.comp, up to offset 56
+    void set_constant(off_t offset, Buffer* buffer, size_t buffer_offset = 0);
+
+    // Textures read by the pass without having their index in the constants
+    void add_input_texture(Texture* texture);
+
+    void set_bin_mode(BIN_MODE mode) { bin_mode = mode; }
+
+    // Bounce dispatches recorded each frame, the metadata max_bounce
+    void set_bounce_count(uint32_t count) { bounce_count = count; }
+
+    void execute(vkrenderer& renderer, VkCommandBuffer command_buffer) final;
+
+    Texture* output_texture;
+
+    private:
+
+    void destroy_queues();
+
+    // Indirect dispatch over the live rays, followed by the barrier the next stage needs
+    void dispatch_rays(VkCommandBuffer command_buffer, pipeline& stage);
+
+    void stage_barrier(VkCommandBuffer command_buffer);
+
+    void sort_rays(VkCommandBuffer command_buffer);
+
+    std::vector<Texture*> input_textures;
+
+    uint8_t constants[64];
+
+    size_t group_count_x = 0;
+    size_t group_count_y = 0;
+    size_t group_count_z = 0;
+
+    uint32_t path_count = 0;
+    uint32_t path_capacity = 0;
+    uint32_t bounce_count = 1;
+    BIN_MODE bin_mode = BIN_MODE::NONE;
+
+    handle state_buffer;
+    handle paths_buffers[2];
+    handle hits_buffer;
+    handle keys_buffer;
+    handle order_buffer;
+    handle radiance_buffer;
+    bool has_queues = false;
+
+    pipeline raygen_pipeline;
+    pipeline extend_pipeline;
+    pipeline shade_pipeline;
+    pipeline bin_count_pipeline;
+    pipeline bin_scatter_pipeline;
+    pipeline advance_pipeline;
+    pipeline accumulate_pipeline;
+};
@@ -34,35 +34,36 @@ vec3 sample_GGXVNDF(vec3 Ve, vec2 alpha2D, uint seed) {
     return normalize(vec3(alpha2D.x * Nh.x, alpha2D.y * Nh.y, max(0.0f, Nh.z)));
 }
 
-// Smith G1 term (masking function) further optimized for GGX distribution (by substituting G_a into G1_GGX)
-float Smith_G1_GGX(float alpha, float NdotS, float alpha_squared, float NdotS_squared) {
-    return 2.0f / (sqrt(((alpha_squared * (1.0f - NdotS_squared)) + NdotS_squared) / NdotS_squared) + 1.0f);
+// Smith G1 term (masking function) further optimized for GGX distribution (by substituting G_a into G1_GGX).
+// Evaluated in float: at grazing angles NdotS squared is subnormal in half precision and flushes to 0
+shade_float Smith_G1_GGX(shade_float alpha, shade_float NdotS, float alpha_squared, float NdotS_squared) {
+    return shade_float(2.0f / (sqrt(((alpha_squared * (1.0f - NdotS_squared)) + NdotS_squared) / NdotS_squared) + 1.0f));
 }
 
 // Weight for the reflection ray sampled from GGX distribution using VNDF method
-float specular_sample_weight_GGXVNDF(float alpha, float alpha_squared, float NdotL, float NdotV, float HdotL, float NdotH) {
+shade_float specular_sample_weight_GGXVNDF(shade_float alpha, shade_float alpha_squared, shade_float NdotL, shade_float NdotV, shade_float HdotL, shade_float NdotH) {
 #if USE_HEIGHT_CORRELATED_G2
     return Smith_G2_Over_G1_Height_Correlated(alpha, alpha_squared, NdotL, NdotV);
 #else 
-    return Smith_G1_GGX(alpha, NdotL, alpha_squared, NdotL * NdotL);
+    return Smith_G1_GGX(alpha, NdotL, float(alpha_squared), float(NdotL) * float(NdotL));
 #endif
 }
 
-vec3 base_color_to_specular_F0(vec3 base_color, float metalness) {
-    return mix(vec3(MIN_DIELECTRICS_F0), base_color, metalness);
+shade_vec3 base_color_to_specular_F0(shade_vec3 base_color, shade_float metalness) {
+    return mix(shade_vec3(MIN_DIELECTRICS_F0), base_color, metalness);
 }
 
-vec3 base_color_to_diffuse_reflectance(vec3 base_color, float metalness) {
-    return base_color * (1.0f - metalness);
+shade_vec3 base_color_to_diffuse_reflectance(shade_vec3 base_color, shade_float metalness) {
+    return base_color * (shade_float(1.0f) - metalness);
 }
 
 // Schlick's approximation to Fresnel term
 // f90 should be 1.0, except for the trick used by Schuler (see 'shadowed_F90' function)
-vec3 eval_fresnel_schlick(vec3 f0, float f90, float NdotS) {
-    return f0 + (f90 - f0) * pow(1.0f - NdotS, 5.0f);
+shade_vec3 eval_fresnel_schlick(shade_vec3 f0, shade_float f90, shade_float NdotS) {
+    return f0 + (f90 - f0) * pow(shade_float(1.0f) - NdotS, shade_float(5.0f));
 }
 
-vec3 eval_fresnel(vec3 f0, float f90, float NdotS) {
+shade_vec3 eval_fresnel(shade_vec3 f0, shade_float f90, shade_float NdotS) {
     // Default is Schlick's approximation
     return eval_fresnel_schlick(f0, f90, NdotS);
 }
@@ -72,28 +73,29 @@ vec3 eval_fresnel(vec3 f0, float f90, float NdotS) {
 // Also see section "Overbright highlights" in Hoffman's 2010 "Crafting Physically Motivated Shading Models for Game Development" for discussion
 // IMPORTANT: Note that when F0 is calculated using metalness, it's value is never less than MIN_DIELECTRICS_F0, and therefore,
 // this adjustment has no effect. To be effective, F0 must be authored separately, or calculated in different way. See main text for discussion.
-float shadowed_F90(vec3 F0) {
+shade_float shadowed_F90(shade_vec3 F0) {
     // This scaler value is somewhat arbitrary, Schuler used 60 in his article. In here, we derive it from MIN_DIELECTRICS_F0 so
     // that it takes effect for any reflectance lower than least reflective dielectrics
     //const float t = 60.0f;
-    const float t = (1.f / MIN_DIELECTRICS_F0);
-    return min(1.f, t * luminance(F0));
+    const shade_float t = shade_float(1.f / MIN_DIELECTRICS_F0);
+    return min(shade_float(1.f), t * luminance(F0));
 }
 
-float get_brdf_probability(vec3 color, float metalness, vec3 view, vec3 shading_normal) {
+shade_float get_brdf_probability(shade_vec3 color, shade_float metalness, vec3 view, vec3 shading_normal) {
     // Evaluate Fresnel term using the shading normal
     // Note: we use the shading normal instead of the microfacet normal (half-vector) for Fresnel term here. That's suboptimal for rough surfaces at grazing angles, but half-vector is yet unknown at this point
-    vec3 specular_F0 = vec3(luminance(base_color_to_specular_F0(color, metalness)));
-    float diffuse_reflectance = luminance(base_color_to_diffuse_reflectance(color, metalness));
-    float fresnel = clamp(luminance(eval_fresnel(specular_F0, shadowed_F90(specular_F0), max(0.0f, dot(view, shading_normal)))), 0.0, 1.0);
+    shade_vec3 specular_F0 = shade_vec3(luminance(base_color_to_specular_F0(color, metalness)));
+    shade_float diffuse_reflectance = luminance(base_color_to_diffuse_reflectance(color, metalness));
+    shade_float NdotV = shade_float(max(0.0f, dot(view, shading_normal)));
+    shade_float fresnel = clamp(luminance(eval_fresnel(specular_F0, shadowed_F90(specular_F0), NdotV)), shade_float(0.0f), shade_float(1.0f));
 
     // Approximate relative contribution of BRDFs using the Fresnel term
-    float specular = fresnel;
-    float diffuse = diffuse_reflectance * (1.0f - fresnel); //< If diffuse term is weighted by Fresnel, apply it here as well
+    shade_float specular = fresnel;
+    shade_float diffuse = diffuse_reflectance * (shade_float(1.0f) - fresnel); //< If diffuse term is weighted by Fresnel, apply it here as well
 
     // Return probability of selecting specular BRDF over diffuse BRDF
-    float p = (specular / max(0.0001f, (specular + diffuse)));
+    shade_float p = (specular / max(shade_float(0.0001f), (specular + diffuse)));
 
     // Clamp probability to avoid undersampling of less prominent BRDF
-    return clamp(p, 0.1f, 0.9f);
+    return clamp(p, shade_float(0.1f), shade_float(0.9f));
 }
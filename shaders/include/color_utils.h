@@ -1,3 +1,5 @@
+#include "precision.h"
+
 vec3 linear_to_srgb(vec3 color)
 {
     color = clamp(color, 0.0f, 1.0f);
@@ -9,14 +11,14 @@ vec3 linear_to_srgb(vec3 color)
     );
 }
  
-vec3 srgb_to_linear(vec3 color)
+shade_vec3 srgb_to_linear(shade_vec3 color)
 {
-    color = clamp(color, 0.0f, 1.0f);
+    color = clamp(color, shade_float(0.0f), shade_float(1.0f));
      
     return mix(
-        pow(((color + 0.055f) / 1.055f), vec3(2.4f)),
-        color / 12.92f,
-        less_than(color, 0.04045f)
+        pow(((color + shade_float(0.055f)) / shade_float(1.055f)), shade_vec3(2.4f)),
+        color / shade_float(12.92f),
+        lessThan(color, shade_vec3(0.04045f))
     );
 }
 
@@ -24,3 +26,10 @@ float luminance(vec3 rgb)
 {
     return dot(rgb, vec3(0.2126f, 0.7152f, 0.0722f));
 }
+
+#ifdef SHADING_FP16
+float16_t luminance(f16vec3 rgb)
+{
+    return dot(rgb, f16vec3(0.2126f, 0.7152f, 0.0722f));
+}
+#endif
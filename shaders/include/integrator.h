@@ -0,0 +1,262 @@
+// Path tracing steps shared by the megakernel and the wavefront stages
+
+bool debug_bvh() {
+    return DEBUG_BVH == SCENE_VALUE ? bufs.scene.debug_bvh == 1 : DEBUG_BVH == 1;
+}
+
+bool enable_dof() {
+    return ENABLE_DOF == SCENE_VALUE ? bufs.scene.enable_dof == 1 : ENABLE_DOF == 1;
+}
+
+uint max_bounce() {
+    return MAX_BOUNCE == SCENE_VALUE ? bufs.scene.max_bounce : MAX_BOUNCE;
+}
+
+// Pixels traced per view, the view size divided by the downscale factor. They are
+// accumulated in the top left corner of the accumulation, then upscaled by upscale.comp
+uvec2 render_extent() {
+    uint factor = uint(bufs.scene.downscale_factor);
+    return (uvec2(bufs.scene.width, bufs.scene.height) + factor - 1) / factor;
+}
+
+// Footprint of a path, the width of the cone at its origin and how fast it grows with distance
+struct ray_cone {
+    float width;
+    float spread;
+};
+
+// Angle covered by one pixel of the view, the cone of the camera rays
+float pixel_spread_angle(uint view) {
+    camera cam = bufs.scene.cams[view];
+    vec3 plane_center = cam.first_pixel.xyz + 0.5 * (cam.horizontal.xyz + cam.vertical.xyz);
+    return length(cam.vertical.xyz) / (float(render_extent().y) * distance(plane_center, cam.position.xyz));
+}
+
+// Texture level of the cone footprint on the triangle, without the texture size term.
+// See "Texture Level of Detail Strategies for Real-Time Ray Tracing", Ray Tracing Gems
+float cone_lod(triangle tri, ray_cone cone, vec3 direction, vec3 normal) {
+    float world_area = length(cross(tri.positions[1] - tri.positions[0], tri.positions[2] - tri.positions[0]));
+    vec2 uv_edge1 = tri.uvs[1] - tri.uvs[0];
+    vec2 uv_edge2 = tri.uvs[2] - tri.uvs[0];
+    float uv_area = abs(uv_edge1.x * uv_edge2.y - uv_edge2.x * uv_edge1.y);
+
+    float texel_density = 0.5 * log2(max(uv_area, 1e-12) / max(world_area, 1e-12));
+    return texel_density + log2(max(abs(cone.width), 1e-12) / max(abs(dot(direction, normal)), 1e-4));
+}
+
+// Compute shaders have no implicit derivatives, the level comes from the cone instead.
+// Texture ids index the streamed texture table, the level asked for is recorded for
+// texture_streamer and the finest resident one is sampled meanwhile
+vec4 sample_texture(tex t, vec2 uv, float lod) {
+    streamed_texture streamed = bufs.scene.streamed_textures.entries[t.texture_id];
+    float level = max(lod + streamed.lod_offset, 0.0);
+
+    // Most invocations find their level already recorded and skip the atomic
+    uint requested_level = uint(level);
+    if (requested_level < bufs.scene.streaming_feedback.requested_levels[t.texture_id]) {
+        atomicMin(bufs.scene.streaming_feedback.requested_levels[t.texture_id], requested_level);
+    }
+
+    return textureLod(
+        sampler2D(
+            textures[nonuniformEXT(streamed.image_index)],
+            samplers[nonuniformEXT(t.sampler_id)]
+        ), uv, max(level - float(streamed.first_level), 0.0)
+    );
+}
+
+// One bounce of the path, samples the BRDF at the hit and turns r into the next ray.
+// The cone is carried to the hit then widened by the BRDF lobe. Returns false when the path ends
+bool scatter(inout ray r, hit_info info, uint bounce, inout vec3 throughput, inout ray_cone cone, inout uint seed) {
+    vec3 v = -r.direction;
+
+    triangle tri = get_triangle(info.primitive_id);
+
+    vec2 uv = interpolate_attribute(tri.uvs, info.barycentrics);
+    vec3 shading_normal = normalize(interpolate_attribute(tri.normals, info.barycentrics));
+
+    // Camera rays are not normalized, t is scaled by their length
+    cone.width += cone.spread * info.t * length(r.direction);
+    float lod = cone_lod(tri, cone, normalize(r.direction), info.geometry_normal);
+
+    // Colors and BRDF weights use the shading precision, see precision.h
+    shade_vec3 diffuse_color = srgb_to_linear(shade_vec3(sample_texture(tri.mat.base_color_texture, uv, lod).xyz)) * shade_vec3(tri.mat.base_color.xyz);
+    shade_vec2 metalness_roughness = shade_vec2(sample_texture(tri.mat.metallic_roughness_texture, uv, lod).xy * vec2(tri.mat.metalness, tri.mat.roughness));
+
+    if (dot(info.geometry_normal, v) < 0.f) info.geometry_normal = -info.geometry_normal;
+    if (dot(info.geometry_normal, shading_normal) < 0.0f) shading_normal = -shading_normal;
+
+    uint brdf_type;
+    if (metalness_roughness.x == 1.f && metalness_roughness.y == 0.f) {
+        brdf_type = SPECULAR;
+    } else {
+        float brdf_probability = float(get_brdf_probability(diffuse_color, metalness_roughness.x, -r.direction, shading_normal));
+        if (rand(seed) < brdf_probability) {
+            brdf_type = SPECULAR;
+            throughput /= brdf_probability;
+        } else {
+            brdf_type = DIFFUSE;
+            throughput /= (1.0 - brdf_probability);
+        }
+    }
+
+    // Ignore ray coming from below the hemisphere
+    if (dot(shading_normal, v) <= 0.f) return false;
+
+    // Move to tangent space
+    vec4 rotation_to_z = rotation_to_z_axis(shading_normal);
+    vec3 view_local = rotate_point(rotation_to_z, -r.direction);
+    vec3 normal_local = vec3(0.0, 0.0, 1.0);
+    vec3 ray_dir_local;
+    shade_vec3 sample_weight;
+
+    if (brdf_type == DIFFUSE) { // Lambertian diffuse
+        vec2 r = vec2(rand(seed), rand(seed));
+        ray_dir_local = sample_hemisphere(r);
+        sample_weight = base_color_to_diffuse_reflectance(diffuse_color, metalness_roughness.x);
+    } else if (brdf_type == SPECULAR) {
+        shade_float alpha = metalness_roughness.y * metalness_roughness.y;
+        shade_float alpha_squared = alpha * alpha;
+
+        vec3 half_local;
+        if (alpha == 0.0f) {
+                // Fast path for zero roughness (perfect reflection), also prevents NaNs appearing due to divisions by zeroes
+                half_local = vec3(0.0f, 0.0f, 1.0f);
+        } else {
+                // For non-zero roughness, this calls VNDF sampling for GG-X distribution or Walter's sampling for Beckmann distribution
+                half_local = sample_GGXVNDF(view_local, vec2(alpha), seed);
+        }
+
+        // Reflect view direction to obtain light vector
+        vec3 light_local = reflect(-view_local, half_local);
+
+        shade_vec3 specular_F0 = base_color_to_diffuse_reflectance(diffuse_color, metalness_roughness.x);
+
+        // Note: HdotL is same as HdotV here
+        // Clamp dot products here to small value to prevent numerical instability.
+        shade_float HdotL = shade_float(clamp(dot(half_local, light_local), MIN_SHADE_DOT, 1.0f));
+        shade_float NdotL = shade_float(clamp(dot(normal_local, light_local), MIN_SHADE_DOT, 1.0f));
+        shade_float NdotV = shade_float(clamp(dot(normal_local, view_local), MIN_SHADE_DOT, 1.0f));
+        shade_float NdotH = shade_float(clamp(dot(normal_local, half_local), MIN_SHADE_DOT, 1.0f));
+        shade_vec3 f = eval_fresnel(specular_F0, shadowed_F90(specular_F0), HdotL);
+
+        sample_weight = f * specular_sample_weight_GGXVNDF(alpha, alpha_squared, NdotL, NdotV, HdotL, NdotH);
+
+        ray_dir_local = light_local;
+    }
+
+    // Prevent tracing direction with no contribution
+    if (luminance(sample_weight) == 0.0f) return false;
+
+    // Move to global space
+    vec4 rotation_from_z = invert_rotation(rotation_to_z);
+    vec3 ray_dir = rotate_point(rotation_from_z, ray_dir_local);
+
+    // Prevent tracing direction "under" the hemisphere (behind the triangle)
+    if (dot(info.geometry_normal, ray_dir) <= 0.0f) return false;
+
+    throughput *= vec3(sample_weight);
+
+    // Rough lobes blur the footprint, a diffuse bounce covers about a radian
+    cone.spread += brdf_type == DIFFUSE ? 1.0 : float(metalness_roughness.y * metalness_roughness.y);
+
+    r = ray(info.point, ray_dir, 0.001f, 1e15);
+
+    // Russian Roulette
+    // As the throughput gets smaller, the ray is more likely to get terminated early.
+    // Survivors have their value boosted to make up for fewer samples being in the average.
+    if (bounce > bufs.scene.min_bounce) {
+        float probability = min(0.95f, luminance(throughput));
+        if (probability < rand(seed)) return false;
+        throughput /= probability;
+    }
+
+    return true;
+}
+
+vec3 ray_color(ray r, ray_cone cone, uint seed) {
+    hit_info info;
+    vec3 throughput = vec3(1.0);
+
+    for (uint bounce = 0; bounce < max_bounce(); bounce++) {
+        if (!hit_node(r, info))
+            return throughput * vec3(1.0);
+
+        if (!scatter(r, info, bounce, throughput, cone, seed))
+            break;
+    }
+
+    return vec3(0.0);
+}
+
+ray generate_camera_ray(ivec2 coords, uint view, uint seed) {
+    camera cam = bufs.scene.cams[view];
+    vec2 scene_size = vec2(render_extent() - 1);
+    vec2 uv = vec2(coords.x / scene_size.x, 1.0 - coords.y / scene_size.y);
+    vec2 rand_disk = disk_vec(vec2(rand(seed), rand(seed)));
+    vec2 jittered_uvs = uv + vec2(rand(seed), rand(seed)) / scene_size;
+    vec2 lens_disk = vec2(0.0);
+
+    if (enable_dof()) {
+        lens_disk = rand_disk * cam.lens_radius;
+    }
+
+    vec3 offset = lens_disk.x * cam.right.xyz + lens_disk.y * cam.up.xyz;
+    vec3 proj_plane_pos = cam.first_pixel.xyz + jittered_uvs.x * cam.horizontal.xyz + jittered_uvs.y * cam.vertical.xyz;
+
+    return ray(cam.position.xyz + offset, proj_plane_pos.xyz - cam.position.xyz - offset, 0.001f, 1e15);
+}
+
+void accumulate_samples(ivec3 accumulation_coords, uint accumulation_image_index, uint output_image_index, vec3 samples_sum, float samples_count) {
+    // The accumulation holds the linear sum of the samples and their count in alpha,
+    // CPU samples add to it unevenly. The compact format keeps the mean instead since
+    // half floats cannot hold large sums
+    vec4 accumulation = vec4(0.0);
+    if (bufs.scene.sample_index > 1) {
+        if (bufs.scene.compact_accumulation == 1) {
+            accumulation = imageLoad(images_f16[nonuniformEXT(accumulation_image_index)], accumulation_coords);
+            accumulation.rgb *= accumulation.a;
+        } else {
+            accumulation = imageLoad(images[nonuniformEXT(accumulation_image_index)], accumulation_coords);
+        }
+    }
+
+    vec3 color_sum = accumulation.rgb + samples_sum;
+    float sample_count = accumulation.a + samples_count;
+
+    if (bufs.scene.cpu_samples_image_index != 0) {
+        vec4 cpu_samples = imageLoad(images[nonuniformEXT(bufs.scene.cpu_samples_image_index)], accumulation_coords);
+        color_sum += cpu_samples.rgb;
+        sample_count += cpu_samples.a;
+    }
+
+    if (bufs.scene.compact_accumulation == 1) {
+        // Past 2048 the count stops being exact in half float, the mean then keeps
+        // converging as a moving average below the precision of its own storage
+        imageStore(images_f16[nonuniformEXT(output_image_index)], accumulation_coords, vec4(color_sum / sample_count, min(sample_count, 2048.0)));
+    } else {
+        imageStore(images[nonuniformEXT(output_image_index)], accumulation_coords, vec4(color_sum, sample_count));
+    }
+}
+
+// Traces the samples of the pixel at coords for this dispatch and adds their sum to the accumulation
+void trace_pixel(ivec2 coords, uint view, uint accumulation_image_index, uint output_image_index) {
+    uint seed = uint(coords.x * uint(1973) + coords.y * uint(9277) + view * uint(7919) + bufs.scene.sample_index * uint(26699)) | uint(1);
+
+    ray_cone camera_cone = ray_cone(0.0, pixel_spread_angle(view));
+
+    vec3 color_sum = vec3(0.0);
+    for (uint sample_id = 0; sample_id < bufs.scene.samples_per_dispatch; sample_id++) {
+        // Every sample starts its own random stream
+        uint sample_seed = pcg_hash(seed) | uint(1);
+        ray r = generate_camera_ray(coords, view, sample_seed);
+
+        if (debug_bvh()) {
+            color_sum += hit_aabbs(r) * vec3(0.001, 0.0, 0.0);
+        } else {
+            color_sum += ray_color(r, camera_cone, sample_seed);
+        }
+    }
+
+    accumulate_samples(ivec3(coords, view), accumulation_image_index, output_image_index, color_sum, float(bufs.scene.samples_per_dispatch));
+}
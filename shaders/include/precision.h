@@ -0,0 +1,15 @@
+// Types of the shading math: BRDF weights, Fresnel and texture colors.
+// A shader defining SHADING_FP16 (and enabling GL_EXT_shader_explicit_arithmetic_types_float16)
+// gets them in half precision. Ray directions, traversal and intersection stay in float
+#ifdef SHADING_FP16
+#define shade_float float16_t
+#define shade_vec2 f16vec2
+#define shade_vec3 f16vec3
+// Lower bound of the clamped dot products, 0.00001 is subnormal in half precision
+#define MIN_SHADE_DOT 1e-3f
+#else
+#define shade_float float
+#define shade_vec2 vec2
+#define shade_vec3 vec3
+#define MIN_SHADE_DOT 0.00001f
+#endif
@@ -162,7 +162,9 @@ bool hit_triangle(uint id, ray r, out hit_info info) {
     return true;
 }
 
-bool hit_node(ray r, out hit_info info) {
+// Walks the nodes in depth first order, entering a node on a hit and skipping to
+// next_id otherwise, without any stack
+bool hit_node_stackless(ray r, out hit_info info) {
     hit_info temp_info;
     bool hit = false;
     int id = 0;
@@ -191,3 +193,145 @@ bool hit_node(ray r, out hit_info info) {
     info.point = at(r, info.t);
     return hit;
 }
+
+// Distance at which r enters the box, NO_ENTRY when it misses it
+const float NO_ENTRY = 3.4e38;
+
+float aabb_entry(vec3 minimum, vec3 maximum, ray r) {
+    const vec3 invdir = 1.0 / r.direction;
+    const vec3 f = (maximum.xyz - r.origin.xyz) * invdir;
+    const vec3 n = (minimum.xyz - r.origin.xyz) * invdir;
+
+    const vec3 tmax = max(f, n);
+    const vec3 tmin = min(f, n);
+
+    const float t1 = min(min(tmax.x, min(tmax.y, tmax.z)), r.max_t);
+    const float t0 = max(max(max(tmin.x, max(tmin.y, tmin.z)), r.min_t), 0.0f);
+
+    return t1 >= t0 ? t0 : NO_ENTRY;
+}
+
+#ifdef SUBGROUP_TRAVERSAL
+// Same walk as hit_node_stackless for all the active invocations of the subgroup at
+// once: a node is entered when any of their rays hits it. The node index is uniform,
+// so each node is loaded once per subgroup and the loop never diverges. Rays may
+// test boxes they would have skipped alone, the closest hits stay the same.
+bool hit_node_subgroup(ray r, out hit_info info) {
+    hit_info temp_info;
+    bool hit = false;
+    int id = 0;
+
+    while(id != -1) {
+        bvh_node node = bufs.bvh.nodes[subgroupBroadcastFirst(id)];
+
+        if (node.primitive_id != -1) {
+            if (hit_triangle(node.primitive_id, r, temp_info)) {
+                info = temp_info;
+                r.max_t = temp_info.t;
+                hit = true;
+            }
+            id = node.next_id;
+        } else if (subgroupAny(hit_aabb(node.min, node.max, r))) {
+            id++;
+        } else {
+            id = node.next_id;
+        }
+    }
+
+    info.point = at(r, info.t);
+    return hit;
+}
+#endif
+
+#ifdef SHARED_STACK_TRAVERSAL
+// Per invocation stacks live in shared memory instead of registers, interleaved so
+// neighbouring invocations use different banks. Only the shared stack variants declare
+// them, main checks the workgroup stacks against maxComputeSharedMemorySize
+const uint SHARED_STACK_DEPTH = 32;
+const uint TRAVERSAL_GROUP_SIZE = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+shared int traversal_stack[TRAVERSAL_GROUP_SIZE * SHARED_STACK_DEPTH];
+
+// Visits the nearest child first and leaves the other one on the stack, so closer
+// hits shrink max_t early and the boxes behind them are culled when popped.
+// The children of an inner node are id + 1 and the next_id of that first child.
+bool hit_node_shared_stack(ray r, out hit_info info) {
+    hit_info temp_info;
+    bool hit = false;
+    bool overflow = false;
+    uint stack_size = 0;
+    int id = 0;
+
+    while(id != -1) {
+        bvh_node node = bufs.bvh.nodes[id];
+
+        if (node.primitive_id != -1) {
+            if (hit_triangle(node.primitive_id, r, temp_info)) {
+                info = temp_info;
+                r.max_t = temp_info.t;
+                hit = true;
+            }
+        } else {
+            int left = id + 1;
+            int right = bufs.bvh.nodes[left].next_id;
+            float left_entry = aabb_entry(bufs.bvh.nodes[left].min, bufs.bvh.nodes[left].max, r);
+            float right_entry = aabb_entry(bufs.bvh.nodes[right].min, bufs.bvh.nodes[right].max, r);
+
+            if (left_entry != NO_ENTRY && right_entry != NO_ENTRY) {
+                if (stack_size == SHARED_STACK_DEPTH) {
+                    overflow = true;
+                    break;
+                }
+
+                bool left_first = left_entry <= right_entry;
+                traversal_stack[stack_size * TRAVERSAL_GROUP_SIZE + gl_LocalInvocationIndex] = left_first ? right : left;
+                stack_size++;
+                id = left_first ? left : right;
+                continue;
+            } else if (left_entry != NO_ENTRY) {
+                id = left;
+                continue;
+            } else if (right_entry != NO_ENTRY) {
+                id = right;
+                continue;
+            }
+        }
+
+        // Pop the next box still in front of the closest hit
+        id = -1;
+        while (stack_size > 0 && id == -1) {
+            stack_size--;
+            int candidate = traversal_stack[stack_size * TRAVERSAL_GROUP_SIZE + gl_LocalInvocationIndex];
+            if (hit_aabb(bufs.bvh.nodes[candidate].min, bufs.bvh.nodes[candidate].max, r)) {
+                id = candidate;
+            }
+        }
+    }
+
+    // Deeper trees than the stack finish with a stackless walk bounded by the closest hit so far
+    if (overflow && hit_node_stackless(r, temp_info)) {
+        info = temp_info;
+        r.max_t = temp_info.t;
+        hit = true;
+    }
+
+    info.point = at(r, info.t);
+    return hit;
+}
+#endif
+
+// The traversals other than stackless are only compiled into their shader variants
+bool hit_node(ray r, out hit_info info) {
+#ifdef SUBGROUP_TRAVERSAL
+    if (TRAVERSAL == TRAVERSAL_SUBGROUP) {
+        return hit_node_subgroup(r, info);
+    }
+#endif
+
+#ifdef SHARED_STACK_TRAVERSAL
+    if (TRAVERSAL == TRAVERSAL_SHARED_STACK) {
+        return hit_node_shared_stack(r, info);
+    }
+#endif
+
+    return hit_node_stackless(r, info);
+}
@@ -0,0 +1,145 @@
+// Scene layout shared by the path tracing shaders, mirrors scene.hpp and material.hpp.
+// Shaders declare their push constants after including it, then include ray.h
+
+const uint MAX_VIEWS = 6;
+
+// Specialization constants set by ComputeRenderpass::set_pipeline, in the order of
+// scene::specialization_constants(). Left to SCENE_VALUE the metadata is read at runtime
+const uint SCENE_VALUE = 0xffffffffu;
+layout(constant_id = 0) const uint DEBUG_BVH = 0xffffffffu;
+layout(constant_id = 1) const uint ENABLE_DOF = 0xffffffffu;
+layout(constant_id = 2) const uint MAX_BOUNCE = 0xffffffffu;
+
+// BVH traversal of hit_node, see ray.h. The subgroup and shared stack ones need the
+// _subgroup and _shared_stack variants of the raytracing shaders
+const uint TRAVERSAL_STACKLESS = 0;
+const uint TRAVERSAL_SUBGROUP = 1;
+const uint TRAVERSAL_SHARED_STACK = 2;
+layout(constant_id = 3) const uint TRAVERSAL = 0;
+
+// constant_id 4 and 5 are the workgroup width and height of compute.comp
+
+struct tex {
+    uint texture_id;
+    uint sampler_id;
+};
+
+struct material {
+    vec4 base_color;
+    // bindless indices
+    tex base_color_texture;
+    tex metallic_roughness_texture;
+    float metalness;
+    float roughness;
+    float[2] padding;
+};
+
+struct sphere {
+    vec4 position;
+    material mat;
+    float radius;
+    float[3] padding;
+};
+
+struct triangle {
+    vec3 positions[3];
+    vec3 normals[3];
+    vec2 uvs[3];
+    material mat;
+};
+
+struct camera {
+    vec4 position;
+
+    vec4 forward;
+    vec4 up;
+    vec4 right;
+
+    vec4 horizontal;
+    vec4 vertical;
+    vec4 first_pixel;
+
+    float lens_radius;
+    float[3] padding;
+};
+
+struct bvh_node {
+    vec3 min;
+    int next_id;
+    vec3 max;
+    int primitive_id;
+};
+
+// Entry of the streamed texture table, mirrors streamed_texture in texture-streamer.hpp.
+// The image holds the levels of the full chain from first_level down
+struct streamed_texture {
+    uint image_index;
+    uint first_level;
+    float lod_offset;
+    uint padding;
+};
+
+layout(buffer_reference) readonly buffer texture_table {
+    streamed_texture entries[];
+};
+
+// Finest level of the full chain each texture was sampled at during the frame
+layout(buffer_reference) buffer texture_feedback {
+    uint requested_levels[];
+};
+
+// Hands out the work items of the persistent threads, zeroed before each dispatch
+layout(buffer_reference) buffer work_counter_buffer {
+    uint next_item;
+};
+
+layout(buffer_reference) readonly buffer scene_metadata {
+    camera cams[MAX_VIEWS];
+
+    uint max_bounce;
+    uint min_bounce;
+    uint width;
+    uint height;
+    uint sample_index;
+
+    uint enable_dof;
+    uint debug_bvh;
+    int downscale_factor;
+    uint view_count;
+    uint cpu_samples_image_index;
+    uint compact_accumulation;
+    uint samples_per_dispatch;
+    work_counter_buffer work_counter;
+    texture_table streamed_textures;
+    texture_feedback streaming_feedback;
+};
+
+layout(buffer_reference) readonly buffer indices_array {
+    uint indices[];
+};
+
+layout(buffer_reference) readonly buffer positions_array {
+    float positions[];
+};
+
+layout(buffer_reference) readonly buffer normals_array {
+    float normals[];
+};
+
+layout(buffer_reference) readonly buffer uvs_array {
+    float uvs[];
+};
+
+layout(buffer_reference) readonly buffer materials_array {
+    material materials[];
+};
+
+layout(buffer_reference) readonly buffer nodes_array {
+    bvh_node[] nodes;
+};
+
+layout(set = 0, binding = 0) uniform sampler samplers[];
+layout(set = 0, binding = 1) uniform texture2D textures[];
+layout(set = 0, binding = 2, rgba32f) uniform image2DArray images[];
+// Same descriptors, for the compact accumulation format
+layout(set = 0, binding = 2, rgba16f) uniform image2DArray images_f16[];
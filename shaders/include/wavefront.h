@@ -0,0 +1,85 @@
+// Queues shared by the wavefront path tracing stages.
+// Each stage is its own dispatch over the live paths instead of one thread running
+// the whole path, so the threads of a wave run the same code and touch nearby data.
+
+struct path {
+    vec3 origin;
+    uint pixel;
+    vec3 direction;
+    uint seed;
+    vec3 throughput;
+    uint bounce;
+    // ray_cone of the path, padded to 64 bytes by the vec3 alignment
+    float cone_width;
+    float cone_spread;
+};
+
+// Closest hit of a path, primitive_id is ~0u when it missed
+struct path_hit {
+    vec2 barycentrics;
+    float t;
+    uint primitive_id;
+};
+
+const uint NO_HIT = ~0u;
+
+// Paths are sorted into bins before the stage that benefits from coherence
+const uint BIN_COUNT = 16;
+const uint BIN_NONE = 0;
+const uint BIN_DIRECTION = 1;  // Rays sorted by direction octant before traversal
+const uint BIN_MATERIAL = 2;   // Hits sorted by material before shading
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer paths_array {
+    path paths[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer hits_array {
+    path_hit hits[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer uints_array {
+    uint values[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer radiance_array {
+    vec4 radiance[];
+};
+
+// Mirrors wavefront_state in wavefront-renderpass.hpp
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer wavefront_state {
+    uint dispatch_args[3];
+    uint ray_count;
+    uint next_ray_count;
+    uint path_count;
+    uint accumulation_image_index;
+    uint bin_mode;
+    uint bin_counts[BIN_COUNT];
+    uint bin_cursors[BIN_COUNT];
+    paths_array current;
+    paths_array next;
+    hits_array hits;
+    uints_array keys;
+    uints_array order;
+    radiance_array radiance;
+};
+
+layout(push_constant) uniform buffers {
+    scene_metadata scene;
+    nodes_array bvh;
+    indices_array indices_arr;
+    positions_array positions_arr;
+    normals_array normals_arr;
+    uvs_array uvs_arr;
+    materials_array materials_arr;
+    wavefront_state wavefront;
+} bufs;
+
+// Octant of the direction, rays of the same octant visit the BVH in a similar order
+uint direction_bin(vec3 direction) {
+    return uint(direction.x < 0.0) | uint(direction.y < 0.0) << 1 | uint(direction.z < 0.0) << 2;
+}
+
+// Position of the ray in the sorted order when the paths are binned
+uint sorted_slot(uint index, uint sorted_mode) {
+    return bufs.wavefront.bin_mode == sorted_mode ? bufs.wavefront.order.values[index] : index;
+}
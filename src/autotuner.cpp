@@ -0,0 +1,110 @@
+#include "autotuner.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Square, wide and tall tiles from one subgroup of 32 up to 256 threads
+static const tile_shape candidate_shapes[] = {
+    { 8, 8 }, { 16, 4 }, { 4, 16 }, { 32, 2 }, { 64, 1 },
+    { 16, 8 }, { 8, 16 }, { 32, 4 },
+    { 16, 16 }, { 32, 8 },
+    { 8, 4 }, { 32, 1 },
+};
+
+static json read_cache(const std::filesystem::path& path) {
+    std::ifstream f { path };
+    if (!f.is_open()) {
+        return json::object();
+    }
+
+    auto cache = json::parse(f, nullptr, false);
+    return cache.is_object() ? cache : json::object();
+}
+
+tile_autotuner::tile_autotuner(std::filesystem::path cache_path, const uint8_t* device_uuid, uint32_t max_invocations)
+    : cache_path(std::move(cache_path))
+{
+    static const char* digits = "0123456789abcdef";
+    for (uint32_t byte { 0U }; byte < 16U; byte++) {
+        device_key += digits[device_uuid[byte] >> 4U];
+        device_key += digits[device_uuid[byte] & 0xfU];
+    }
+
+    for (const auto& shape: candidate_shapes) {
+        if (shape.x * shape.y <= max_invocations) {
+            candidates.push_back(shape);
+        }
+    }
+
+    auto cache = read_cache(this->cache_path);
+    auto entry = cache.find(device_key);
+    if (entry != cache.end() && entry->contains("tile_x") && entry->contains("tile_y")) {
+        tile_shape cached { (*entry)["tile_x"].get<uint32_t>(), (*entry)["tile_y"].get<uint32_t>() };
+
+        // A shape tuned without the current limit, e.g. before the shared stacks, is ignored
+        if (cached.x * cached.y <= max_invocations) {
+            best = cached;
+        }
+    }
+}
+
+void tile_autotuner::start() {
+    candidate_index = 0;
+    candidate_frames = 0;
+    candidate_ms = 0.f;
+    best_ms = 0.f;
+}
+
+tile_shape tile_autotuner::shape() const {
+    return tuning() ? candidates[candidate_index] : best;
+}
+
+void tile_autotuner::record(float sample_ms) {
+    if (!tuning()) {
+        return;
+    }
+
+    if (++candidate_frames > warmup_frames) {
+        candidate_ms += sample_ms;
+    }
+
+    if (candidate_frames < warmup_frames + measured_frames) {
+        return;
+    }
+
+    auto average_ms = candidate_ms / (float)measured_frames;
+    const auto& candidate = candidates[candidate_index];
+    std::cerr << "tile " << candidate.x << "x" << candidate.y << ": " << average_ms << " ms per sample" << std::endl;
+
+    if (best_ms == 0.f || average_ms < best_ms) {
+        best = candidate;
+        best_ms = average_ms;
+    }
+
+    candidate_index++;
+    candidate_frames = 0;
+    candidate_ms = 0.f;
+
+    if (!tuning()) {
+        std::cerr << "best tile " << best.x << "x" << best.y << std::endl;
+        save();
+    }
+}
+
+void tile_autotuner::save() const {
+    // Other devices keep their entries
+    auto cache = read_cache(cache_path);
+    cache[device_key] = {
+        { "tile_x", best.x },
+        { "tile_y", best.y },
+        { "ms_per_sample", best_ms },
+    };
+
+    std::ofstream f { cache_path };
+    f << cache.dump(4);
+}
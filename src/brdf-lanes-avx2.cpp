@@ -0,0 +1,222 @@
+#include "brdf-lanes.hpp"
+
+#include <immintrin.h>
+
+#include "brdf.hpp"
+
+// Built with AVX2 and FMA enabled, only called once sample_brdf checked the CPU supports them
+
+static constexpr float pi = 3.14159265359f;
+static constexpr float min_dielectrics_f0 = 0.04f;
+
+struct lanes3 {
+    __m256 x;
+    __m256 y;
+    __m256 z;
+};
+
+static __m256 select(__m256 mask, __m256 if_true, __m256 if_false) {
+    return _mm256_blendv_ps(if_false, if_true, mask);
+}
+
+static __m256 clamp(__m256 x, float min, float max) {
+    return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(min)), _mm256_set1_ps(max));
+}
+
+static __m256 lerp(__m256 a, __m256 b, __m256 t) {
+    return _mm256_fmadd_ps(t, _mm256_sub_ps(b, a), a);
+}
+
+static __m256 dot(const lanes3& a, const lanes3& b) {
+    return _mm256_fmadd_ps(a.x, b.x, _mm256_fmadd_ps(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+}
+
+static lanes3 normalize(const lanes3& a) {
+    auto inv_length = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(dot(a, a)));
+    return { _mm256_mul_ps(a.x, inv_length), _mm256_mul_ps(a.y, inv_length), _mm256_mul_ps(a.z, inv_length) };
+}
+
+static __m256 luminance(const lanes3& rgb) {
+    return dot(rgb, { _mm256_set1_ps(0.2126f), _mm256_set1_ps(0.7152f), _mm256_set1_ps(0.0722f) });
+}
+
+// sin and cos of angles in [0, 2 pi), folded into [-pi/2, pi/2] where Taylor
+// polynomials of degree 11 and 12 stay within 1e-7 of the exact values
+static __m256 sin_cos(__m256 angle, __m256& cosine) {
+    const auto sign_mask = _mm256_set1_ps(-0.f);
+    const auto half_pi = _mm256_set1_ps(pi / 2.f);
+
+    // sin(a) = -sin(a - pi) and cos(a) = -cos(a - pi), with a - pi in [-pi, pi)
+    auto x = _mm256_sub_ps(angle, _mm256_set1_ps(pi));
+    auto sign = _mm256_and_ps(x, sign_mask);
+    auto fold = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, x), half_pi, _CMP_GT_OQ);
+    x = select(fold, _mm256_sub_ps(_mm256_or_ps(_mm256_set1_ps(pi), sign), x), x);
+
+    auto x2 = _mm256_mul_ps(x, x);
+
+    auto s = _mm256_set1_ps(-1.f / 39916800.f);
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(1.f / 362880.f));
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(-1.f / 5040.f));
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(1.f / 120.f));
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(-1.f / 6.f));
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(1.f));
+    s = _mm256_mul_ps(s, x);
+
+    auto c = _mm256_set1_ps(1.f / 479001600.f);
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(-1.f / 3628800.f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(1.f / 40320.f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(-1.f / 720.f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(1.f / 24.f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(-1.f / 2.f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(1.f));
+
+    // Folding mirrors the angle around +-pi/2, which flips the cosine
+    cosine = _mm256_xor_ps(c, _mm256_andnot_ps(fold, sign_mask));
+    return _mm256_xor_ps(s, sign_mask);
+}
+
+static lanes3 sample_hemisphere(__m256 u, __m256 v) {
+    auto radius = _mm256_sqrt_ps(u);
+    __m256 cosine;
+    auto sine = sin_cos(_mm256_mul_ps(_mm256_set1_ps(2.f * pi), v), cosine);
+
+    return { _mm256_mul_ps(cosine, radius), _mm256_mul_ps(sine, radius), _mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), u)) };
+}
+
+static lanes3 sample_ggx_vndf(const lanes3& view, __m256 alpha, __m256 u1, __m256 u2) {
+    const auto zero = _mm256_setzero_ps();
+    const auto one = _mm256_set1_ps(1.f);
+
+    auto vh = normalize({ _mm256_mul_ps(alpha, view.x), _mm256_mul_ps(alpha, view.y), view.z });
+
+    auto lensq = _mm256_fmadd_ps(vh.x, vh.x, _mm256_mul_ps(vh.y, vh.y));
+    auto has_length = _mm256_cmp_ps(lensq, zero, _CMP_GT_OQ);
+    auto inv_length = _mm256_div_ps(one, _mm256_sqrt_ps(lensq));
+    lanes3 t1_axis {
+        select(has_length, _mm256_mul_ps(_mm256_sub_ps(zero, vh.y), inv_length), one),
+        select(has_length, _mm256_mul_ps(vh.x, inv_length), zero),
+        zero,
+    };
+    lanes3 t2_axis {
+        _mm256_fmsub_ps(vh.y, t1_axis.z, _mm256_mul_ps(vh.z, t1_axis.y)),
+        _mm256_fmsub_ps(vh.z, t1_axis.x, _mm256_mul_ps(vh.x, t1_axis.z)),
+        _mm256_fmsub_ps(vh.x, t1_axis.y, _mm256_mul_ps(vh.y, t1_axis.x)),
+    };
+
+    auto r = _mm256_sqrt_ps(u1);
+    __m256 cosine;
+    auto sine = sin_cos(_mm256_mul_ps(_mm256_set1_ps(2.f * pi), u2), cosine);
+    auto t1 = _mm256_mul_ps(r, cosine);
+    auto t2 = _mm256_mul_ps(r, sine);
+    auto s = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_add_ps(one, vh.z));
+    auto t1_squared = _mm256_mul_ps(t1, t1);
+    t2 = _mm256_fmadd_ps(_mm256_sqrt_ps(_mm256_sub_ps(one, t1_squared)), _mm256_sub_ps(one, s), _mm256_mul_ps(t2, s));
+
+    auto nh_z_length = _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(_mm256_sub_ps(one, t1_squared), _mm256_mul_ps(t2, t2))));
+    lanes3 nh {
+        _mm256_fmadd_ps(t1, t1_axis.x, _mm256_fmadd_ps(t2, t2_axis.x, _mm256_mul_ps(nh_z_length, vh.x))),
+        _mm256_fmadd_ps(t1, t1_axis.y, _mm256_fmadd_ps(t2, t2_axis.y, _mm256_mul_ps(nh_z_length, vh.y))),
+        _mm256_fmadd_ps(t1, t1_axis.z, _mm256_fmadd_ps(t2, t2_axis.z, _mm256_mul_ps(nh_z_length, vh.z))),
+    };
+
+    return normalize({ _mm256_mul_ps(alpha, nh.x), _mm256_mul_ps(alpha, nh.y), _mm256_max_ps(zero, nh.z) });
+}
+
+static __m256 smith_g1_ggx(__m256 alpha_squared, __m256 n_dot_s_squared) {
+    const auto one = _mm256_set1_ps(1.f);
+    auto ratio = _mm256_div_ps(_mm256_fmadd_ps(alpha_squared, _mm256_sub_ps(one, n_dot_s_squared), n_dot_s_squared), n_dot_s_squared);
+
+    return _mm256_div_ps(_mm256_set1_ps(2.f), _mm256_add_ps(_mm256_sqrt_ps(ratio), one));
+}
+
+static __m256 schlick_factor(__m256 n_dot_s) {
+    auto x = _mm256_sub_ps(_mm256_set1_ps(1.f), n_dot_s);
+    auto x2 = _mm256_mul_ps(x, x);
+    return _mm256_mul_ps(_mm256_mul_ps(x2, x2), x);
+}
+
+static __m256 shadowed_f90(__m256 f0_luminance) {
+    return _mm256_min_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(_mm256_set1_ps(1.f / min_dielectrics_f0), f0_luminance));
+}
+
+void sample_brdf_avx2(brdf_lanes& lanes, size_t first) {
+    const auto zero = _mm256_setzero_ps();
+    const auto one = _mm256_set1_ps(1.f);
+
+    lanes3 view { _mm256_loadu_ps(&lanes.view[0][first]), _mm256_loadu_ps(&lanes.view[1][first]), _mm256_loadu_ps(&lanes.view[2][first]) };
+    lanes3 base_color { _mm256_loadu_ps(&lanes.base_color[0][first]), _mm256_loadu_ps(&lanes.base_color[1][first]), _mm256_loadu_ps(&lanes.base_color[2][first]) };
+    auto metalness = _mm256_loadu_ps(&lanes.metalness[first]);
+    auto roughness = _mm256_loadu_ps(&lanes.roughness[first]);
+    auto u0 = _mm256_loadu_ps(&lanes.random[0][first]);
+    auto u1 = _mm256_loadu_ps(&lanes.random[1][first]);
+    auto u2 = _mm256_loadu_ps(&lanes.random[2][first]);
+
+    auto diffuse_scale = _mm256_sub_ps(one, metalness);
+    lanes3 diffuse_reflectance { _mm256_mul_ps(base_color.x, diffuse_scale), _mm256_mul_ps(base_color.y, diffuse_scale), _mm256_mul_ps(base_color.z, diffuse_scale) };
+
+    // get_brdf_probability, the normal is +z in tangent space
+    auto dielectric_f0 = _mm256_set1_ps(min_dielectrics_f0);
+    auto specular_luminance = luminance({ lerp(dielectric_f0, base_color.x, metalness), lerp(dielectric_f0, base_color.y, metalness), lerp(dielectric_f0, base_color.z, metalness) });
+    auto probability_f90 = shadowed_f90(specular_luminance);
+    auto probability_fresnel = _mm256_fmadd_ps(_mm256_sub_ps(probability_f90, specular_luminance), schlick_factor(_mm256_max_ps(zero, view.z)), specular_luminance);
+    auto fresnel = clamp(probability_fresnel, 0.f, 1.f);
+    auto diffuse = _mm256_mul_ps(luminance(diffuse_reflectance), _mm256_sub_ps(one, fresnel));
+    auto brdf_probability = clamp(_mm256_div_ps(fresnel, _mm256_max_ps(_mm256_set1_ps(0.0001f), _mm256_add_ps(fresnel, diffuse))), 0.1f, 0.9f);
+
+    auto is_mirror = _mm256_and_ps(_mm256_cmp_ps(metalness, one, _CMP_EQ_OQ), _mm256_cmp_ps(roughness, zero, _CMP_EQ_OQ));
+    auto is_specular = _mm256_or_ps(is_mirror, _mm256_cmp_ps(u0, brdf_probability, _CMP_LT_OQ));
+    auto lobe_weight = select(
+        is_mirror,
+        one,
+        select(is_specular, _mm256_div_ps(one, brdf_probability), _mm256_div_ps(one, _mm256_sub_ps(one, brdf_probability)))
+    );
+
+    // Ignore ray coming from below the hemisphere
+    lobe_weight = select(_mm256_cmp_ps(view.z, zero, _CMP_LE_OQ), zero, lobe_weight);
+
+    // Both lobes are evaluated for every lane and blended, cheaper than splitting the batch
+    auto diffuse_direction = sample_hemisphere(u1, u2);
+
+    auto alpha = _mm256_mul_ps(roughness, roughness);
+    auto alpha_squared = _mm256_mul_ps(alpha, alpha);
+    auto is_rough = _mm256_cmp_ps(alpha, zero, _CMP_NEQ_OQ);
+    auto sampled_half = sample_ggx_vndf(view, alpha, u1, u2);
+    lanes3 half {
+        select(is_rough, sampled_half.x, zero),
+        select(is_rough, sampled_half.y, zero),
+        select(is_rough, sampled_half.z, one),
+    };
+
+    // reflect(-view, half)
+    auto twice_v_dot_h = _mm256_mul_ps(_mm256_set1_ps(2.f), dot(view, half));
+    lanes3 light {
+        _mm256_fmsub_ps(twice_v_dot_h, half.x, view.x),
+        _mm256_fmsub_ps(twice_v_dot_h, half.y, view.y),
+        _mm256_fmsub_ps(twice_v_dot_h, half.z, view.z),
+    };
+
+    // Like compute.comp, the specular f0 comes from the diffuse reflectance
+    const auto& specular_f0 = diffuse_reflectance;
+    auto h_dot_l = clamp(dot(half, light), 0.00001f, 1.f);
+    auto n_dot_l = clamp(light.z, 0.00001f, 1.f);
+    auto f90 = shadowed_f90(luminance(specular_f0));
+    auto fresnel_factor = schlick_factor(h_dot_l);
+    auto g1 = smith_g1_ggx(alpha_squared, _mm256_mul_ps(n_dot_l, n_dot_l));
+
+    lanes3 specular_weight {
+        _mm256_mul_ps(_mm256_fmadd_ps(_mm256_sub_ps(f90, specular_f0.x), fresnel_factor, specular_f0.x), g1),
+        _mm256_mul_ps(_mm256_fmadd_ps(_mm256_sub_ps(f90, specular_f0.y), fresnel_factor, specular_f0.y), g1),
+        _mm256_mul_ps(_mm256_fmadd_ps(_mm256_sub_ps(f90, specular_f0.z), fresnel_factor, specular_f0.z), g1),
+    };
+
+    _mm256_storeu_ps(&lanes.direction[0][first], select(is_specular, light.x, diffuse_direction.x));
+    _mm256_storeu_ps(&lanes.direction[1][first], select(is_specular, light.y, diffuse_direction.y));
+    _mm256_storeu_ps(&lanes.direction[2][first], select(is_specular, light.z, diffuse_direction.z));
+
+    _mm256_storeu_ps(&lanes.weight[0][first], _mm256_mul_ps(select(is_specular, specular_weight.x, diffuse_reflectance.x), lobe_weight));
+    _mm256_storeu_ps(&lanes.weight[1][first], _mm256_mul_ps(select(is_specular, specular_weight.y, diffuse_reflectance.y), lobe_weight));
+    _mm256_storeu_ps(&lanes.weight[2][first], _mm256_mul_ps(select(is_specular, specular_weight.z, diffuse_reflectance.z), lobe_weight));
+
+    auto type = _mm256_blendv_epi8(_mm256_set1_epi32(DIFFUSE), _mm256_set1_epi32(SPECULAR), _mm256_castps_si256(is_specular));
+    _mm256_storeu_si256((__m256i*)&lanes.type[first], type);
+}
@@ -0,0 +1,123 @@
+#include "brdf-lanes.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "brdf.hpp"
+#include "color.hpp"
+#include "utils.hpp"
+
+void brdf_lanes::resize(size_t new_count) {
+    count = new_count;
+    auto padded_count = (new_count + width - 1U) / width * width;
+
+    for (uint32_t axis { 0U }; axis < 3U; axis++) {
+        view[axis].resize(padded_count);
+        base_color[axis].resize(padded_count);
+        random[axis].resize(padded_count);
+        direction[axis].resize(padded_count);
+        weight[axis].resize(padded_count);
+    }
+    metalness.resize(padded_count);
+    roughness.resize(padded_count);
+    type.resize(padded_count);
+}
+
+bool supports_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int registers[4];
+    __cpuid(registers, 0);
+    if (registers[0] < 7) {
+        return false;
+    }
+
+    __cpuid(registers, 1);
+    auto has_fma = (registers[2] & (1 << 12)) != 0;
+    auto has_os_ymm = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6U) == 0x6U;
+
+    __cpuidex(registers, 7, 0);
+    auto has_avx2 = (registers[1] & (1 << 5)) != 0;
+
+    return has_fma && has_os_ymm && has_avx2;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+void sample_brdf(brdf_lanes& lanes) {
+    static const bool use_avx2 = supports_avx2();
+
+    if (!use_avx2) {
+        sample_brdf_scalar(lanes, 0U, lanes.count);
+        return;
+    }
+
+    for (size_t first { 0U }; first < lanes.count; first += brdf_lanes::width) {
+        sample_brdf_avx2(lanes, first);
+    }
+}
+
+// Same steps as the bounce loop of ray_color in compute.comp, once in tangent space
+void sample_brdf_scalar(brdf_lanes& lanes, size_t first, size_t count) {
+    for (size_t lane { first }; lane < first + count; lane++) {
+        vec3 view_local { lanes.view[0][lane], lanes.view[1][lane], lanes.view[2][lane] };
+        color base_color { lanes.base_color[0][lane], lanes.base_color[1][lane], lanes.base_color[2][lane] };
+        auto metalness = lanes.metalness[lane];
+        auto roughness = lanes.roughness[lane];
+        vec3 normal_local { 0.f, 0.f, 1.f };
+
+        BRDF_TYPE brdf_type = SPECULAR;
+        auto lobe_weight = 1.f;
+        if (metalness != 1.f || roughness != 0.f) {
+            auto brdf_probability = get_brdf_probability(base_color, metalness, view_local, normal_local);
+            if (lanes.random[0][lane] < brdf_probability) {
+                lobe_weight = 1.f / brdf_probability;
+            } else {
+                brdf_type = DIFFUSE;
+                lobe_weight = 1.f / (1.f - brdf_probability);
+            }
+        }
+
+        vec3 ray_dir_local;
+        color sample_weight;
+        if (brdf_type == DIFFUSE) {
+            ray_dir_local = sample_hemisphere(lanes.random[1][lane], lanes.random[2][lane]);
+            sample_weight = base_color_to_diffuse_reflectance(base_color, metalness);
+        } else {
+            auto alpha = roughness * roughness;
+            auto alpha_squared = alpha * alpha;
+
+            vec3 half_local { 0.f, 0.f, 1.f };
+            if (alpha != 0.f) {
+                half_local = sample_ggx_vndf(view_local, alpha, lanes.random[1][lane], lanes.random[2][lane]);
+            }
+
+            auto light_local = reflect(-view_local, half_local);
+
+            auto specular_f0 = base_color_to_diffuse_reflectance(base_color, metalness);
+
+            auto h_dot_l = clamp(half_local.dot(light_local), 0.00001f, 1.f);
+            auto n_dot_l = clamp(normal_local.dot(light_local), 0.00001f, 1.f);
+            auto f = eval_fresnel(specular_f0, shadowed_f90(specular_f0), h_dot_l);
+
+            sample_weight = f * specular_sample_weight_ggx_vndf(alpha_squared, n_dot_l);
+
+            ray_dir_local = light_local;
+        }
+
+        // Ignore ray coming from below the hemisphere
+        if (view_local.v[2] <= 0.f) {
+            lobe_weight = 0.f;
+        }
+
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            lanes.direction[axis][lane] = ray_dir_local.v[axis];
+            lanes.weight[axis][lane] = sample_weight.v[axis] * lobe_weight;
+        }
+        lanes.type[lane] = brdf_type;
+    }
+}
@@ -0,0 +1,114 @@
+#include "brdf.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "color.hpp"
+#include "utils.hpp"
+
+static constexpr float min_dielectrics_f0 = 0.04f;
+
+vec3 sample_hemisphere(float u, float v) {
+    auto radius = std::sqrt(u);
+    auto theta = 2.f * (float)PI * v;
+
+    return { std::cos(theta) * radius, std::sin(theta) * radius, std::sqrt(1.f - u) };
+}
+
+vec3 disk_vec(float u, float v) {
+    auto z = u * 2.f - 1.f;
+    auto a = 2.f * (float)PI * v;
+    auto r = std::sqrt(1.f - z * z);
+
+    return { std::cos(a) * r, std::sin(a) * r, 0.f };
+}
+
+quaternion rotation_to_z_axis(const vec3& axis) {
+    // Handle special case when axis is exact or near opposite of (0, 0, 1)
+    if (axis.v[2] < -0.99999f) {
+        return { vec3{ 1.f, 0.f, 0.f }, 0.f };
+    }
+
+    vec3 q_axis { axis.v[1], -axis.v[0], 0.f };
+    auto w = 1.f + axis.v[2];
+    auto length = std::sqrt(q_axis.length_sq() + w * w);
+
+    return { q_axis / length, w / length };
+}
+
+quaternion invert_rotation(const quaternion& q) {
+    return { -q.axis, q.w };
+}
+
+vec3 rotate_point(const quaternion& q, const vec3& v) {
+    return 2.f * q.axis.dot(v) * q.axis + (q.w * q.w - q.axis.dot(q.axis)) * v + 2.f * q.w * q.axis.cross(v);
+}
+
+// Samples a microfacet normal for the GGX distribution using VNDF method, see brdf.h for references
+vec3 sample_ggx_vndf(const vec3& view, float alpha, uint32_t& seed) {
+    auto u1 = randf(seed);
+    auto u2 = randf(seed);
+
+    return sample_ggx_vndf(view, alpha, u1, u2);
+}
+
+vec3 sample_ggx_vndf(const vec3& view, float alpha, float u1, float u2) {
+    vec3 vh { alpha * view.v[0], alpha * view.v[1], view.v[2] };
+    vh.normalize();
+
+    auto lensq = vh.v[0] * vh.v[0] + vh.v[1] * vh.v[1];
+    auto t1_axis = lensq > 0.f ? vec3{ -vh.v[1], vh.v[0], 0.f } / std::sqrt(lensq) : vec3{ 1.f, 0.f, 0.f };
+    auto t2_axis = vh.cross(t1_axis);
+
+    auto r = std::sqrt(u1);
+    auto phi = 2.f * (float)PI * u2;
+    auto t1 = r * std::cos(phi);
+    auto t2 = r * std::sin(phi);
+    auto s = 0.5f * (1.f + vh.v[2]);
+    t2 = std::sqrt(1.f - t1 * t1) * (1.f - s) + t2 * s;
+
+    auto nh = t1 * t1_axis + t2 * t2_axis + std::sqrt(std::max(0.f, 1.f - t1 * t1 - t2 * t2)) * vh;
+
+    vec3 half { alpha * nh.v[0], alpha * nh.v[1], std::max(0.f, nh.v[2]) };
+    return half.normalize();
+}
+
+static float smith_g1_ggx(float alpha_squared, float n_dot_s_squared) {
+    return 2.f / (std::sqrt(((alpha_squared * (1.f - n_dot_s_squared)) + n_dot_s_squared) / n_dot_s_squared) + 1.f);
+}
+
+float specular_sample_weight_ggx_vndf(float alpha_squared, float n_dot_l) {
+    return smith_g1_ggx(alpha_squared, n_dot_l * n_dot_l);
+}
+
+color base_color_to_specular_f0(const color& base_color, float metalness) {
+    return lerp(color{ min_dielectrics_f0, min_dielectrics_f0, min_dielectrics_f0 }, base_color, metalness);
+}
+
+color base_color_to_diffuse_reflectance(const color& base_color, float metalness) {
+    return base_color * (1.f - metalness);
+}
+
+// Schlick's approximation to Fresnel term
+color eval_fresnel(const color& f0, float f90, float n_dot_s) {
+    return f0 + (color{ f90, f90, f90 } - f0) * std::pow(1.f - n_dot_s, 5.f);
+}
+
+float shadowed_f90(const color& f0) {
+    const float t = 1.f / min_dielectrics_f0;
+    return std::min(1.f, t * luminance(f0));
+}
+
+float get_brdf_probability(const color& base_color, float metalness, const vec3& view, const vec3& shading_normal) {
+    auto specular_luminance = luminance(base_color_to_specular_f0(base_color, metalness));
+    color specular_f0 { specular_luminance, specular_luminance, specular_luminance };
+    auto diffuse_reflectance = luminance(base_color_to_diffuse_reflectance(base_color, metalness));
+    auto fresnel = clamp(luminance(eval_fresnel(specular_f0, shadowed_f90(specular_f0), std::max(0.f, view.dot(shading_normal)))), 0.f, 1.f);
+
+    auto specular = fresnel;
+    auto diffuse = diffuse_reflectance * (1.f - fresnel);
+
+    auto p = specular / std::max(0.0001f, specular + diffuse);
+
+    return clamp(p, 0.1f, 0.9f);
+}
@@ -169,8 +169,8 @@ void bvh::subdivide(uint32_t parent_id, uint32_t begin, uint32_t end) {
     const auto& parent_bb = temp_nodes[parent_id].bounding_box;
     int32_t split_axis = parent_bb.maximum_axis();
 
-    if (count <= 4) {
-        // Subdivide the node by splitting the set in two equal parts
+    // Subdivide the node by splitting the set in two equal parts
+    auto split_in_halves = [&]() {
         std::sort(leafs.begin() + begin, leafs.begin() + end,
             // [&](const bvh_node& a, const bvh_node& b) {
             //     return spheres[a.primitive_id].center[split_axis] < spheres[b.primitive_id].center[split_axis];
@@ -185,6 +185,10 @@ void bvh::subdivide(uint32_t parent_id, uint32_t begin, uint32_t end) {
 
         subdivide(left_id, begin, begin + (count / 2));
         subdivide(right_id, begin + (count / 2), end);
+    };
+
+    if (count <= 4) {
+        split_in_halves();
         return;
     }
 
@@ -206,14 +210,22 @@ void bvh::subdivide(uint32_t parent_id, uint32_t begin, uint32_t end) {
     }
 
     float split_axis_size = centroid_bounds.maximum[split_axis] - centroid_bounds.minimum[split_axis];
-    for (size_t i = begin; i < end; i++) {
-        auto& primitive = triangles[leafs[i].primitive_id];
-        // auto& primitive = spheres[leafs[i].primitive_id];
+
+    // Centers all in one plane cannot be bucketed along the axis
+    if (split_axis_size <= 0.f) {
+        split_in_halves();
+        return;
+    }
+
+    auto bucket_of = [&](const bvh_node& leaf) {
+        auto& primitive = triangles[leaf.primitive_id];
+        // auto& primitive = spheres[leaf.primitive_id];
         auto normalized_offset = (primitive.center[split_axis] - centroid_bounds.minimum[split_axis]) / split_axis_size;
-        uint32_t bucket_index = normalized_offset * buckets_count;
-        if (bucket_index == buckets_count) {
-            bucket_index -= 1;
-        }
+        return std::min((uint32_t)(normalized_offset * buckets_count), buckets_count - 1);
+    };
+
+    for (size_t i = begin; i < end; i++) {
+        auto bucket_index = bucket_of(leafs[i]);
 
         buckets[bucket_index].count++;
         buckets[bucket_index].bb.union_with(leafs[i].bounding_box);
@@ -249,9 +261,15 @@ void bvh::subdivide(uint32_t parent_id, uint32_t begin, uint32_t end) {
         }
     }
 
-    uint32_t middle_primitive_index = buckets[0].count;
-    for (size_t bucket_index = 1; bucket_index <= min_cost_bucket; bucket_index++) {
-        middle_primitive_index += buckets[bucket_index].count;
+    // The leafs of the buckets left of the split go first
+    auto middle = std::partition(leafs.begin() + begin, leafs.begin() + end, [&](const bvh_node& leaf) {
+        return bucket_of(leaf) <= min_cost_bucket;
+    });
+    auto middle_primitive_index = (uint32_t)(middle - (leafs.begin() + begin));
+
+    if (middle_primitive_index == 0 || middle_primitive_index == count) {
+        split_in_halves();
+        return;
     }
 
     temp_nodes[left_id].bounding_box = compute_bounds(begin, begin + middle_primitive_index);
@@ -9,16 +9,38 @@ camera::camera(
         float v_fov,
         float aspect_ratio,
         float aperture,
-        float focus_dist
+        float focus_dist,
+        vec3 world_up
     ) : position(position), lens_radius(aperture / 2.f), fov(v_fov), focus_distance(focus_dist) {
 
     forward = (target - position).normalize();
-    right = forward.cross(vec3{ 0.0, 1.0, 0.0 }).normalize();
+    right = forward.cross(world_up).normalize();
     up = right.cross(forward).normalize();
 
     set_aspect_ratio(aspect_ratio);
 }
 
+std::array<camera, 6> camera::cubemap(point3 position, float focus_dist) {
+    // Looking up or down the world up axis needs another reference to build the frame
+    return {
+        camera(position, position + vec3{  1.f,  0.f,  0.f }, 90.f, 1.f, 0.f, focus_dist),
+        camera(position, position + vec3{ -1.f,  0.f,  0.f }, 90.f, 1.f, 0.f, focus_dist),
+        camera(position, position + vec3{  0.f,  1.f,  0.f }, 90.f, 1.f, 0.f, focus_dist, vec3{ 0.f, 0.f, -1.f }),
+        camera(position, position + vec3{  0.f, -1.f,  0.f }, 90.f, 1.f, 0.f, focus_dist, vec3{ 0.f, 0.f,  1.f }),
+        camera(position, position + vec3{  0.f,  0.f,  1.f }, 90.f, 1.f, 0.f, focus_dist),
+        camera(position, position + vec3{  0.f,  0.f, -1.f }, 90.f, 1.f, 0.f, focus_dist),
+    };
+}
+
+std::array<camera, 2> camera::stereo(const camera& center, float eye_separation) {
+    std::array<camera, 2> eyes { center, center };
+
+    eyes[0].move(-center.right * (eye_separation / 2.f));
+    eyes[1].move(center.right * (eye_separation / 2.f));
+
+    return eyes;
+}
+
 void camera::set_aspect_ratio(float ratio) {
     aspect_ratio = ratio;
 
@@ -38,12 +60,18 @@ void camera::move(const vec3& v) {
 }
 
 void camera::rotate_y(float theta) {
-    forward.v[0] = forward.v[0] * cos(theta) - forward.v[2] * sin(theta);
-    forward.v[2] = forward.v[0] * sin(theta) + forward.v[2] * cos(theta);
-    forward.normalize();
+    // Rotate the whole frame so views looking along the y axis stay valid
+    auto rotate = [cos_theta = cos(theta), sin_theta = sin(theta)](vec3& v) {
+        auto x = v.v[0];
+        auto z = v.v[2];
+        v.v[0] = x * cos_theta - z * sin_theta;
+        v.v[2] = x * sin_theta + z * cos_theta;
+        v.normalize();
+    };
 
-    right = forward.cross(vec3{ 0.0, 1.0, 0.0 }).normalize();
-    up = right.cross(forward).normalize();
+    rotate(forward);
+    rotate(right);
+    rotate(up);
 
     auto h = tan(deg_to_rad(fov) / 2.f);
     auto viewport_height = 2.f * h;
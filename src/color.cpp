@@ -1,5 +1,7 @@
 #include "color.hpp"
 
+#include <cmath>
+
 #include "utils.hpp"
 #include "vec3.hpp"
 
@@ -12,3 +14,25 @@ void write_color(std::ostream& out, const color& pixel_color) {
         << static_cast<uint32_t>(256.0 * clamp(g, 0.0, 0.999)) << ' '
         << static_cast<uint32_t>(256.0 * clamp(b, 0.0, 0.999)) << std::endl;
 }
+
+float luminance(const color& rgb) {
+    return rgb.dot(color{ 0.2126f, 0.7152f, 0.0722f });
+}
+
+color srgb_to_linear(const color& rgb) {
+    auto convert = [](float channel) {
+        channel = clamp(channel, 0.f, 1.f);
+        return channel < 0.04045f ? channel / 12.92f : std::pow((channel + 0.055f) / 1.055f, 2.4f);
+    };
+
+    return { convert(rgb.v[0]), convert(rgb.v[1]), convert(rgb.v[2]) };
+}
+
+color linear_to_srgb(const color& rgb) {
+    auto convert = [](float channel) {
+        channel = clamp(channel, 0.f, 1.f);
+        return channel < 0.0031308f ? channel * 12.92f : std::pow(channel, 1.f / 2.4f) * 1.055f - 0.055f;
+    };
+
+    return { convert(rgb.v[0]), convert(rgb.v[1]), convert(rgb.v[2]) };
+}
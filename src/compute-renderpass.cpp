@@ -1,5 +1,7 @@
 #include "compute-renderpass.hpp"
 
+#include <algorithm>
+
 #include "vk-renderer.hpp"
 
 ComputeRenderpass::ComputeRenderpass(vkapi& api)
@@ -7,13 +9,75 @@ ComputeRenderpass::ComputeRenderpass(vkapi& api)
 {}
 
 ComputeRenderpass::~ComputeRenderpass() {
-    api.destroy_pipeline(pipeline);
+    destroy_pipelines();
+
+    if (timing_pool != VK_NULL_HANDLE) {
+        api.destroy_query_pool(timing_pool);
+    }
+}
+
+void ComputeRenderpass::enable_timing() {
+    if (timing_pool != VK_NULL_HANDLE)
+        return;
+
+    timing_pool = api.create_timestamp_pool(2 * vkrenderer::virtual_frames_count);
+    timing_pending.assign(vkrenderer::virtual_frames_count, false);
+}
+
+void ComputeRenderpass::set_pipeline(const char* new_shader_name, const std::vector<uint32_t>& specialization_constants) {
+    if (shader_name != new_shader_name) {
+        destroy_pipelines();
+        shader_name = new_shader_name;
+    }
+
+    specialization = specialization_constants;
+
+    auto permutation = pipelines.find(specialization);
+    if (permutation == pipelines.end()) {
+        if (pipelines.size() >= max_permutations) {
+            auto least_used = std::min_element(pipelines.begin(), pipelines.end(), [](const auto& a, const auto& b) {
+                return a.second.last_used < b.second.last_used;
+            });
+            retired_pipelines.push_back({ least_used->second.compiled, executions });
+            pipelines.erase(least_used);
+        }
+
+        permutation = pipelines.emplace(specialization, pipeline_permutation { api.create_compute_pipeline(shader_name.c_str(), specialization) }).first;
+    }
+
+    permutation->second.last_used = executions;
+    current_pipeline = &permutation->second.compiled;
+}
+
+void ComputeRenderpass::reload_pipelines() {
+    destroy_pipelines();
+
+    current_pipeline = &pipelines.emplace(specialization, pipeline_permutation { api.create_compute_pipeline(shader_name.c_str(), specialization) }).first->second.compiled;
+}
+
+void ComputeRenderpass::destroy_pipelines() {
+    for (auto& [key, permutation]: pipelines) {
+        api.destroy_pipeline(permutation.compiled);
+    }
+
+    for (auto& retired: retired_pipelines) {
+        api.destroy_pipeline(retired.compiled);
+    }
+
+    pipelines.clear();
+    retired_pipelines.clear();
+    current_pipeline = nullptr;
 }
 
-void ComputeRenderpass::set_pipeline(const char* shader_name) {
-    if (this->pipeline.handle != VK_NULL_HANDLE)
-        api.destroy_pipeline(this->pipeline);
-    this->pipeline = api.create_compute_pipeline(shader_name);
+void ComputeRenderpass::destroy_retired_pipelines() {
+    std::erase_if(retired_pipelines, [&](retired_pipeline& retired) {
+        if (retired.execution + vkrenderer::virtual_frames_count > executions) {
+            return false;
+        }
+
+        api.destroy_pipeline(retired.compiled);
+        return true;
+    });
 }
 
 void ComputeRenderpass::set_ouput_texture(Texture* out_texture) {
@@ -40,15 +104,26 @@ void ComputeRenderpass::set_constant(off_t offset, Texture* texture) {
 
     memcpy(constants + offset, (void*)&image.bindless_storage_index, sizeof(bindless_index));
 
+    add_input_texture(texture);
+}
+
+void ComputeRenderpass::add_input_texture(Texture* texture) {
     input_textures.push_back(texture);
 }
 
-void ComputeRenderpass::set_constant(off_t offset, Buffer* buffer) {
+void ComputeRenderpass::add_cleared_buffer(Buffer* buffer) {
+    cleared_buffers.push_back(buffer);
+}
+
+void ComputeRenderpass::set_constant(off_t offset, Buffer* buffer, size_t buffer_offset) {
     auto device_buffer = api.get_buffer(buffer->device_buffer);
-    memcpy(constants + offset, (void*)&device_buffer.device_address, sizeof(VkDeviceAddress));
+    VkDeviceAddress address = device_buffer.device_address + buffer_offset;
+    memcpy(constants + offset, (void*)&address, sizeof(VkDeviceAddress));
 }
 
-void ComputeRenderpass::execute(vkrenderer&, VkCommandBuffer command_buffer) {
+void ComputeRenderpass::execute(vkrenderer& renderer, VkCommandBuffer command_buffer) {
+    destroy_retired_pipelines();
+
     api.update_constants(command_buffer, VK_SHADER_STAGE_COMPUTE_BIT, 0, 64, (void*)&constants);
 
     for (auto& texture: input_textures) {
@@ -57,7 +132,31 @@ void ComputeRenderpass::execute(vkrenderer&, VkCommandBuffer command_buffer) {
 
     api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, output_texture->device_image);
 
-    api.run_compute_pipeline(command_buffer, pipeline, group_count_x, group_count_y, group_count_z);
+    if (!cleared_buffers.empty()) {
+        api.memory_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        for (auto& buffer: cleared_buffers) {
+            api.fill_buffer(command_buffer, buffer->device_buffer, 0, buffer->buffer_size, 0U);
+        }
+        api.memory_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    if (timing_pool == VK_NULL_HANDLE) {
+        api.run_compute_pipeline(command_buffer, *current_pipeline, group_count_x, group_count_y, group_count_z);
+    } else {
+        // The previous frame of this virtual frame is done, its timestamps are ready
+        auto frame_index = renderer.frame_index();
+        auto first_query = 2 * frame_index;
+        if (timing_pending[frame_index] && api.get_elapsed_time(timing_pool, first_query, dispatch_duration_ms)) {
+            timing_pending[frame_index] = false;
+        }
+
+        api.reset_queries(command_buffer, timing_pool, first_query, 2);
+        api.write_timestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timing_pool, first_query);
+        api.run_compute_pipeline(command_buffer, *current_pipeline, group_count_x, group_count_y, group_count_z);
+        api.write_timestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timing_pool, first_query + 1);
+        timing_pending[frame_index] = true;
+    }
 
     input_textures.clear();
+    executions++;
 }
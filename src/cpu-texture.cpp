@@ -0,0 +1,152 @@
+#include "cpu-texture.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Spreads the 3 low bits of x over the even bits
+static uint32_t part_bits(uint32_t x) {
+    x = (x | (x << 2U)) & 0x33U;
+    return (x | (x << 1U)) & 0x55U;
+}
+
+static uint32_t wrap(int64_t x, uint32_t size, cpu_sampler::address_mode mode) {
+    switch (mode) {
+        case cpu_sampler::address_mode::CLAMP_TO_EDGE:
+            return (uint32_t)std::clamp(x, (int64_t)0, (int64_t)size - 1);
+        case cpu_sampler::address_mode::MIRRORED_REPEAT: {
+            // Repeats every two sizes, the second copy reversed
+            auto period = 2 * (int64_t)size;
+            auto wrapped = x % period;
+            wrapped = wrapped < 0 ? wrapped + period : wrapped;
+            return (uint32_t)(wrapped < (int64_t)size ? wrapped : period - 1 - wrapped);
+        }
+        default: {
+            auto wrapped = x % (int64_t)size;
+            return (uint32_t)(wrapped < 0 ? wrapped + size : wrapped);
+        }
+    }
+}
+
+static color unpack(uint32_t texel) {
+    return {
+        (float)(texel & 0xffU) / 255.f,
+        (float)((texel >> 8U) & 0xffU) / 255.f,
+        (float)((texel >> 16U) & 0xffU) / 255.f,
+    };
+}
+
+cpu_texture::cpu_texture(const uint32_t* rgba, uint32_t width, uint32_t height) {
+    assert(rgba != nullptr && width > 0 && height > 0);
+
+    base_lod_offset = 0.5f * std::log2((float)width * (float)height);
+
+    add_level(width, height);
+    for (uint32_t y { 0U }; y < height; y++) {
+        for (uint32_t x { 0U }; x < width; x++) {
+            texels[texel_index(levels[0], x, y)] = rgba[(size_t)y * width + x];
+        }
+    }
+
+    while (width > 1U || height > 1U) {
+        width = std::max(width / 2U, 1U);
+        height = std::max(height / 2U, 1U);
+        add_level(width, height);
+
+        const auto& parent = levels[levels.size() - 2U];
+        const auto& mip = levels.back();
+        for (uint32_t y { 0U }; y < height; y++) {
+            for (uint32_t x { 0U }; x < width; x++) {
+                uint32_t sum[4] = {};
+                for (uint32_t tap { 0U }; tap < 4U; tap++) {
+                    auto parent_x = std::min(x * 2U + (tap & 1U), parent.width - 1U);
+                    auto parent_y = std::min(y * 2U + (tap >> 1U), parent.height - 1U);
+                    auto texel = texels[texel_index(parent, parent_x, parent_y)];
+                    for (uint32_t channel { 0U }; channel < 4U; channel++) {
+                        sum[channel] += (texel >> (channel * 8U)) & 0xffU;
+                    }
+                }
+
+                uint32_t texel = 0U;
+                for (uint32_t channel { 0U }; channel < 4U; channel++) {
+                    texel |= ((sum[channel] + 2U) / 4U) << (channel * 8U);
+                }
+                texels[texel_index(mip, x, y)] = texel;
+            }
+        }
+    }
+}
+
+color cpu_texture::sample(float u, float v) const {
+    return bilinear(levels[0], u, v, {});
+}
+
+color cpu_texture::sample(float u, float v, float lod, const cpu_sampler& sampler) const {
+    lod = std::isfinite(lod) ? lod : 0.f;
+
+    // As on the GPU, the magnification filter applies up to lod 0
+    auto nearest_filter = lod <= 0.f ? sampler.nearest_mag : sampler.nearest_min;
+
+    auto max_level = (float)(levels.size() - 1U);
+    lod = std::clamp(sampler.nearest_mip ? std::floor(lod + 0.5f) : lod, 0.f, max_level);
+
+    auto lower = (uint32_t)lod;
+    auto weight = lod - (float)lower;
+    if (weight == 0.f) {
+        return filter(levels[lower], u, v, sampler, nearest_filter);
+    }
+
+    return lerp(filter(levels[lower], u, v, sampler, nearest_filter), filter(levels[lower + 1U], u, v, sampler, nearest_filter), weight);
+}
+
+void cpu_texture::add_level(uint32_t width, uint32_t height) {
+    auto tiles_x = (width + tile_size - 1U) / tile_size;
+    auto tiles_y = (height + tile_size - 1U) / tile_size;
+
+    levels.push_back({
+        .width = width,
+        .height = height,
+        .tiles_x = tiles_x,
+        .offset = texels.size(),
+    });
+    texels.resize(texels.size() + (size_t)tiles_x * tiles_y * tile_size * tile_size);
+}
+
+size_t cpu_texture::texel_index(const level& mip, uint32_t x, uint32_t y) const {
+    auto tile = (size_t)(y / tile_size) * mip.tiles_x + x / tile_size;
+    auto swizzle = part_bits(x % tile_size) | (part_bits(y % tile_size) << 1U);
+
+    return mip.offset + tile * tile_size * tile_size + swizzle;
+}
+
+uint32_t cpu_texture::fetch(const level& mip, int64_t x, int64_t y, const cpu_sampler& sampler) const {
+    return texels[texel_index(mip, wrap(x, mip.width, sampler.address_u), wrap(y, mip.height, sampler.address_v))];
+}
+
+color cpu_texture::nearest(const level& mip, float u, float v, const cpu_sampler& sampler) const {
+    auto x = (int64_t)std::floor(u * (float)mip.width);
+    auto y = (int64_t)std::floor(v * (float)mip.height);
+
+    return unpack(fetch(mip, x, y, sampler));
+}
+
+color cpu_texture::bilinear(const level& mip, float u, float v, const cpu_sampler& sampler) const {
+    auto x = u * (float)mip.width - 0.5f;
+    auto y = v * (float)mip.height - 0.5f;
+    auto floor_x = std::floor(x);
+    auto floor_y = std::floor(y);
+    auto fx = x - floor_x;
+    auto fy = y - floor_y;
+    auto x0 = (int64_t)floor_x;
+    auto y0 = (int64_t)floor_y;
+
+    return lerp(
+        lerp(unpack(fetch(mip, x0, y0, sampler)), unpack(fetch(mip, x0 + 1, y0, sampler)), fx),
+        lerp(unpack(fetch(mip, x0, y0 + 1, sampler)), unpack(fetch(mip, x0 + 1, y0 + 1, sampler)), fx),
+        fy
+    );
+}
+
+color cpu_texture::filter(const level& mip, float u, float v, const cpu_sampler& sampler, bool nearest_filter) const {
+    return nearest_filter ? nearest(mip, u, v, sampler) : bilinear(mip, u, v, sampler);
+}
@@ -0,0 +1,436 @@
+#include "cpu-tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "brdf-lanes.hpp"
+#include "brdf.hpp"
+#include "color.hpp"
+#include "texture-compression.hpp"
+#include "utils.hpp"
+#include "vk-renderer.hpp"
+
+// Tiled copy of a material texture, compressed ones hold their encoded mip chain led by level 0
+static cpu_texture tiled_copy(const Texture& texture) {
+    assert(texture.data != nullptr && texture.width > 0 && texture.height > 0);
+
+    auto width = (uint32_t)texture.width;
+    auto height = (uint32_t)texture.height;
+    auto format = vkrenderer::api.get_image(texture.device_image).format;
+    if (!Texture::is_block_compressed(format)) {
+        return { (const uint32_t*)texture.data, width, height };
+    }
+
+    std::vector<uint8_t> decoded((size_t)width * height * 4U);
+    if (format == VK_FORMAT_BC7_UNORM_BLOCK) {
+        decode_bc7((const uint8_t*)texture.data, width, height, decoded.data());
+    } else {
+        decode_bc5((const uint8_t*)texture.data, width, height, decoded.data());
+    }
+
+    return { (const uint32_t*)decoded.data(), width, height };
+}
+
+cpu_tracer::cpu_tracer(const scene& traced_scene, uint32_t worker_count)
+    : traced_scene(traced_scene), query(traced_scene), meta(traced_scene.meta) {
+    // Only the workers sample the tiled copies
+    for (const auto& mat: traced_scene.materials) {
+        for (const auto* texture: { mat.base_color_texture, mat.metallic_roughness_texture }) {
+            if (worker_count > 0U && texture != nullptr && texture->data != nullptr && !textures.contains(texture)) {
+                textures.emplace(texture, tiled_copy(*texture));
+            }
+        }
+    }
+
+    reset(traced_scene.meta);
+
+    for (uint32_t worker_index { 0U }; worker_index < worker_count; worker_index++) {
+        workers.emplace_back(&cpu_tracer::work, this);
+    }
+}
+
+cpu_tracer::~cpu_tracer() {
+    {
+        std::lock_guard lock { mutex };
+        running = false;
+    }
+    work_available.notify_all();
+
+    for (auto& worker: workers) {
+        worker.join();
+    }
+}
+
+void cpu_tracer::reset(const scene::metadata& new_meta) {
+    std::lock_guard lock { mutex };
+
+    meta = new_meta;
+    generation++;
+
+    tiles_x = (meta.width + tile_size - 1) / tile_size;
+    tiles_y = (meta.height + tile_size - 1) / tile_size;
+    next_tile = 0;
+    pass = 0;
+
+    // A minimized window has no tiles, the budget of the last flush must not reach the workers
+    if (tiles_x * tiles_y * meta.view_count == 0U) {
+        tile_budget = 0;
+    }
+
+    samples.assign((size_t)meta.width * meta.height * meta.view_count * 4U, 0.f);
+    has_samples = false;
+}
+
+bool cpu_tracer::flush(Texture* samples_texture, float frame_time) {
+    std::lock_guard lock { mutex };
+
+    if (busy_time > 0.f) {
+        auto measured = (float)traced_samples / busy_time * (float)workers.size();
+        throughput = throughput == 0.f ? measured : throughput * 0.9f + measured * 0.1f;
+    }
+    traced_samples = 0;
+    busy_time = 0.f;
+
+    // Tiles the workers can finish while the GPU renders the next frame,
+    // at least one per worker so the throughput keeps being measured
+    if (enabled()) {
+        auto tiles = (uint32_t)(throughput * frame_time / (float)(tile_size * tile_size));
+        tile_budget = std::max(tiles, (uint32_t)workers.size());
+        work_available.notify_all();
+    } else {
+        tile_budget = 0;
+    }
+
+    if (!has_samples) {
+        return false;
+    }
+
+    auto data_size = samples.size() * sizeof(float);
+    assert(samples_texture->size() == data_size);
+
+    // The texture owns the copy until its upload is replaced by the next one
+    auto* data = malloc(data_size);
+    std::memcpy(data, samples.data(), data_size);
+    samples_texture->update(data);
+
+    std::fill(samples.begin(), samples.end(), 0.f);
+    has_samples = false;
+
+    return true;
+}
+
+void cpu_tracer::work() {
+    std::vector<float> tile_samples(tile_size * tile_size * 4U);
+    wavefront paths;
+    auto tile_meta = [this]() {
+        std::lock_guard lock { mutex };
+        return meta;
+    }();
+
+    while (true) {
+        uint32_t view = 0;
+        uint32_t tile_x = 0;
+        uint32_t tile_y = 0;
+        uint32_t tile_pass = 0;
+        uint64_t tile_generation = 0;
+
+        {
+            std::unique_lock lock { mutex };
+            work_available.wait(lock, [this]() { return !running || (tile_budget > 0 && tiles_x * tiles_y * meta.view_count > 0U); });
+
+            if (!running) {
+                return;
+            }
+
+            tile_budget--;
+            view = next_tile / (tiles_x * tiles_y);
+            tile_x = next_tile % (tiles_x * tiles_y) % tiles_x * tile_size;
+            tile_y = next_tile % (tiles_x * tiles_y) / tiles_x * tile_size;
+            tile_pass = pass;
+            tile_generation = generation;
+            tile_meta = meta;
+
+            if (++next_tile == tiles_x * tiles_y * meta.view_count) {
+                next_tile = 0;
+                pass++;
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        trace_tile(view, tile_x, tile_y, tile_pass, tile_meta, paths, tile_samples);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::lock_guard lock { mutex };
+        busy_time += std::chrono::duration<float, std::milli>(end - start).count();
+
+        // The accumulation restarted while this tile was traced
+        if (tile_generation != generation) {
+            continue;
+        }
+
+        for (uint32_t y { 0U }; y < tile_size && tile_y + y < meta.height; y++) {
+            for (uint32_t x { 0U }; x < tile_size && tile_x + x < meta.width; x++) {
+                auto* pixel = &samples[(((size_t)view * meta.height + tile_y + y) * meta.width + tile_x + x) * 4U];
+                const auto* tile_pixel = &tile_samples[(y * tile_size + x) * 4U];
+
+                pixel[0] += tile_pixel[0];
+                pixel[1] += tile_pixel[1];
+                pixel[2] += tile_pixel[2];
+                pixel[3] += tile_pixel[3];
+
+                traced_samples++;
+            }
+        }
+
+        has_samples = true;
+    }
+}
+
+// Mirrors generate_camera_ray of compute.comp
+ray cpu_tracer::generate_camera_ray(const camera& cam, uint32_t x, uint32_t y, uint32_t& seed, const scene::metadata& tile_meta) const {
+    auto scene_width = (float)(tile_meta.width - 1);
+    auto scene_height = (float)(tile_meta.height - 1);
+
+    auto u = (float)x / scene_width;
+    auto v = 1.f - (float)y / scene_height;
+
+    auto rand_disk = disk_vec(randf(seed), randf(seed));
+    auto jittered_u = u + randf(seed) / scene_width;
+    auto jittered_v = v + randf(seed) / scene_height;
+
+    vec3 lens_disk {};
+    if (tile_meta.enable_dof == (uint32_t)true) {
+        lens_disk = rand_disk * cam.lens_radius;
+    }
+
+    auto offset = lens_disk.v[0] * cam.right + lens_disk.v[1] * cam.up;
+    auto proj_plane_pos = cam.first_pixel + jittered_u * cam.horizontal + jittered_v * cam.vertical;
+
+    return { cam.position + offset, proj_plane_pos - cam.position - offset, 0.001f, 1e15f };
+}
+
+// Paths of a tile advance one bounce at a time so every bounce is a single batch of ray queries
+void cpu_tracer::trace_tile(uint32_t view, uint32_t tile_x, uint32_t tile_y, uint32_t tile_pass, const scene::metadata& tile_meta, wavefront& paths, std::vector<float>& tile_samples) const {
+    const auto& cam = tile_meta.cameras[view];
+    auto pixel_spread = 2.f * std::tan(deg_to_rad(cam.fov) / 2.f) / (float)tile_meta.height;
+
+    std::fill(tile_samples.begin(), tile_samples.end(), 0.f);
+    paths.rays.clear();
+    paths.states.clear();
+
+    for (uint32_t y { 0U }; y < tile_size; y++) {
+        for (uint32_t x { 0U }; x < tile_size; x++) {
+            auto pixel_x = tile_x + x;
+            auto pixel_y = tile_y + y;
+            if (pixel_x >= tile_meta.width || pixel_y >= tile_meta.height) {
+                continue;
+            }
+
+            auto pixel = y * tile_size + x;
+            tile_samples[pixel * 4U + 3U] = 1.f;
+
+            // Different constants than compute.comp so both devices do not trace the same paths
+            path_state state {
+                .throughput = color { 1.f, 1.f, 1.f },
+                .seed = (pixel_x * 7841U + pixel_y * 6143U + view * 4513U + tile_pass * 39119U) | 1U,
+                .pixel = pixel,
+                .cone_width = 0.f,
+                .cone_spread = pixel_spread,
+            };
+
+            paths.rays.push_back(generate_camera_ray(cam, pixel_x, pixel_y, state.seed, tile_meta));
+            paths.states.push_back(state);
+        }
+    }
+
+    for (uint32_t bounce { 0U }; bounce < tile_meta.max_bounce && !paths.rays.empty(); bounce++) {
+        query.closest_hit(paths.rays, paths.hits);
+
+        paths.surfaces.clear();
+        for (size_t path_index { 0U }; path_index < paths.rays.size(); path_index++) {
+            if (paths.hits[path_index].hit()) {
+                paths.surfaces.emplace_back().path = (uint32_t)path_index;
+                continue;
+            }
+
+            // Keep NaNs out of the shared accumulation
+            const auto& radiance = paths.states[path_index].throughput;
+            if (std::isfinite(radiance.v[0]) && std::isfinite(radiance.v[1]) && std::isfinite(radiance.v[2])) {
+                auto* tile_pixel = &tile_samples[paths.states[path_index].pixel * 4U];
+                tile_pixel[0] += radiance.v[0];
+                tile_pixel[1] += radiance.v[1];
+                tile_pixel[2] += radiance.v[2];
+            }
+        }
+
+        paths.lanes.resize(paths.surfaces.size());
+        for (size_t lane { 0U }; lane < paths.surfaces.size(); lane++) {
+            auto path_index = paths.surfaces[lane].path;
+            prepare_surface(paths.rays[path_index], paths.hits[path_index], paths.states[path_index], paths.surfaces[lane], paths.lanes, lane);
+        }
+
+        sample_brdf(paths.lanes);
+
+        // Surfaces are in path order so survivors only overwrite paths already handled
+        size_t alive_count = 0;
+        for (size_t lane { 0U }; lane < paths.surfaces.size(); lane++) {
+            auto state = paths.states[paths.surfaces[lane].path];
+
+            ray next_ray;
+            if (scatter(paths.surfaces[lane], paths.lanes, lane, bounce, tile_meta, state, next_ray)) {
+                paths.rays[alive_count] = next_ray;
+                paths.states[alive_count] = state;
+                alive_count++;
+            }
+        }
+
+        paths.rays.resize(alive_count);
+        paths.states.resize(alive_count);
+    }
+}
+
+// First half of the bounce loop body of ray_color in compute.comp, gathers the
+// surface properties and moves the view direction to tangent space
+void cpu_tracer::prepare_surface(const ray& r, hit_info info, path_state& state, surface& hit_surface, brdf_lanes& lanes, size_t lane) const {
+    const auto& indices = traced_scene.indices;
+    const auto& positions = traced_scene.positions;
+    const auto& normals = traced_scene.normals;
+    const auto& uvs = traced_scene.uvs;
+
+    auto v = -r.direction;
+
+    const auto* triangle_indices = &indices[(size_t)info.primitive_id * 3U];
+    uint32_t vertex_ids[3] = {
+        triangle_indices[0] & 0x00ffffffU,
+        triangle_indices[1] & 0x00ffffffU,
+        triangle_indices[2] & 0x00ffffffU,
+    };
+    auto material_id = (triangle_indices[0] & 0xff000000U) >> 8U
+                     | (triangle_indices[1] & 0xff000000U) >> 16U
+                     | (triangle_indices[2] & 0xff000000U) >> 24U;
+    const auto& mat = traced_scene.materials[material_id];
+
+    const auto& weights = info.barycentrics;
+    vec3 shading_normal {};
+    float uv[2] = {};
+    for (uint32_t vertex_index { 0U }; vertex_index < 3U; vertex_index++) {
+        auto id = vertex_ids[vertex_index];
+        auto weight = weights.v[vertex_index];
+
+        shading_normal += vec3 { normals[id * 3U], normals[id * 3U + 1U], normals[id * 3U + 2U] } * weight;
+        uv[0] += uvs[id * 2U] * weight;
+        uv[1] += uvs[id * 2U + 1U] * weight;
+    }
+    shading_normal.normalize();
+
+    // Texture independent part of the ray cone lod, from the cone width at the hit
+    // and the ratio between the uv and world areas of the triangle
+    point3 p[3];
+    for (uint32_t vertex_index { 0U }; vertex_index < 3U; vertex_index++) {
+        auto id = vertex_ids[vertex_index];
+        p[vertex_index] = { positions[id * 3U], positions[id * 3U + 1U], positions[id * 3U + 2U] };
+    }
+    const auto* uv0 = &uvs[vertex_ids[0] * 2U];
+    const auto* uv1 = &uvs[vertex_ids[1] * 2U];
+    const auto* uv2 = &uvs[vertex_ids[2] * 2U];
+    auto world_area = (p[1] - p[0]).cross(p[2] - p[0]).length();
+    auto uv_area = std::abs((uv1[0] - uv0[0]) * (uv2[1] - uv0[1]) - (uv2[0] - uv0[0]) * (uv1[1] - uv0[1]));
+    auto cos_angle = std::abs(info.geometry_normal.dot(r.direction)) / std::sqrt(r.direction.dot(r.direction));
+
+    state.cone_width += state.cone_spread * (info.point - r.origin).length();
+    auto cone_lod = 0.5f * std::log2(uv_area / world_area) + std::log2(state.cone_width / cos_angle);
+
+    auto diffuse_color = srgb_to_linear(sample_texture(mat.base_color_texture, mat.base_color_sampler, uv[0], uv[1], cone_lod)) * mat.base_color;
+    auto metallic_roughness = sample_texture(mat.metallic_roughness_texture, mat.metallic_roughness_sampler, uv[0], uv[1], cone_lod);
+    auto metalness = metallic_roughness.v[0] * mat.metalness;
+    auto roughness = metallic_roughness.v[1] * mat.roughness;
+
+    if (info.geometry_normal.dot(v) < 0.f) { info.geometry_normal = -info.geometry_normal; }
+    if (info.geometry_normal.dot(shading_normal) < 0.f) { shading_normal = -shading_normal; }
+
+    // Move to tangent space
+    hit_surface.to_local = rotation_to_z_axis(shading_normal);
+    hit_surface.geometry_normal = info.geometry_normal;
+    hit_surface.point = info.point;
+
+    auto view_local = rotate_point(hit_surface.to_local, v);
+    for (uint32_t axis { 0U }; axis < 3U; axis++) {
+        lanes.view[axis][lane] = view_local.v[axis];
+        lanes.base_color[axis][lane] = diffuse_color.v[axis];
+        lanes.random[axis][lane] = randf(state.seed);
+    }
+    lanes.metalness[lane] = metalness;
+    lanes.roughness[lane] = roughness;
+}
+
+// Second half of the bounce loop body, once the BRDF was sampled. Returns false when the path ends
+bool cpu_tracer::scatter(const surface& hit_surface, const brdf_lanes& lanes, size_t lane, uint32_t bounce, const scene::metadata& tile_meta, path_state& state, ray& next_ray) const {
+    color sample_weight { lanes.weight[0][lane], lanes.weight[1][lane], lanes.weight[2][lane] };
+
+    // Prevent tracing direction with no contribution
+    if (luminance(sample_weight) == 0.f) { return false; }
+
+    // Move to global space
+    vec3 ray_dir_local { lanes.direction[0][lane], lanes.direction[1][lane], lanes.direction[2][lane] };
+    auto ray_dir = rotate_point(invert_rotation(hit_surface.to_local), ray_dir_local);
+
+    // Prevent tracing direction "under" the hemisphere (behind the triangle)
+    if (hit_surface.geometry_normal.dot(ray_dir) <= 0.f) { return false; }
+
+    state.throughput = state.throughput * sample_weight;
+
+    // Rough lobes widen the cone by about their angular extent
+    auto roughness = lanes.roughness[lane];
+    state.cone_spread += lanes.type[lane] == DIFFUSE ? 1.f : roughness * roughness;
+
+    next_ray = ray(hit_surface.point, ray_dir, 0.001f, 1e15f);
+
+    // Russian Roulette
+    if (bounce > tile_meta.min_bounce) {
+        auto probability = std::min(0.95f, luminance(state.throughput));
+        if (probability < randf(state.seed)) { return false; }
+        state.throughput /= probability;
+    }
+
+    return true;
+}
+
+// Filters and address modes of the glTF sampler, converted from the settings of its GPU sampler
+static cpu_sampler cpu_sampler_from(const Sampler* sampler) {
+    auto address_mode = [](VkSamplerAddressMode mode) {
+        switch (mode) {
+            case VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE:
+                return cpu_sampler::address_mode::CLAMP_TO_EDGE;
+            case VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT:
+                return cpu_sampler::address_mode::MIRRORED_REPEAT;
+            default:
+                return cpu_sampler::address_mode::REPEAT;
+        }
+    };
+
+    if (sampler == nullptr) {
+        return {};
+    }
+
+    const auto& settings = sampler->settings;
+    return {
+        .address_u = address_mode(settings.address_mode_u),
+        .address_v = address_mode(settings.address_mode_v),
+        .nearest_mag = settings.mag_filter == VK_FILTER_NEAREST,
+        .nearest_min = settings.min_filter == VK_FILTER_NEAREST,
+        .nearest_mip = settings.mipmap_mode == VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    };
+}
+
+// Same filtering and addressing as the sampler of the material on the GPU
+color cpu_tracer::sample_texture(const Texture* texture, const Sampler* sampler, float u, float v, float cone_lod) const {
+    auto tiled_texture = textures.find(texture);
+    if (tiled_texture == textures.end()) {
+        return { 1.f, 1.f, 1.f };
+    }
+
+    const auto& tiled = tiled_texture->second;
+    return tiled.sample(u, v, cone_lod + tiled.lod_offset(), cpu_sampler_from(sampler));
+}
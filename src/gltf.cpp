@@ -1,6 +1,7 @@
 #include "gltf.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <execution>
 #include <filesystem>
 #include <fstream>
@@ -8,9 +9,14 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "texture-cache.hpp"
+#include "texture-compression.hpp"
 #include "utils.hpp"
 #include "vk-renderer.hpp"
 
+// Decoded textures, relative to the working directory like the other caches
+static const std::filesystem::path texture_cache_path = "texture-cache.bin";
+
 gltf::gltf(const std::filesystem::path& filepath) {
     auto parent_path = filepath.parent_path();
     std::fstream f{ filepath };
@@ -111,48 +117,218 @@ Mesh::attribute gltf::load_attribute(uint32_t accessor_index) {
     };
 }
 
+// Filters and wrap modes of a glTF sampler. Textures always have their mips, the levels
+// of the minification filters without mipmapping are picked like the others
+static sampler_settings sampler_settings_from(const json& gltf_sampler) {
+    auto address_mode = [](uint32_t wrap) {
+        switch (wrap) {
+            case 33071:
+                return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            case 33648:
+                return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+            default:
+                return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        }
+    };
+
+    sampler_settings settings {};
+    if (gltf_sampler.contains("magFilter")) {
+        settings.mag_filter = gltf_sampler["magFilter"].get<uint32_t>() == 9728 ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+    }
+
+    if (gltf_sampler.contains("minFilter")) {
+        switch (gltf_sampler["minFilter"].get<uint32_t>()) {
+            case 9728: // NEAREST
+            case 9984: // NEAREST_MIPMAP_NEAREST
+                settings.min_filter = VK_FILTER_NEAREST;
+                settings.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+                break;
+            case 9985: // LINEAR_MIPMAP_NEAREST
+                settings.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+                break;
+            case 9986: // NEAREST_MIPMAP_LINEAR
+                settings.min_filter = VK_FILTER_NEAREST;
+                break;
+            default:    // LINEAR, LINEAR_MIPMAP_LINEAR
+                break;
+        }
+    }
+
+    settings.address_mode_u = address_mode(gltf_sampler.value("wrapS", 10497U));
+    settings.address_mode_v = address_mode(gltf_sampler.value("wrapT", 10497U));
+
+    return settings;
+}
+
 void gltf::load_textures(const std::filesystem::path& path) {
     const auto& gltf_images = gltf_json["images"];
     auto images_count = gltf_images.size();
     std::vector<raw_image> images{ images_count };
 
+    // Metallic roughness images only need their red and green channels, the shaders
+    // read metalness and roughness from .xy. Images also used as base color keep all 4
+    const auto& gltf_textures = gltf_json["textures"];
+    std::vector<BLOCK_FORMAT> image_formats(images_count, BLOCK_FORMAT::BC7);
+    for (const auto* texture_slot: { "metallicRoughnessTexture", "baseColorTexture" }) {
+        for (const auto& gltf_material: gltf_json["materials"]) {
+            if (!gltf_material.contains("pbrMetallicRoughness") || !gltf_material["pbrMetallicRoughness"].contains(texture_slot)) {
+                continue;
+            }
+
+            auto texture_index = gltf_material["pbrMetallicRoughness"][texture_slot]["index"].get<uint32_t>();
+            auto image_index = gltf_textures[texture_index]["source"].get<uint32_t>();
+            image_formats[image_index] = std::strcmp(texture_slot, "baseColorTexture") == 0 ? BLOCK_FORMAT::BC7 : BLOCK_FORMAT::BC5;
+        }
+    }
+
+    const auto compress = vkrenderer::context.supports_texture_compression_bc;
+
+    // Outlives the glTF, the textures found in it keep reading their payload from the mapping
+    static texture_cache decoded_textures { texture_cache_path };
+
+    // Images decoded by this run, added to the cache once they are all loaded
+    struct decoded_source {
+        uint64_t        hash = 0;
+        uint64_t        size = 0;
+        cached_texture  texture {};
+    };
+    std::vector<decoded_source> decoded_sources{ images_count };
+
     std::vector<size_t> v(images_count);
     std::iota(v.begin(), v.end(), 0);
 
+    // Hashing the files is much cheaper than decoding them
+    std::vector<std::vector<uint8_t>> sources{ images_count };
+    std::vector<uint64_t> source_hashes(images_count);
     std::for_each(std::execution::par, v.begin(), v.end(), [&](const size_t image_index) {
-        const auto& gltf_image = gltf_images[image_index];
-        auto filepath = (path / gltf_image["uri"].get<std::string>()).string();
+        auto filepath = (path / gltf_images[image_index]["uri"].get<std::string>()).string();
+        sources[image_index] = read_file(filepath.c_str());
+        source_hashes[image_index] = texture_cache::hash(sources[image_index].data(), sources[image_index].size());
+    });
+
+    // Images with the same content are decoded and uploaded once, as the first of them.
+    // It keeps all 4 channels when any of its copies is a base color
+    std::vector<size_t> unique_images(images_count);
+    std::vector<size_t> decoded_images;
+    for (size_t image_index { 0U }; image_index < images_count; image_index++) {
+        unique_images[image_index] = image_index;
+        for (auto decoded_index: decoded_images) {
+            if (source_hashes[decoded_index] == source_hashes[image_index] && sources[decoded_index] == sources[image_index]) {
+                unique_images[image_index] = decoded_index;
+                break;
+            }
+        }
+
+        auto unique_index = unique_images[image_index];
+        if (unique_index == image_index) {
+            decoded_images.push_back(image_index);
+        } else if (image_formats[image_index] == BLOCK_FORMAT::BC7) {
+            image_formats[unique_index] = BLOCK_FORMAT::BC7;
+        }
+    }
+
+    std::for_each(std::execution::par, decoded_images.begin(), decoded_images.end(), [&](const size_t image_index) {
         auto& image = images[image_index];
-        image.data = stbi_load(filepath.c_str(), &image.width, &image.height, &image.channels, 4);
+        const auto& source = sources[image_index];
+        auto source_hash = source_hashes[image_index];
+
+        auto encoding = TEXTURE_ENCODING::RGBA8;
+        if (compress) {
+            encoding = image_formats[image_index] == BLOCK_FORMAT::BC7 ? TEXTURE_ENCODING::BC7 : TEXTURE_ENCODING::BC5;
+        }
+
+        cached_texture cached {};
+        if (decoded_textures.find(source_hash, source.size(), encoding, cached)) {
+            image.width = (int32_t)cached.width;
+            image.height = (int32_t)cached.height;
+            image.channels = 4;
+            image.data = const_cast<uint8_t*>(cached.payload);
+            image.mapped = true;
+            return;
+        }
+
+        image.data = stbi_load_from_memory(source.data(), (int)source.size(), &image.width, &image.height, &image.channels, 4);
+
+        auto& decoded = decoded_sources[image_index];
+        decoded.hash = source_hash;
+        decoded.size = source.size();
+        decoded.texture = {
+            .encoding = encoding,
+            .width = (uint32_t)image.width,
+            .height = (uint32_t)image.height,
+            .levels = 0,
+            .payload = nullptr,
+            .payload_size = 0,
+        };
+
+        // Every level is kept on the CPU, texture_streamer uploads the ones the shaders ask for
+        if (!compress) {
+            auto chain = rgba_mip_chain(image.data, image.width, image.height);
+            stbi_image_free(image.data);
+
+            image.data = (uint8_t*)malloc(chain.size());
+            std::memcpy(image.data, chain.data(), chain.size());
+            decoded.texture.levels = Texture::full_mip_levels(image.width, image.height);
+            decoded.texture.payload = image.data;
+            decoded.texture.payload_size = chain.size();
+        } else {
+            auto encoded = encode_mip_chain(image.data, image.width, image.height, image_formats[image_index]);
+            stbi_image_free(image.data);
+
+            image.data = (uint8_t*)malloc(encoded.blocks.size());
+            std::memcpy(image.data, encoded.blocks.data(), encoded.blocks.size());
+            decoded.texture.levels = encoded.levels;
+            decoded.texture.payload = image.data;
+            decoded.texture.payload_size = encoded.blocks.size();
+        }
     });
 
-    // const auto &gltf_samplers = gltf_json["samplers"];
-    // auto samplers_count = gltf_samplers.size();
-    // std::vector<Sampler *> samplers{samplers_count};
+    for (const auto& decoded: decoded_sources) {
+        if (decoded.texture.payload != nullptr) {
+            decoded_textures.add(decoded.hash, decoded.size, decoded.texture);
+        }
+    }
+    decoded_textures.save();
+
+    const auto& gltf_samplers = gltf_json["samplers"];
+    std::vector<Sampler*> samplers{ gltf_samplers.size() };
+    for (size_t sampler_index = 0; sampler_index < gltf_samplers.size(); sampler_index++) {
+        samplers[sampler_index] = vkrenderer::create_sampler(sampler_settings_from(gltf_samplers[sampler_index]));
+    }
 
-    Sampler* sampler = vkrenderer::create_sampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
-    // for (size_t sampler_index = 0; sampler_index < samplers_count; sampler_index++) {
-    //     samplers[sampler_index] = vkrenderer::create_sampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
-    // }
+    // Textures without sampler repeat and filter linearly
+    Sampler* default_sampler = vkrenderer::create_sampler(sampler_settings {});
 
-    const auto& gltf_textures = gltf_json["textures"];
     auto textures_count = gltf_textures.size();
     textures.resize(textures_count);
+    texture_samplers.resize(textures_count);
+
+    // One Texture per decoded image, the glTF textures referencing it share its bindless slot
+    std::vector<Texture*> image_textures(images_count, nullptr);
 
     for (size_t texture_index = 0; texture_index < textures_count; texture_index++) {
-        auto gltf_texture = gltf_textures[texture_index];
+        const auto& gltf_texture = gltf_textures[texture_index];
 
-        auto& image = images[gltf_texture["source"].get<uint32_t>()];
-        // if (gltf_texture.contains("sampler")) {
-        //     auto sampler_index = gltf_texture["sampler"].get<uint32_t>();
-        //     sampler = samplers[sampler_index];
-        // }
+        auto* sampler = default_sampler;
+        if (gltf_texture.contains("sampler")) {
+            sampler = samplers[gltf_texture["sampler"].get<uint32_t>()];
+        }
+        texture_samplers[texture_index] = sampler;
 
-        auto* texture = vkrenderer::create_2d_texture(static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), VK_FORMAT_R8G8B8A8_UNORM, sampler);
+        auto image_index = unique_images[gltf_texture["source"].get<uint32_t>()];
+        if (image_textures[image_index] == nullptr) {
+            const auto& image = images[image_index];
 
-        texture->update(image.data);
+            auto format = VK_FORMAT_R8G8B8A8_UNORM;
+            if (compress) {
+                format = image_formats[image_index] == BLOCK_FORMAT::BC7 ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC5_UNORM_BLOCK;
+            }
+
+            // Full mip chain on the CPU, the shaders pick the level from the ray cone footprint
+            image_textures[image_index] = vkrenderer::streamer.create_texture(static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), format, sampler, image.data, !image.mapped);
+        }
 
-        textures[texture_index] = texture;
+        textures[texture_index] = image_textures[image_index];
     }
 }
 
@@ -181,6 +357,7 @@ void gltf::load_materials() {
             if (pbr_params.contains("baseColorTexture")) {
                 auto base_color_index = pbr_params["baseColorTexture"]["index"].get<uint32_t>();
                 material.base_color_texture = textures[base_color_index];
+                material.base_color_sampler = texture_samplers[base_color_index];
             }
 
             if (pbr_params.contains("metallicFactor")) {
@@ -198,6 +375,7 @@ void gltf::load_materials() {
             if (pbr_params.contains("metallicRoughnessTexture")) {
                 auto metallic_roughness_index = pbr_params["metallicRoughnessTexture"]["index"].get<uint32_t>();
                 material.metallic_roughness_texture = textures[metallic_roughness_index];
+                material.metallic_roughness_sampler = texture_samplers[metallic_roughness_index];
             }
         }
     }
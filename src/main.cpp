@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <iostream>
 
 #include "imgui.h"
 
@@ -7,10 +13,13 @@
 #include <renderdoc.h>
 #endif
 
+#include "autotuner.hpp"
 #include "compute-renderpass.hpp"
+#include "cpu-tracer.hpp"
 #include "primitive-renderpass.hpp"
 #include "scene.hpp"
 #include "vk-renderer.hpp"
+#include "wavefront-renderpass.hpp"
 #include "window.hpp"
 #include "utils.hpp"
 
@@ -43,7 +52,10 @@ void update_ui(scene& main_scene, float delta_time) {
         main_scene.meta.sample_index = 1;
     }
 
+    ImGui::Text("samples per dispatch %u\n", main_scene.meta.samples_per_dispatch);
+
     ImGui::SliderInt("max bounces", (int32_t *)&main_scene.meta.max_bounce, 1, 250);
+    main_scene.bake_max_bounce = !ImGui::IsItemActive();
     ImGui::SliderInt("min bounces", (int32_t *)&main_scene.meta.min_bounce, 1, main_scene.meta.max_bounce);
     if (ImGui::SliderInt("downscale factor", (int32_t *)&main_scene.meta.downscale_factor, 1, 32)) {
         main_scene.meta.sample_index = 1;
@@ -199,14 +211,169 @@ RENDERDOC_API_1_1_2 enable_renderdoc() {
 }
 #endif
 
-int main() {
+// Scales the samples traced per dispatch so the dispatch lasts about target_ms,
+// moving halfway to the estimate to not oscillate on noisy timings
+uint32_t adapt_samples_per_dispatch(uint32_t samples, float duration_ms, float target_ms) {
+    const uint32_t max_samples = 64;
+
+    if (duration_ms <= 0.f) {
+        return samples;
+    }
+
+    auto sample_ms = duration_ms / (float)samples;
+    auto next_samples = (float)samples + 0.5f * (target_ms / sample_ms - (float)samples);
+
+    return std::clamp((uint32_t)std::lround(next_samples), 1U, max_samples);
+}
+
+// Steps the downscale factor so frames last about target_ms. The frame time goes
+// roughly with the pixel count, a factor is only lowered when the estimate for the
+// next one leaves some margin, to not oscillate between two factors
+int32_t adapt_downscale_factor(int32_t factor, float frame_ms, float target_ms) {
+    const int32_t max_factor = 8;
+
+    if (frame_ms > 1.1f * target_ms) {
+        return std::min(factor + 1, max_factor);
+    }
+
+    if (factor > 1) {
+        auto pixels_ratio = (float)(factor * factor) / (float)((factor - 1) * (factor - 1));
+        if (frame_ms * pixels_ratio < 0.9f * target_ms) {
+            return factor - 1;
+        }
+    }
+
+    return factor;
+}
+
+// BVH traversal of the raytracing pass, in the order of the TRAVERSAL_* constants of scene.h
+enum class TRAVERSAL : uint32_t {
+    STACKLESS,
+    SUBGROUP,
+    SHARED_STACK,
+};
+
+// Curve of the tonemapping pass, in the order of the OPERATOR_* constants of tonemapping.comp
+enum class TONEMAP_OPERATOR : uint32_t {
+    CLAMP,
+    REINHARD,
+    ACES,
+};
+
+enum class VIEW_LAYOUT {
+    SINGLE,
+    STEREO,
+    CUBEMAP,
+};
+
+// Size of a single view when all of them are laid out side by side in the window
+VkExtent2D view_extent(VIEW_LAYOUT layout, uint32_t view_count, uint32_t width, uint32_t height) {
+    auto view_width = width / view_count;
+
+    if (layout == VIEW_LAYOUT::CUBEMAP) {
+        auto side = std::min(view_width, height);
+        return { side, side };
+    }
+
+    return { view_width, height };
+}
+
+// Pixels traced per view at the given downscale factor, like render_extent() in integrator.h
+VkExtent2D render_extent(VkExtent2D view_size, int32_t downscale_factor) {
+    auto factor = (uint32_t)downscale_factor;
+
+    return { (view_size.width + factor - 1) / factor, (view_size.height + factor - 1) / factor };
+}
+
+int main(int argc, char** argv) {
 
 #if defined(ENABLE_RENDERDOC)
     auto* rdoc_api = enable_renderdoc();
 #endif
 
-    const float aspect_ratio = 16.0 / 9.0;
-    const auto width = 400;
+    auto layout = VIEW_LAYOUT::SINGLE;
+    auto compact_accumulation = false;
+    auto wavefront = false;
+    auto persistent_threads = false;
+    uint32_t samples_per_dispatch = 1;
+    auto target_dispatch_ms = 0.f;
+    auto target_frame_ms = 0.f;
+    auto traversal = TRAVERSAL::STACKLESS;
+    auto benchmark = false;
+    auto autotune = false;
+    auto shading_fp16 = false;
+    auto validate_fp16 = false;
+    auto bin_mode = BIN_MODE::NONE;
+    auto tonemap_operator = TONEMAP_OPERATOR::CLAMP;
+    auto exposure_stops = 0.f;
+    size_t texture_budget_mb = 0;
+    auto host_visible_scene = false;
+    auto async_post = false;
+    uint32_t frames_in_flight = vkrenderer::virtual_frames_count;
+    auto cpu_threads = cpu_tracer::default_worker_count();
+    for (int arg_index = 1; arg_index < argc; arg_index++) {
+        if (std::strcmp(argv[arg_index], "--views") == 0 && arg_index + 1 < argc) {
+            if (std::strcmp(argv[arg_index + 1], "stereo") == 0) { layout = VIEW_LAYOUT::STEREO; }
+            if (std::strcmp(argv[arg_index + 1], "cubemap") == 0) { layout = VIEW_LAYOUT::CUBEMAP; }
+        }
+        if (std::strcmp(argv[arg_index], "--compact-accumulation") == 0) { compact_accumulation = true; }
+        if (std::strcmp(argv[arg_index], "--wavefront") == 0) { wavefront = true; }
+        if (std::strcmp(argv[arg_index], "--persistent") == 0) { persistent_threads = true; }
+        if (std::strcmp(argv[arg_index], "--samples") == 0 && arg_index + 1 < argc) {
+            samples_per_dispatch = std::max(std::atoi(argv[arg_index + 1]), 1);
+        }
+        if (std::strcmp(argv[arg_index], "--traversal") == 0 && arg_index + 1 < argc) {
+            if (std::strcmp(argv[arg_index + 1], "subgroup") == 0) { traversal = TRAVERSAL::SUBGROUP; }
+            if (std::strcmp(argv[arg_index + 1], "shared-stack") == 0) { traversal = TRAVERSAL::SHARED_STACK; }
+        }
+        // Logs the GPU time of the raytracing dispatch, to compare the traversals, and the CPU time waiting on the GPU
+        if (std::strcmp(argv[arg_index], "--benchmark") == 0) { benchmark = true; }
+        // Times the workgroup shapes of the raytracing pass and saves the fastest for this GPU
+        if (std::strcmp(argv[arg_index], "--autotune") == 0) { autotune = true; }
+        // Shades in half precision, optionally checking the image against the float path
+        if (std::strcmp(argv[arg_index], "--fp16") == 0) { shading_fp16 = true; }
+        if (std::strcmp(argv[arg_index], "--fp16-validate") == 0) { shading_fp16 = true; validate_fp16 = true; }
+        // Adapts the samples per dispatch to the GPU time of the raytracing dispatch
+        if (std::strcmp(argv[arg_index], "--target-ms") == 0 && arg_index + 1 < argc) {
+            target_dispatch_ms = std::max((float)std::atof(argv[arg_index + 1]), 0.f);
+        }
+        // Lowers the resolution while the camera moves to keep the frame time under the target
+        if (std::strcmp(argv[arg_index], "--target-frame-ms") == 0 && arg_index + 1 < argc) {
+            target_frame_ms = std::max((float)std::atof(argv[arg_index + 1]), 0.f);
+        }
+        if (std::strcmp(argv[arg_index], "--tonemap") == 0 && arg_index + 1 < argc) {
+            if (std::strcmp(argv[arg_index + 1], "reinhard") == 0) { tonemap_operator = TONEMAP_OPERATOR::REINHARD; }
+            if (std::strcmp(argv[arg_index + 1], "aces") == 0) { tonemap_operator = TONEMAP_OPERATOR::ACES; }
+        }
+        if (std::strcmp(argv[arg_index], "--exposure") == 0 && arg_index + 1 < argc) {
+            exposure_stops = (float)std::atof(argv[arg_index + 1]);
+        }
+        // Keeps the scene data in host visible memory, to compare the traversal time with --benchmark
+        if (std::strcmp(argv[arg_index], "--host-scene") == 0) { host_visible_scene = true; }
+        // Device memory the streamed texture levels may use, every requested level stays resident without it
+        if (std::strcmp(argv[arg_index], "--texture-budget") == 0 && arg_index + 1 < argc) {
+            texture_budget_mb = (size_t)std::max(std::atoi(argv[arg_index + 1]), 0);
+        }
+        // Post processing on the compute queue, it costs a copy of the traced image per frame so
+        // compare the waits logged by --benchmark with and without it
+        if (std::strcmp(argv[arg_index], "--async-post") == 0) { async_post = true; }
+        // Workers tracing extra samples on the CPU, 0 measures the GPU alone
+        if (std::strcmp(argv[arg_index], "--cpu-threads") == 0 && arg_index + 1 < argc) {
+            cpu_threads = (uint32_t)std::max(std::atoi(argv[arg_index + 1]), 0);
+        }
+        // Frames the CPU records ahead of the GPU, fewer lower the latency and more hide the CPU stalls.
+        // Each one holds its own staging buffer and scene metadata, so at most 4
+        if (std::strcmp(argv[arg_index], "--frames-in-flight") == 0 && arg_index + 1 < argc) {
+            frames_in_flight = (uint32_t)std::clamp(std::atoi(argv[arg_index + 1]), 1, 4);
+        }
+        if (std::strcmp(argv[arg_index], "--bin") == 0 && arg_index + 1 < argc) {
+            if (std::strcmp(argv[arg_index + 1], "direction") == 0) { bin_mode = BIN_MODE::DIRECTION; }
+            if (std::strcmp(argv[arg_index + 1], "material") == 0) { bin_mode = BIN_MODE::MATERIAL; }
+        }
+    }
+
+    const float aspect_ratio = layout == VIEW_LAYOUT::CUBEMAP ? 6.f : 16.0 / 9.0;
+    const auto width = layout == VIEW_LAYOUT::SINGLE ? 400 : 1200;
     auto height = (uint32_t)(width / aspect_ratio);
 
     window wnd { width, height };
@@ -222,17 +389,110 @@ int main() {
     const auto aperture = 0.1f;
     const auto focus_distance = 10.f;
 
+    vkrenderer::virtual_frames_count = frames_in_flight;
+    std::cerr << frames_in_flight << " frames in flight" << std::endl;
+    vkrenderer::async_post = async_post;
     vkrenderer renderer { wnd };
+    vkrenderer::streamer.set_budget(texture_budget_mb * 1024ULL * 1024ULL);
+    vkrenderer::device_local_scene_data = !host_visible_scene;
 
     ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
     io.DisplaySize.x = (float)width;
     io.DisplaySize.y = (float)height;
 
-    auto main_scene = scene(camera(position, target, v_fov, aspect_ratio, aperture, focus_distance), width, height);
+    auto main_camera = camera(position, target, v_fov, aspect_ratio, aperture, focus_distance);
+    auto main_scene = scene(main_camera, width, height);
+    renderer.flush_uploads();
+
+    switch (layout) {
+        case VIEW_LAYOUT::STEREO: {
+            const auto eye_separation = 0.065f;
+            auto eyes = camera::stereo(main_camera, eye_separation);
+            main_scene.set_views(eyes.data(), eyes.size());
+            break;
+        }
+        case VIEW_LAYOUT::CUBEMAP: {
+            auto faces = camera::cubemap(position, focus_distance);
+            main_scene.set_views(faces.data(), faces.size());
+            break;
+        }
+        default:
+            break;
+    }
+
+    main_scene.meta.compact_accumulation = (uint32_t)compact_accumulation;
+    main_scene.meta.samples_per_dispatch = samples_per_dispatch;
+
+    auto view_count = main_scene.meta.view_count;
+    auto view_size = view_extent(layout, view_count, width, height);
+    main_scene.meta.width = view_size.width;
+    main_scene.meta.height = view_size.height;
+    if (layout != VIEW_LAYOUT::CUBEMAP) {
+        main_scene.set_views_aspect_ratio((float)view_size.width / (float)view_size.height);
+    }
+
+    if (wavefront && traversal != TRAVERSAL::STACKLESS) {
+        std::cerr << "The wavefront pass only has the stackless traversal, ignoring --traversal" << std::endl;
+        traversal = TRAVERSAL::STACKLESS;
+    }
+
+    const auto subgroup_operations = VK_SUBGROUP_FEATURE_VOTE_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+    if (traversal == TRAVERSAL::SUBGROUP && !vkrenderer::context.supports_compute_subgroup_operations(subgroup_operations)) {
+        std::cerr << "Subgroup vote and ballot are not supported in compute shaders, using the stackless traversal" << std::endl;
+        traversal = TRAVERSAL::STACKLESS;
+    }
+
+    if (shading_fp16 && !vkrenderer::context.supports_shader_float16) {
+        std::cerr << "shaderFloat16 is not supported, shading in float" << std::endl;
+        shading_fp16 = false;
+        validate_fp16 = false;
+    }
 
-    auto *raytracing_pass = renderer.create_compute_renderpass();
-    raytracing_pass->set_pipeline("compute");
+    // Each invocation of the shared stack traversal keeps SHARED_STACK_DEPTH ints of ray.h in shared
+    // memory, the smallest workgroups (8x8 tiles, persistent groups) have to fit them
+    const uint32_t shared_stack_bytes = 32U * sizeof(int32_t);
+    const auto shared_memory_size = vkrenderer::context.limits.maxComputeSharedMemorySize;
+    auto max_tile_invocations = vkrenderer::context.limits.maxComputeWorkGroupInvocations;
+    if (traversal == TRAVERSAL::SHARED_STACK && 64U * shared_stack_bytes > shared_memory_size) {
+        std::cerr << "The shared stacks do not fit in " << shared_memory_size << " bytes of shared memory, using the stackless traversal" << std::endl;
+        traversal = TRAVERSAL::STACKLESS;
+    } else if (traversal == TRAVERSAL::SHARED_STACK) {
+        max_tile_invocations = std::min(max_tile_invocations, shared_memory_size / shared_stack_bytes);
+    }
+
+    // Shape saved by a previous --autotune run on this GPU, 8x8 otherwise
+    tile_autotuner autotuner { "autotune.json", vkrenderer::context.id_properties.deviceUUID, max_tile_invocations };
+    auto tile = autotuner.shape();
+
+    auto raytracing_specialization = [&]() {
+        auto constants = main_scene.specialization_constants();
+        constants.push_back((uint32_t)traversal);
+        constants.push_back(tile.x);
+        constants.push_back(tile.y);
+        return constants;
+    };
+
+    // The persistent threads variant replaces the per pixel dispatch of compute.comp, each
+    // traversal other than stackless is compiled into its own variant, see shaders/CMakeLists.txt
+    static const char* raytracing_shaders[3][3] = {
+        { "compute", "compute_subgroup", "compute_shared_stack" },
+        { "compute_fp16", "compute_fp16_subgroup", "compute_fp16_shared_stack" },
+        { "compute_persistent", "compute_persistent_subgroup", "compute_persistent_shared_stack" },
+    };
+    const auto* raytracing_shader = raytracing_shaders[persistent_threads ? 2 : shading_fp16 ? 1 : 0][(uint32_t)traversal];
+    const auto* reference_shader = raytracing_shaders[0][(uint32_t)traversal];
+    validate_fp16 = validate_fp16 && !persistent_threads && !wavefront;
+    ComputeRenderpass* raytracing_pass = nullptr;
+    WavefrontRenderpass* wavefront_pass = nullptr;
+    if (wavefront) {
+        // The wavefront pass traces the same paths as compute.comp with one dispatch per stage
+        wavefront_pass = renderer.create_wavefront_renderpass();
+        wavefront_pass->set_bin_mode(bin_mode);
+    } else {
+        raytracing_pass = renderer.create_compute_renderpass();
+        raytracing_pass->set_pipeline(raytracing_shader, raytracing_specialization());
+    }
 
     watcher::watch_file(std::filesystem::path("../shaders/compute.comp"), [&]() {
         LPCSTR app_name = "glslc.exe --target-env=vulkan1.2 -std=460 ../shaders/compute.comp -o shaders/compute.comp.spv -I \"../shaders/include\"\0";
@@ -255,19 +515,111 @@ int main() {
         CloseHandle(proc_info.hProcess);
         CloseHandle(proc_info.hThread);
 
-        raytracing_pass->set_pipeline("compute");
+        if (raytracing_pass != nullptr) {
+            raytracing_pass->reload_pipelines();
+        }
     });
 
-    auto *accumulation_texture = vkrenderer::create_2d_texture(width, height, VK_FORMAT_R32G32B32A32_SFLOAT);
-    auto *output_texture = vkrenderer::create_2d_texture(width, height, VK_FORMAT_R32G32B32A32_SFLOAT);
-    raytracing_pass->set_constant(0, main_scene.scene_buffer);
-    raytracing_pass->set_constant(8, main_scene.bvh_buffer);
-    raytracing_pass->set_constant(16, main_scene.indices_buffer);
-    raytracing_pass->set_constant(24, main_scene.positions_buffer);
-    raytracing_pass->set_constant(32, main_scene.normals_buffer);
-    raytracing_pass->set_constant(40, main_scene.uvs_buffer);
-    raytracing_pass->set_constant(48, main_scene.materials_buffer);
-    raytracing_pass->set_dispatch_size(width / 8 + 1, height / 8 + 1, 1);
+    // Updated in place by the raytracing pass, then tonemapped into the swapchain image
+    const auto accumulation_format = compact_accumulation ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
+    auto *accumulation_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+    // Full size copy of an accumulation traced at reduced resolution
+    auto *upscaled_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+    auto set_scene_constants = [&](auto* pass) {
+        pass->set_constant(0, main_scene.scene_buffer);
+        pass->set_constant(8, main_scene.bvh_buffer);
+        pass->set_constant(16, main_scene.indices_buffer);
+        pass->set_constant(24, main_scene.positions_buffer);
+        pass->set_constant(32, main_scene.normals_buffer);
+        pass->set_constant(40, main_scene.uvs_buffer);
+        pass->set_constant(48, main_scene.materials_buffer);
+    };
+
+    if (wavefront_pass != nullptr) {
+        set_scene_constants(wavefront_pass);
+        wavefront_pass->resize(view_size.width, view_size.height, view_count);
+    } else {
+        set_scene_constants(raytracing_pass);
+    }
+
+    // Enough 64 threads workgroups to keep a large GPU busy, the ones in excess find no work left
+    const size_t persistent_group_count = 1024;
+    Buffer* work_counter = nullptr;
+    if (raytracing_pass != nullptr && persistent_threads) {
+        work_counter = vkrenderer::create_counter_buffer(sizeof(uint32_t));
+        main_scene.meta.work_counter_address = vkrenderer::api.get_buffer(work_counter->device_buffer).device_address;
+        raytracing_pass->add_cleared_buffer(work_counter);
+        raytracing_pass->set_dispatch_size(persistent_group_count, 1, 1);
+    }
+
+    // The wavefront pass traces a single sample per frame
+    if (wavefront_pass != nullptr) {
+        main_scene.meta.samples_per_dispatch = 1;
+    } else if (target_dispatch_ms > 0.f || benchmark || autotune) {
+        raytracing_pass->enable_timing();
+    }
+
+    // The persistent threads variant has a fixed 64x1 shape
+    if (raytracing_pass != nullptr && !persistent_threads && autotune) {
+        autotuner.start();
+    }
+
+    // The float path traces the same samples next to the half precision one, image_diff
+    // compares both accumulations once fp16_validation_samples were accumulated
+    const uint32_t fp16_validation_samples = 256;
+    const auto fp16_max_mean_error = 0.01f;
+    const auto fp16_max_outlier_ratio = 0.01f;
+    ComputeRenderpass* reference_pass = nullptr;
+    ComputeRenderpass* image_diff_pass = nullptr;
+    Texture* reference_texture = nullptr;
+    Texture* error_texture = nullptr;
+    Buffer* diff_result = nullptr;
+    uint64_t diff_frame = 0;
+    auto diff_pending = false;
+    auto fp16_differs = false;
+    if (validate_fp16) {
+        reference_pass = renderer.create_compute_renderpass();
+        set_scene_constants(reference_pass);
+        image_diff_pass = renderer.create_compute_renderpass();
+        image_diff_pass->set_pipeline("image_diff");
+        reference_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+        error_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, VK_FORMAT_R32G32B32A32_SFLOAT);
+        diff_result = vkrenderer::create_counter_buffer(3 * sizeof(uint32_t));
+    }
+
+    // Post processing, on the compute queue while the next frame traces with --async-post
+    auto *upscale_pass = renderer.create_post_renderpass();
+    auto *tonemapping_pass = renderer.create_post_renderpass();
+    renderer.set_present_pass(tonemapping_pass);
+
+    // Exposure multiplier, padded to the 8 bytes of a constant
+    float tonemapping_constants[2] { std::exp2(exposure_stops), 0.f };
+
+    // Workgroups covering every traced pixel of the views with the current tile, then
+    // every displayed one. The upscale pass is skipped at full resolution
+    auto set_tile_dispatch_sizes = [&]() {
+        auto traced_extent = render_extent(view_size, main_scene.meta.downscale_factor);
+        auto traced_group_count_x = (traced_extent.width + tile.x - 1) / tile.x;
+        auto traced_group_count_y = (traced_extent.height + tile.y - 1) / tile.y;
+        if (raytracing_pass != nullptr && work_counter == nullptr) {
+            raytracing_pass->set_dispatch_size(traced_group_count_x, traced_group_count_y, view_count);
+        }
+        if (reference_pass != nullptr) {
+            reference_pass->set_dispatch_size(traced_group_count_x, traced_group_count_y, view_count);
+        }
+        if (wavefront_pass != nullptr) {
+            wavefront_pass->set_render_extent(traced_extent.width, traced_extent.height, view_count);
+        }
+
+        auto group_count_x = (view_size.width + tile.x - 1) / tile.x;
+        auto group_count_y = (view_size.height + tile.y - 1) / tile.y;
+        size_t upscale_group_count = main_scene.meta.downscale_factor > 1 ? 1 : 0;
+        upscale_pass->set_dispatch_size(upscale_group_count * group_count_x, upscale_group_count * group_count_y, upscale_group_count * view_count);
+        tonemapping_pass->set_dispatch_size(group_count_x, group_count_y, view_count);
+    };
+
+    cpu_tracer hybrid_tracer { main_scene, cpu_threads };
+    auto *cpu_samples_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, VK_FORMAT_R32G32B32A32_SFLOAT);
 
     // uint8_t *pixels = nullptr;
     // int atlas_width, atlas_height;
@@ -289,6 +641,13 @@ int main() {
     // ui_pass->finalize_render_pass();
 
     auto can_render = true;
+    uint32_t frames_since_adaptation = 0;
+    // Frames since the accumulation was last reset, by a camera move or a setting change
+    uint32_t still_frames = 0;
+    auto benchmark_sample_ms = 0.f;
+    uint32_t benchmark_frames = 0;
+    auto benchmark_wait_ms = 0.f;
+    uint32_t benchmark_wait_frames = 0;
 
     while (wnd.isOpen) {
         end = std::chrono::high_resolution_clock::now();
@@ -306,8 +665,9 @@ int main() {
         for (auto &event : wnd.events) {
             switch (event.type) {
             case EVENT_TYPES::RESIZE: {
-                main_scene.meta.width = event.width;
-                main_scene.meta.height = event.height;
+                view_size = view_extent(layout, view_count, event.width, event.height);
+                main_scene.meta.width = view_size.width;
+                main_scene.meta.height = view_size.height;
 
                 io.DisplaySize.x = (float)event.width;
                 io.DisplaySize.y = (float)event.height;
@@ -317,13 +677,25 @@ int main() {
                 } else {
                     can_render = true;
                     renderer.recreate_swapchain();
-                    main_scene.meta.cam.set_aspect_ratio((float)event.width / (float)event.height);
+                    if (layout != VIEW_LAYOUT::CUBEMAP) {
+                        main_scene.set_views_aspect_ratio((float)view_size.width / (float)view_size.height);
+                    }
 
                     delete accumulation_texture;
-                    delete output_texture;
-                    accumulation_texture = vkrenderer::create_2d_texture(event.width, event.height, VK_FORMAT_R32G32B32A32_SFLOAT);
-                    output_texture = vkrenderer::create_2d_texture(event.width, event.height, VK_FORMAT_R32G32B32A32_SFLOAT);
-                    raytracing_pass->set_dispatch_size(event.width / 8 + 1, event.height / 8 + 1, 1);
+                    delete upscaled_texture;
+                    delete cpu_samples_texture;
+                    accumulation_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+                    upscaled_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+                    cpu_samples_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, VK_FORMAT_R32G32B32A32_SFLOAT);
+                    if (wavefront_pass != nullptr) {
+                        wavefront_pass->resize(view_size.width, view_size.height, view_count);
+                    }
+                    if (reference_pass != nullptr) {
+                        delete reference_texture;
+                        delete error_texture;
+                        reference_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, accumulation_format);
+                        error_texture = vkrenderer::create_2d_texture_array(view_size.width, view_size.height, view_count, VK_FORMAT_R32G32B32A32_SFLOAT);
+                    }
                 }
 
                 main_scene.meta.sample_index = 1;
@@ -338,45 +710,45 @@ int main() {
 
                 switch (event.key) {
                 case KEYS::W: {
-                    move_vec = main_scene.meta.cam.forward * move_speed;
+                    move_vec = main_scene.meta.cameras[0].forward * move_speed;
                     break;
                 }
 
                 case KEYS::S: {
-                    move_vec = -main_scene.meta.cam.forward * move_speed;
+                    move_vec = -main_scene.meta.cameras[0].forward * move_speed;
                     break;
                 }
                 case KEYS::D: {
-                    move_vec = main_scene.meta.cam.right * move_speed;
+                    move_vec = main_scene.meta.cameras[0].right * move_speed;
                     break;
                 }
                 case KEYS::A: {
-                    move_vec = -main_scene.meta.cam.right * move_speed;
+                    move_vec = -main_scene.meta.cameras[0].right * move_speed;
                     break;
                 }
                 case KEYS::E: {
-                    main_scene.meta.cam.rotate_y(0.001f * delta_time);
+                    main_scene.rotate_views_y(0.001f * delta_time);
                     main_scene.meta.sample_index = 1;
                     break;
                 }
                 case KEYS::Q: {
-                    main_scene.meta.cam.rotate_y(-0.001f * delta_time);
+                    main_scene.rotate_views_y(-0.001f * delta_time);
                     main_scene.meta.sample_index = 1;
                     break;
                 }
                 case KEYS::SPACE: {
-                    move_vec = main_scene.meta.cam.up * move_speed;
+                    move_vec = main_scene.meta.cameras[0].up * move_speed;
                     break;
                 }
                 case KEYS::LCTRL: {
-                    move_vec = -main_scene.meta.cam.up * move_speed;
+                    move_vec = -main_scene.meta.cameras[0].up * move_speed;
                     break;
                 }
                 default:
                     break;
                 }
 
-                main_scene.meta.cam.move(move_vec);
+                main_scene.move_views(move_vec);
 
                 if (!move_vec.near_zero()) { main_scene.meta.sample_index = 1; }
 
@@ -403,21 +775,148 @@ int main() {
 
         wnd.events.clear();
 
-        raytracing_pass->set_ouput_texture(output_texture);
-        raytracing_pass->set_constant(60, accumulation_texture);
+        // Trades resolution for frame time while the camera moves, then returns to full
+        // resolution once it stops so the image converges sharp
+        const uint32_t settle_frames = 16;
+        still_frames = main_scene.meta.sample_index <= 1 ? 0 : still_frames + 1;
+        if (target_frame_ms > 0.f) {
+            if (still_frames == 0) {
+                main_scene.meta.downscale_factor = adapt_downscale_factor(main_scene.meta.downscale_factor, delta_time, target_frame_ms);
+            } else if (still_frames == settle_frames && main_scene.meta.downscale_factor > 1) {
+                main_scene.meta.downscale_factor = 1;
+                main_scene.meta.sample_index = 1;
+            }
+        }
+
+        // Switches to the next candidate shape while autotuning
+        tile = autotuner.shape();
+        set_tile_dispatch_sizes();
+
+        if (wavefront_pass != nullptr) {
+            wavefront_pass->set_ouput_texture(accumulation_texture);
+            wavefront_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+            wavefront_pass->set_bounce_count(main_scene.meta.max_bounce);
+        } else {
+            // Toggling a baked setting switches to its permutation instead of branching per pixel
+            raytracing_pass->set_pipeline(raytracing_shader, raytracing_specialization());
+            raytracing_pass->set_ouput_texture(accumulation_texture);
+            raytracing_pass->set_constant(60, accumulation_texture);
+            raytracing_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+        }
+
+        if (reference_pass != nullptr) {
+            reference_pass->set_pipeline(reference_shader, raytracing_specialization());
+            reference_pass->set_ouput_texture(reference_texture);
+            reference_pass->set_constant(60, reference_texture);
+            reference_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+
+            // The comparison runs once, on the frame the accumulations reach the validation sample count
+            size_t diff_group_count = 0;
+            if (main_scene.meta.sample_index == fp16_validation_samples && !diff_pending) {
+                uint32_t zeros[3] {};
+                diff_result->write(zeros, 0, sizeof(zeros));
+                diff_group_count = 1;
+                diff_frame = frame_count;
+                diff_pending = true;
+            }
+            image_diff_pass->set_dispatch_size(diff_group_count * ((view_size.width + 7) / 8), diff_group_count * ((view_size.height + 7) / 8), diff_group_count * view_count);
+            image_diff_pass->set_ouput_texture(error_texture);
+            image_diff_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+            image_diff_pass->set_constant(8, diff_result);
+            image_diff_pass->set_constant(16, accumulation_texture);
+            image_diff_pass->set_constant(60, reference_texture);
+        }
+
+        upscale_pass->set_pipeline("upscale", { tile.x, tile.y });
+        upscale_pass->set_ouput_texture(upscaled_texture);
+        upscale_pass->set_constant(60, renderer.post_input(accumulation_texture));
+        upscale_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+
+        tonemapping_pass->set_pipeline("tonemapping", { tile.x, tile.y, (uint32_t)tonemap_operator });
+        tonemapping_pass->set_constant(8, (uint64_t*)&tonemapping_constants);
+        tonemapping_pass->set_constant(60, main_scene.meta.downscale_factor > 1 ? upscaled_texture : renderer.post_input(accumulation_texture));
+        tonemapping_pass->set_constant(0, main_scene.scene_buffer, renderer.frame_index() * sizeof(main_scene.meta));
+
+        // Samples traced by the CPU workers since the last frame are merged by compute.comp
+        if (can_render && main_scene.meta.sample_index <= 1) {
+            hybrid_tracer.reset(main_scene.meta);
+        }
+
+        main_scene.meta.cpu_samples_image_index = 0;
+        if (can_render && hybrid_tracer.flush(cpu_samples_texture, delta_time)) {
+            main_scene.meta.cpu_samples_image_index = vkrenderer::api.get_image(cpu_samples_texture->device_image).bindless_storage_index;
+            if (wavefront_pass != nullptr) {
+                wavefront_pass->add_input_texture(cpu_samples_texture);
+            } else {
+                raytracing_pass->add_input_texture(cpu_samples_texture);
+            }
+            if (reference_pass != nullptr) {
+                reference_pass->add_input_texture(cpu_samples_texture);
+            }
+        }
 
         renderer.begin_frame();
 
+        // The feedback of the last frame using this slot is complete, the table follows the uploads
+        vkrenderer::streamer.update(renderer.frame_index(), frame_count);
+        main_scene.meta.texture_table_address = vkrenderer::streamer.table_address(renderer.frame_index());
+        main_scene.meta.texture_feedback_address = vkrenderer::streamer.feedback_address(renderer.frame_index());
+
+        // The frame running image_diff is done, its totals are ready
+        if (diff_pending && frame_count == diff_frame + vkrenderer::virtual_frames_count) {
+            const auto* totals = (const uint32_t*)vkrenderer::api.get_buffer(diff_result->device_buffer).device_ptr;
+            auto pixel_count = (float)std::max(totals[2], 1U);
+            auto mean_error = (float)totals[0] / 1024.f / pixel_count;
+            auto outlier_ratio = (float)totals[1] / pixel_count;
+            auto matches = mean_error <= fp16_max_mean_error && outlier_ratio <= fp16_max_outlier_ratio;
+            std::cerr << "fp16 shading " << (matches ? "matches" : "differs from") << " the float path: mean error " << mean_error
+                      << ", " << outlier_ratio * 100.f << "% of the pixels over the threshold" << std::endl;
+            diff_pending = false;
+
+            // A mismatch fails the run, so scripts and CI catch precision regressions
+            if (!matches) {
+                fp16_differs = true;
+                wnd.isOpen = false;
+            }
+        }
+
+        // Timestamps come back virtual_frames_count frames late, wait for the ones of the current count
+        if (raytracing_pass != nullptr && target_dispatch_ms > 0.f && ++frames_since_adaptation > vkrenderer::virtual_frames_count) {
+            main_scene.meta.samples_per_dispatch = adapt_samples_per_dispatch(main_scene.meta.samples_per_dispatch, raytracing_pass->dispatch_duration(), target_dispatch_ms);
+            frames_since_adaptation = 0;
+        }
+
         // update_ui(main_scene, delta_time);
 
         if (can_render) {
             render(main_scene, renderer);
-
-            std::swap(output_texture, accumulation_texture);
         }
 
         renderer.finish_frame();
 
+        if (autotuner.tuning() && raytracing_pass->dispatch_duration() > 0.f) {
+            autotuner.record(raytracing_pass->dispatch_duration() / (float)main_scene.meta.samples_per_dispatch);
+        }
+
+        if (raytracing_pass != nullptr && benchmark && raytracing_pass->dispatch_duration() > 0.f) {
+            benchmark_sample_ms += raytracing_pass->dispatch_duration() / (float)main_scene.meta.samples_per_dispatch;
+            if (++benchmark_frames == 256) {
+                std::cerr << "traversal " << (uint32_t)traversal << ": " << benchmark_sample_ms / (float)benchmark_frames << " ms per sample" << std::endl;
+                benchmark_sample_ms = 0.f;
+                benchmark_frames = 0;
+            }
+        }
+
+        // Time the CPU spent blocked on the GPU, near 0 when the CPU is the bottleneck
+        if (benchmark) {
+            benchmark_wait_ms += renderer.frame_wait_time();
+            if (++benchmark_wait_frames == 256) {
+                std::cerr << vkrenderer::virtual_frames_count << " frames in flight: " << benchmark_wait_ms / (float)benchmark_wait_frames << " ms waited for the GPU per frame" << std::endl;
+                benchmark_wait_ms = 0.f;
+                benchmark_wait_frames = 0;
+            }
+        }
+
         frame_count++;
     }
 
@@ -433,5 +932,5 @@ int main() {
 
     // std::cerr << "Done !" << std::endl;
 
-    return 0;
+    return fp16_differs ? EXIT_FAILURE : 0;
 }
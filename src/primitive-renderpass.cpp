@@ -74,7 +74,7 @@ void Primitive::render(VkCommandBuffer command_buffer) {
 
 
 PrimitiveRenderpass::PrimitiveRenderpass(vkapi& api)
-        : Renderpass(api) {
+        : Renderpass(api), framebuffers(vkrenderer::virtual_frames_count) {
     };
 
 void PrimitiveRenderpass::add_primitive(Primitive* new_primitive) {
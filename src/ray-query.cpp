@@ -0,0 +1,312 @@
+#include "ray-query.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+#include <smmintrin.h>
+
+#include "scene.hpp"
+
+ray_query::ray_query(const std::vector<packed_bvh_node>& nodes, const std::vector<uint32_t>& indices, const std::vector<float>& positions)
+    : nodes(nodes), indices(indices), positions(positions) {}
+
+ray_query::ray_query(const scene& traced_scene)
+    : ray_query(traced_scene.bvh_nodes, traced_scene.indices, traced_scene.positions) {}
+
+void ray_query::closest_hit(const std::vector<ray>& rays, std::vector<hit_info>& hits) const {
+    hits.resize(rays.size());
+
+    if (rays.size() <= chunk_size) {
+        trace_chunk<false>(rays.data(), rays.size(), hits.data(), nullptr);
+        return;
+    }
+
+    std::vector<size_t> chunks((rays.size() + chunk_size - 1) / chunk_size);
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk_index) {
+        auto first = chunk_index * chunk_size;
+        trace_chunk<false>(rays.data() + first, std::min(chunk_size, rays.size() - first), hits.data() + first, nullptr);
+    });
+}
+
+void ray_query::any_hit(const std::vector<ray>& rays, std::vector<uint8_t>& occluded) const {
+    occluded.resize(rays.size());
+
+    if (rays.size() <= chunk_size) {
+        trace_chunk<true>(rays.data(), rays.size(), nullptr, occluded.data());
+        return;
+    }
+
+    std::vector<size_t> chunks((rays.size() + chunk_size - 1) / chunk_size);
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk_index) {
+        auto first = chunk_index * chunk_size;
+        trace_chunk<true>(rays.data() + first, std::min(chunk_size, rays.size() - first), nullptr, occluded.data() + first);
+    });
+}
+
+bool ray_query::closest_hit(const ray& r, hit_info& info) const {
+    return traverse<false>(r, info);
+}
+
+bool ray_query::any_hit(const ray& r) const {
+    hit_info info;
+    return traverse<true>(r, info);
+}
+
+template<bool any>
+void ray_query::trace_chunk(const ray* rays, size_t count, hit_info* hits, uint8_t* occluded) const {
+    for (size_t first { 0U }; first < count; first += packet_size) {
+        trace_packet<any>(
+            rays + first,
+            std::min(packet_size, count - first),
+            any ? nullptr : hits + first,
+            any ? occluded + first : nullptr
+        );
+    }
+}
+
+// Same traversal order as the scalar path, a node is entered when any active ray of the packet overlaps it
+template<bool any>
+void ray_query::trace_packet(const ray* rays, size_t count, hit_info* hits, uint8_t* occluded) const {
+    alignas(16) float lanes[8][packet_size] = {};
+    alignas(16) float t_max_lanes[packet_size] = {};
+    for (size_t lane { 0U }; lane < count; lane++) {
+        const auto& r = rays[lane];
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            lanes[axis][lane] = r.origin.v[axis];
+            lanes[axis + 3U][lane] = r.direction.v[axis];
+        }
+        lanes[6][lane] = std::max(r.min_t, 0.f);
+        lanes[7][lane] = r.min_t;
+        t_max_lanes[lane] = r.max_t;
+    }
+
+    __m128 origin[3] = { _mm_load_ps(lanes[0]), _mm_load_ps(lanes[1]), _mm_load_ps(lanes[2]) };
+    __m128 dir[3] = { _mm_load_ps(lanes[3]), _mm_load_ps(lanes[4]), _mm_load_ps(lanes[5]) };
+    __m128 inv_dir[3] = {
+        _mm_div_ps(_mm_set1_ps(1.f), dir[0]),
+        _mm_div_ps(_mm_set1_ps(1.f), dir[1]),
+        _mm_div_ps(_mm_set1_ps(1.f), dir[2]),
+    };
+    __m128 box_t_min = _mm_load_ps(lanes[6]);
+    __m128 t_min = _mm_load_ps(lanes[7]);
+    __m128 t_max = _mm_load_ps(t_max_lanes);
+
+    __m128 active = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32((int32_t)count)));
+
+    alignas(16) float u_lanes[packet_size] = {};
+    alignas(16) float v_lanes[packet_size] = {};
+    uint32_t primitive_ids[packet_size] = { hit_info::miss, hit_info::miss, hit_info::miss, hit_info::miss };
+
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.f);
+
+    int32_t id = 0;
+    while (id != -1) {
+        const auto& node = nodes[id];
+
+        if (node.primitive_id == -1) {
+            auto t0 = box_t_min;
+            auto t1 = t_max;
+            for (uint32_t axis { 0U }; axis < 3U; axis++) {
+                auto near_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[axis]), origin[axis]), inv_dir[axis]);
+                auto far_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[axis]), origin[axis]), inv_dir[axis]);
+                t0 = _mm_max_ps(t0, _mm_min_ps(near_t, far_t));
+                t1 = _mm_min_ps(t1, _mm_max_ps(near_t, far_t));
+            }
+
+            auto overlap = _mm_and_ps(_mm_cmpge_ps(t1, t0), active);
+            id = _mm_movemask_ps(overlap) != 0 ? id + 1 : node.next_id;
+            continue;
+        }
+
+        // Leaf, one triangle tested against the whole packet
+        auto primitive_id = (uint32_t)node.primitive_id;
+        float p[3][3];
+        for (uint32_t vertex_index { 0U }; vertex_index < 3U; vertex_index++) {
+            auto vertex_id = indices[(size_t)primitive_id * 3U + vertex_index] & 0x00ffffffU;
+            for (uint32_t axis { 0U }; axis < 3U; axis++) {
+                p[vertex_index][axis] = positions[vertex_id * 3U + axis];
+            }
+        }
+
+        float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        float normal[3] = {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0],
+        };
+
+        __m128 originv1[3] = {
+            _mm_sub_ps(origin[0], _mm_set1_ps(p[0][0])),
+            _mm_sub_ps(origin[1], _mm_set1_ps(p[0][1])),
+            _mm_sub_ps(origin[2], _mm_set1_ps(p[0][2])),
+        };
+
+        __m128 q[3] = {
+            _mm_sub_ps(_mm_mul_ps(originv1[1], dir[2]), _mm_mul_ps(originv1[2], dir[1])),
+            _mm_sub_ps(_mm_mul_ps(originv1[2], dir[0]), _mm_mul_ps(originv1[0], dir[2])),
+            _mm_sub_ps(_mm_mul_ps(originv1[0], dir[1]), _mm_mul_ps(originv1[1], dir[0])),
+        };
+
+        auto dot = [](const __m128 a[3], const float b[3]) {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a[0], _mm_set1_ps(b[0])), _mm_mul_ps(a[1], _mm_set1_ps(b[1]))),
+                _mm_mul_ps(a[2], _mm_set1_ps(b[2]))
+            );
+        };
+
+        auto d = _mm_div_ps(one, dot(dir, normal));
+        auto u = _mm_mul_ps(d, _mm_sub_ps(zero, dot(q, e2)));
+        auto v = _mm_mul_ps(d, dot(q, e1));
+        auto t = _mm_mul_ps(d, _mm_sub_ps(zero, dot(originv1, normal)));
+
+        auto hit = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)),
+            _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one))
+        );
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, t_min), _mm_cmple_ps(t, t_max)));
+        hit = _mm_and_ps(hit, active);
+
+        auto hit_mask = _mm_movemask_ps(hit);
+        if (hit_mask != 0) {
+            t_max = _mm_blendv_ps(t_max, t, hit);
+
+            alignas(16) float u_hit[packet_size];
+            alignas(16) float v_hit[packet_size];
+            _mm_store_ps(u_hit, u);
+            _mm_store_ps(v_hit, v);
+
+            for (size_t lane { 0U }; lane < packet_size; lane++) {
+                if ((hit_mask & (1 << lane)) != 0) {
+                    u_lanes[lane] = u_hit[lane];
+                    v_lanes[lane] = v_hit[lane];
+                    primitive_ids[lane] = primitive_id;
+                }
+            }
+
+            // Occlusion only needs one hit per ray
+            if constexpr (any) {
+                active = _mm_andnot_ps(hit, active);
+                if (_mm_movemask_ps(active) == 0) {
+                    break;
+                }
+            }
+        }
+
+        id = node.next_id;
+    }
+
+    if constexpr (any) {
+        for (size_t lane { 0U }; lane < count; lane++) {
+            occluded[lane] = primitive_ids[lane] != hit_info::miss ? 1U : 0U;
+        }
+    } else {
+        _mm_store_ps(t_max_lanes, t_max);
+
+        for (size_t lane { 0U }; lane < count; lane++) {
+            auto& info = hits[lane];
+            info = hit_info {};
+
+            if (primitive_ids[lane] == hit_info::miss) {
+                continue;
+            }
+
+            info.t = t_max_lanes[lane];
+            info.barycentrics = { 1.f - u_lanes[lane] - v_lanes[lane], u_lanes[lane], v_lanes[lane] };
+            info.primitive_id = primitive_ids[lane];
+            fill_hit(rays[lane], info);
+        }
+    }
+}
+
+// Mirrors hit_node of ray.h, stackless traversal of the depth first ordered nodes
+template<bool any>
+bool ray_query::traverse(ray r, hit_info& info) const {
+    hit_info temp_info;
+    auto hit = false;
+    int32_t id = 0;
+
+    info = hit_info {};
+
+    float inv_dir[3] = { 1.f / r.direction.v[0], 1.f / r.direction.v[1], 1.f / r.direction.v[2] };
+
+    while (id != -1) {
+        const auto& node = nodes[id];
+
+        if (node.primitive_id != -1) {
+            if (hit_triangle(node.primitive_id, r, temp_info)) {
+                info = temp_info;
+                r.max_t = temp_info.t;
+                hit = true;
+
+                if constexpr (any) {
+                    break;
+                }
+            }
+            id = node.next_id;
+            continue;
+        }
+
+        auto t0 = std::max(r.min_t, 0.f);
+        auto t1 = r.max_t;
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            auto near_t = (node.min[axis] - r.origin.v[axis]) * inv_dir[axis];
+            auto far_t = (node.max[axis] - r.origin.v[axis]) * inv_dir[axis];
+            t0 = std::max(t0, std::min(near_t, far_t));
+            t1 = std::min(t1, std::max(near_t, far_t));
+        }
+
+        id = t1 >= t0 ? id + 1 : node.next_id;
+    }
+
+    info.point = r.at(info.t);
+    return hit;
+}
+
+// Mirrors hit_triangle of ray.h
+bool ray_query::hit_triangle(uint32_t id, const ray& r, hit_info& info) const {
+    point3 p[3];
+    for (uint32_t vertex_index { 0U }; vertex_index < 3U; vertex_index++) {
+        auto vertex_id = indices[(size_t)id * 3U + vertex_index] & 0x00ffffffU;
+        p[vertex_index] = { positions[vertex_id * 3U], positions[vertex_id * 3U + 1U], positions[vertex_id * 3U + 2U] };
+    }
+
+    auto v2v1 = p[1] - p[0];
+    auto v3v1 = p[2] - p[0];
+
+    auto originv1 = r.origin - p[0];
+    auto normal = v2v1.cross(v3v1);
+    auto q = originv1.cross(r.direction);
+    auto d = 1.f / r.direction.dot(normal);
+    auto u = d * (-q).dot(v3v1);
+    auto v = d * q.dot(v2v1);
+    auto t = d * (-normal).dot(originv1);
+
+    if (u < 0.f || u > 1.f || v < 0.f || u + v > 1.f || t < r.min_t || t > r.max_t) {
+        return false;
+    }
+
+    info.t = t;
+    info.barycentrics = { 1.f - u - v, u, v };
+    info.geometry_normal = normal.normalize();
+    info.primitive_id = id;
+
+    return true;
+}
+
+void ray_query::fill_hit(const ray& r, hit_info& info) const {
+    point3 p[3];
+    for (uint32_t vertex_index { 0U }; vertex_index < 3U; vertex_index++) {
+        auto vertex_id = indices[(size_t)info.primitive_id * 3U + vertex_index] & 0x00ffffffU;
+        p[vertex_index] = { positions[vertex_id * 3U], positions[vertex_id * 3U + 1U], positions[vertex_id * 3U + 2U] };
+    }
+
+    info.geometry_normal = (p[1] - p[0]).cross(p[2] - p[0]).normalize();
+    info.point = r.at(info.t);
+}
@@ -1,5 +1,8 @@
 #include "scene.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <filesystem>
 #include <queue>
 
@@ -59,18 +62,15 @@
 
 
 scene::metadata::metadata(const camera &cam, uint32_t width, uint32_t height)
-    : cam(cam), width(width), height(height) {}
+    : width(width), height(height) {
+    std::fill(std::begin(cameras), std::end(cameras), cam);
+}
 
 scene::scene(const camera& cam, uint32_t width, uint32_t height)
     :meta(cam, width, height){
 
     // Geometry & BVH
-    std::vector<uint32_t>       indices;
-    std::vector<float>          positions;
-    std::vector<float>          normals;
-    std::vector<float>          uvs;
-    std::vector<gpu_material>   materials;
-    std::vector<packed_bvh_node> packed_nodes;
+    std::vector<gpu_material>   gpu_materials;
 
     // auto root_node = gltf::load("../models/BistroInterior", "BistroInterior.gltf");
     auto gltf_model = gltf("../models/sponza/Sponza.gltf");
@@ -137,28 +137,27 @@ scene::scene(const camera& cam, uint32_t width, uint32_t height)
 
                     auto triangle_offset = triangles_offset * 3 + index_offset;
 
-                    indices[triangle_offset]        = (submesh_level_index_1 + vertex_offset) | (0xff000000 & (materials.size() << 8));
-                    indices[triangle_offset + 1]    = (submesh_level_index_2 + vertex_offset) | (0xff000000 & (materials.size() << 16));
-                    indices[triangle_offset + 2]    = (submesh_level_index_3 + vertex_offset) | (0xff000000 & (materials.size() << 24));
+                    indices[triangle_offset]        = (submesh_level_index_1 + vertex_offset) | (0xff000000 & (gpu_materials.size() << 8));
+                    indices[triangle_offset + 1]    = (submesh_level_index_2 + vertex_offset) | (0xff000000 & (gpu_materials.size() << 16));
+                    indices[triangle_offset + 2]    = (submesh_level_index_3 + vertex_offset) | (0xff000000 & (gpu_materials.size() << 24));
                 }
 
-                const auto& albedo_image = vkrenderer::api.get_image(material.base_color_texture->device_image);
-                const auto& albedo_sampler = vkrenderer::api.get_sampler(material.base_color_texture->sampler->device_sampler);
+                const auto& albedo_sampler = vkrenderer::api.get_sampler(material.base_color_sampler->device_sampler);
 
-                materials.emplace_back(gpu_material {
+                materials.push_back(material);
+                gpu_materials.emplace_back(gpu_material {
                     .base_color = material.base_color,
-                    .albedo_texture_id = albedo_image.bindless_sampled_index,
+                    .albedo_texture_id = vkrenderer::streamer.slot(material.base_color_texture),
                     .albedo_texture_sampler_id = albedo_sampler.bindless_index,
                     .metalness = material.metalness,
                     .roughness = material.roughness
                 });
 
                 if (material.metallic_roughness_texture != nullptr) {
-                    auto& gpu_material = materials.back();
-                    const auto& metallic_roughness_image = vkrenderer::api.get_image(material.metallic_roughness_texture->device_image);
-                    const auto& metallic_roughness_sampler = vkrenderer::api.get_sampler(material.metallic_roughness_texture->sampler->device_sampler);
+                    auto& gpu_material = gpu_materials.back();
+                    const auto& metallic_roughness_sampler = vkrenderer::api.get_sampler(material.metallic_roughness_sampler->device_sampler);
 
-                    gpu_material.metallic_roughness_texture_id = metallic_roughness_image.bindless_sampled_index;
+                    gpu_material.metallic_roughness_texture_id = vkrenderer::streamer.slot(material.metallic_roughness_texture);
                     gpu_material.metallic_roughness_texture_sampler_id = metallic_roughness_sampler.bindless_index;
                 }
 
@@ -177,29 +176,74 @@ scene::scene(const camera& cam, uint32_t width, uint32_t height)
 
     // random_scene();
 
-    bvh builder(triangles, packed_nodes);
+    bvh builder(triangles, bvh_nodes);
     // bvh builder(spheres, packed_nodes);
 
     scene_buffer = vkrenderer::create_buffer(sizeof(meta) * vkrenderer::virtual_frames_count);
-    scene_buffer->write(&meta, 0, sizeof(meta));
-    scene_buffer->write(&meta, sizeof(meta), sizeof(meta));
-    scene_buffer->write(&meta, sizeof(meta) * 2, sizeof(meta));
+    for (uint32_t frame_index { 0U }; frame_index < vkrenderer::virtual_frames_count; frame_index++) {
+        scene_buffer->write(&meta, sizeof(meta) * frame_index, sizeof(meta));
+    }
 
-    indices_buffer = vkrenderer::create_buffer(indices.size() * sizeof(indices[0]));
+    indices_buffer = vkrenderer::create_scene_buffer(indices.size() * sizeof(indices[0]));
     indices_buffer->write(indices.data(), 0, indices.size() * sizeof(indices[0]));
 
-    positions_buffer = vkrenderer::create_buffer(positions.size() * sizeof(positions[0]));
+    positions_buffer = vkrenderer::create_scene_buffer(positions.size() * sizeof(positions[0]));
     positions_buffer->write(positions.data(), 0, positions.size() * sizeof(positions[0]));
 
-    normals_buffer = vkrenderer::create_buffer(normals.size() * sizeof(normals[0]));
+    normals_buffer = vkrenderer::create_scene_buffer(normals.size() * sizeof(normals[0]));
     normals_buffer->write(normals.data(), 0, normals.size() * sizeof(normals[0]));
 
-    uvs_buffer = vkrenderer::create_buffer(uvs.size() * sizeof(uvs[0]));
+    uvs_buffer = vkrenderer::create_scene_buffer(uvs.size() * sizeof(uvs[0]));
     uvs_buffer->write(uvs.data(), 0, uvs.size() * sizeof(uvs[0]));
 
-    bvh_buffer = vkrenderer::create_buffer(packed_nodes.size() * sizeof(packed_nodes[0]));
-    bvh_buffer->write(packed_nodes.data(), 0, packed_nodes.size() * sizeof(packed_nodes[0]));
+    bvh_buffer = vkrenderer::create_scene_buffer(bvh_nodes.size() * sizeof(bvh_nodes[0]));
+    bvh_buffer->write(bvh_nodes.data(), 0, bvh_nodes.size() * sizeof(bvh_nodes[0]));
+
+    materials_buffer = vkrenderer::create_scene_buffer(gpu_materials.size() * sizeof(gpu_materials[0]));
+    materials_buffer->write(gpu_materials.data(), 0, gpu_materials.size() * sizeof(gpu_materials[0]));
+}
+
+void scene::set_views(const camera* views, uint32_t count) {
+    assert(count > 0 && count <= max_views);
+
+    std::copy(views, views + count, meta.cameras);
+    meta.view_count = count;
+}
+
+void scene::move_views(const vec3& v) {
+    for (uint32_t view_index { 0U }; view_index < meta.view_count; view_index++) {
+        meta.cameras[view_index].move(v);
+    }
+}
+
+void scene::rotate_views_y(float theta) {
+    // Views turn around the center of the rig so stereo eyes keep their baseline
+    vec3 pivot {};
+    for (uint32_t view_index { 0U }; view_index < meta.view_count; view_index++) {
+        pivot += meta.cameras[view_index].position;
+    }
+    pivot = pivot / (float)meta.view_count;
+
+    for (uint32_t view_index { 0U }; view_index < meta.view_count; view_index++) {
+        auto& view = meta.cameras[view_index];
+        auto offset = view.position - pivot;
+        vec3 rotated_offset {
+            offset.v[0] * cos(theta) - offset.v[2] * sin(theta),
+            offset.v[1],
+            offset.v[0] * sin(theta) + offset.v[2] * cos(theta),
+        };
+
+        view.rotate_y(theta);
+        view.move(rotated_offset - offset);
+    }
+}
+
+void scene::set_views_aspect_ratio(float ratio) {
+    for (uint32_t view_index { 0U }; view_index < meta.view_count; view_index++) {
+        meta.cameras[view_index].set_aspect_ratio(ratio);
+    }
+}
 
-    materials_buffer = vkrenderer::create_buffer(materials.size() * sizeof(materials[0]));
-    materials_buffer->write(materials.data(), 0, materials.size() * sizeof(materials[0]));
+std::vector<uint32_t> scene::specialization_constants() const {
+    return { meta.debug_bvh, meta.enable_dof, bake_max_bounce ? meta.max_bounce : scene_value };
 }
@@ -0,0 +1,241 @@
+#include "texture-cache.hpp"
+
+#if defined(WINDOWS)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+static constexpr uint32_t container_magic = 0x43585450; // "PTXC"
+static constexpr uint32_t container_version = 2;
+
+// Payloads start on 16 bytes, the staging copies of compressed levels need whole blocks
+static constexpr uint64_t payload_alignment = 16;
+
+struct container_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    entry_count;
+    uint32_t    padding;
+};
+
+texture_cache::texture_cache(const std::filesystem::path& container_path)
+    : path(container_path)
+{
+    open();
+}
+
+texture_cache::~texture_cache() {
+    unmap();
+}
+
+void texture_cache::open() {
+    // Left aside by save while this container was mapped, it replaces it now nothing maps it
+    std::error_code pending_error;
+    if (std::filesystem::exists(pending_path(), pending_error)) {
+        std::filesystem::rename(pending_path(), path, pending_error);
+    }
+
+#if defined(WINDOWS)
+    file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER file_size {};
+    GetFileSizeEx(file_handle, &file_size);
+    mapping_size = (size_t)file_size.QuadPart;
+
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle != nullptr) {
+        mapping = (const uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    auto file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+
+    struct stat file_stat {};
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        mapping_size = (size_t)file_stat.st_size;
+        auto* address = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+        mapping = address == MAP_FAILED ? nullptr : (const uint8_t*)address;
+    }
+
+    // The mapping keeps the file alive
+    close(file);
+#endif
+
+    if (mapping == nullptr || mapping_size < sizeof(container_header)) {
+        unmap();
+        return;
+    }
+
+    container_header header {};
+    std::memcpy(&header, mapping, sizeof(header));
+
+    auto table_end = sizeof(container_header) + (size_t)header.entry_count * sizeof(entry);
+    if (header.magic != container_magic || header.version != container_version || table_end > mapping_size) {
+        unmap();
+        return;
+    }
+
+    mapped_entries.resize(header.entry_count);
+    std::memcpy(mapped_entries.data(), mapping + sizeof(container_header), header.entry_count * sizeof(entry));
+
+    for (const auto& mapped_entry: mapped_entries) {
+        if (mapped_entry.payload_offset < table_end || mapped_entry.payload_offset + mapped_entry.payload_size > mapping_size) {
+            std::cerr << "Ignoring the corrupted texture cache " << path.string() << std::endl;
+            mapped_entries.clear();
+            mapped_payloads.clear();
+            unmap();
+            return;
+        }
+
+        mapped_payloads.push_back(mapping + mapped_entry.payload_offset);
+    }
+}
+
+void texture_cache::unmap() {
+#if defined(WINDOWS)
+    if (mapping != nullptr) {
+        UnmapViewOfFile(mapping);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+    }
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (mapping != nullptr) {
+        munmap((void*)mapping, mapping_size);
+    }
+#endif
+
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+bool texture_cache::find(uint64_t source_hash, uint64_t source_size, TEXTURE_ENCODING encoding, cached_texture& texture) const {
+    // A scene has tens of textures, a linear search is enough
+    for (size_t entry_index { 0U }; entry_index < mapped_entries.size(); entry_index++) {
+        const auto& mapped_entry = mapped_entries[entry_index];
+        if (mapped_entry.source_hash != source_hash || mapped_entry.source_size != source_size || mapped_entry.encoding != (uint32_t)encoding) {
+            continue;
+        }
+
+        texture = {
+            .encoding = encoding,
+            .width = mapped_entry.width,
+            .height = mapped_entry.height,
+            .levels = mapped_entry.levels,
+            .payload = mapped_payloads[entry_index],
+            .payload_size = mapped_entry.payload_size,
+        };
+        return true;
+    }
+
+    return false;
+}
+
+void texture_cache::add(uint64_t source_hash, uint64_t source_size, const cached_texture& texture) {
+    added_entries.push_back({
+        .source_hash = source_hash,
+        .source_size = source_size,
+        .encoding = (uint32_t)texture.encoding,
+        .width = texture.width,
+        .height = texture.height,
+        .levels = texture.levels,
+        .payload_offset = 0,
+        .payload_size = texture.payload_size,
+    });
+    added_payloads.emplace_back(texture.payload, texture.payload + texture.payload_size);
+}
+
+void texture_cache::save() {
+    if (added_entries.empty()) {
+        return;
+    }
+
+    auto entries = mapped_entries;
+    entries.insert(entries.end(), added_entries.begin(), added_entries.end());
+
+    auto payload_offset = sizeof(container_header) + entries.size() * sizeof(entry);
+    for (auto& container_entry: entries) {
+        payload_offset = (payload_offset + payload_alignment - 1) & ~(payload_alignment - 1);
+        container_entry.payload_offset = payload_offset;
+        payload_offset += container_entry.payload_size;
+    }
+
+    // Written aside then renamed, the payloads already handed out still point into the old mapping
+    std::ofstream f { pending_path(), std::ios::binary };
+
+    container_header header {
+        .magic = container_magic,
+        .version = container_version,
+        .entry_count = (uint32_t)entries.size(),
+        .padding = 0,
+    };
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(entry)));
+
+    static const char zeros[payload_alignment] = {};
+    for (size_t entry_index { 0U }; entry_index < entries.size(); entry_index++) {
+        const auto& container_entry = entries[entry_index];
+        f.write(zeros, (std::streamsize)(container_entry.payload_offset - (uint64_t)f.tellp()));
+
+        const auto* payload = entry_index < mapped_entries.size()
+            ? mapped_payloads[entry_index]
+            : added_payloads[entry_index - mapped_entries.size()].data();
+        f.write((const char*)payload, (std::streamsize)container_entry.payload_size);
+    }
+    f.close();
+
+    // A short write must not replace the good container, the added entries wait for the next save
+    std::error_code error;
+    if (!f.good()) {
+        std::cerr << "Could not write the texture cache " << pending_path().string() << std::endl;
+        std::filesystem::remove(pending_path(), error);
+        return;
+    }
+
+    // Windows refuses to replace a mapped file, open renames the pending container on the next start
+    std::filesystem::rename(pending_path(), path, error);
+
+    // The next save writes them again, from the copies kept alive with the cache
+    mapped_entries = entries;
+    for (auto& payload: added_payloads) {
+        mapped_payloads.push_back(payload.data());
+        saved_payloads.push_back(std::move(payload));
+    }
+
+    added_entries.clear();
+    added_payloads.clear();
+}
+
+std::filesystem::path texture_cache::pending_path() const {
+    auto pending = path;
+    pending += ".pending";
+    return pending;
+}
+
+uint64_t texture_cache::hash(const uint8_t* data, size_t size) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (size_t byte { 0U }; byte < size; byte++) {
+        value = (value ^ data[byte]) * 0x100000001b3ULL;
+    }
+    return value;
+}
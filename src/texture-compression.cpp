@@ -0,0 +1,395 @@
+#include "texture-compression.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// Interpolation weights of the 4 bits BC7 indices, out of 64
+static const uint32_t bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Blocks are little endian bit streams, fields start at the least significant bit
+class block_bits {
+public:
+    explicit block_bits(uint8_t* block) : bytes(block) {}
+
+    void write(uint32_t value, uint32_t count) {
+        for (uint32_t bit { 0U }; bit < count; bit++, position++) {
+            if (((value >> bit) & 1U) != 0U) {
+                bytes[position / 8U] |= (uint8_t)(1U << (position % 8U));
+            }
+        }
+    }
+
+    uint32_t read(uint32_t count) {
+        uint32_t value = 0U;
+        for (uint32_t bit { 0U }; bit < count; bit++, position++) {
+            value |= ((bytes[position / 8U] >> (position % 8U)) & 1U) << bit;
+        }
+        return value;
+    }
+
+private:
+    uint8_t*    bytes;
+    uint32_t    position = 0U;
+};
+
+// Texels of the block, the edges are repeated when the block goes past the image
+static void load_block(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y, uint8_t texels[16][4]) {
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        auto x = std::min(block_x * block_side + texel % block_side, width - 1U);
+        auto y = std::min(block_y * block_side + texel / block_side, height - 1U);
+        std::memcpy(texels[texel], rgba + ((size_t)y * width + x) * 4U, 4U);
+    }
+}
+
+static void store_block(const uint8_t texels[16][4], uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y, uint8_t* rgba) {
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        auto x = block_x * block_side + texel % block_side;
+        auto y = block_y * block_side + texel / block_side;
+        if (x < width && y < height) {
+            std::memcpy(rgba + ((size_t)y * width + x) * 4U, texels[texel], 4U);
+        }
+    }
+}
+
+static uint32_t blocks_count(uint32_t size) {
+    return (size + block_side - 1U) / block_side;
+}
+
+static uint8_t bc7_interpolate(uint32_t e0, uint32_t e1, uint32_t index) {
+    return (uint8_t)(((64U - bc7_weights[index]) * e0 + bc7_weights[index] * e1 + 32U) >> 6U);
+}
+
+// Mode 6: one pair of RGBA endpoints with 7 bits per channel and a p-bit each, 4 bits indices.
+// The endpoints are the extremes of the texels along their principal axis.
+static void encode_bc7_block(const uint8_t texels[16][4], uint8_t* block) {
+    float mean[4] = {};
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        for (uint32_t channel { 0U }; channel < 4U; channel++) {
+            mean[channel] += (float)texels[texel][channel] / 16.f;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        for (uint32_t row { 0U }; row < 4U; row++) {
+            for (uint32_t column { 0U }; column < 4U; column++) {
+                covariance[row][column] += ((float)texels[texel][row] - mean[row]) * ((float)texels[texel][column] - mean[column]);
+            }
+        }
+    }
+
+    // Power iterations converge to the axis of largest variance
+    float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+    for (uint32_t iteration { 0U }; iteration < 8U; iteration++) {
+        float next[4] = {};
+        for (uint32_t row { 0U }; row < 4U; row++) {
+            for (uint32_t column { 0U }; column < 4U; column++) {
+                next[row] += covariance[row][column] * axis[column];
+            }
+        }
+
+        auto length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            // Flat block, both endpoints end up on the mean
+            std::fill(axis, axis + 4, 0.f);
+            break;
+        }
+
+        for (uint32_t channel { 0U }; channel < 4U; channel++) {
+            axis[channel] = next[channel] / length;
+        }
+    }
+
+    float min_t = 0.f;
+    float max_t = 0.f;
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        float t = 0.f;
+        for (uint32_t channel { 0U }; channel < 4U; channel++) {
+            t += ((float)texels[texel][channel] - mean[channel]) * axis[channel];
+        }
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    // Quantized to 7 bits, with the p-bit that lands closest as the 8th bit
+    uint32_t endpoints[2][4];
+    uint32_t p_bits[2];
+    for (uint32_t endpoint { 0U }; endpoint < 2U; endpoint++) {
+        auto t = endpoint == 0U ? min_t : max_t;
+
+        float best_error = INFINITY;
+        for (uint32_t p_bit { 0U }; p_bit < 2U; p_bit++) {
+            uint32_t quantized[4];
+            float error = 0.f;
+            for (uint32_t channel { 0U }; channel < 4U; channel++) {
+                auto value = std::clamp(mean[channel] + axis[channel] * t, 0.f, 255.f);
+                quantized[channel] = (uint32_t)std::clamp(std::round((value - (float)p_bit) / 2.f), 0.f, 127.f);
+                auto difference = (float)((quantized[channel] << 1U) | p_bit) - value;
+                error += difference * difference;
+            }
+
+            if (error < best_error) {
+                best_error = error;
+                std::memcpy(endpoints[endpoint], quantized, sizeof(quantized));
+                p_bits[endpoint] = p_bit;
+            }
+        }
+    }
+
+    uint8_t palette[16][4];
+    for (uint32_t index { 0U }; index < 16U; index++) {
+        for (uint32_t channel { 0U }; channel < 4U; channel++) {
+            palette[index][channel] = bc7_interpolate((endpoints[0][channel] << 1U) | p_bits[0], (endpoints[1][channel] << 1U) | p_bits[1], index);
+        }
+    }
+
+    uint32_t indices[16];
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        uint32_t best_error = UINT32_MAX;
+        for (uint32_t index { 0U }; index < 16U; index++) {
+            uint32_t error = 0U;
+            for (uint32_t channel { 0U }; channel < 4U; channel++) {
+                auto difference = (int32_t)texels[texel][channel] - (int32_t)palette[index][channel];
+                error += (uint32_t)(difference * difference);
+            }
+
+            if (error < best_error) {
+                best_error = error;
+                indices[texel] = index;
+            }
+        }
+    }
+
+    // The first index is stored without its high bit, swapping the endpoints clears it
+    if ((indices[0] & 8U) != 0U) {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(p_bits[0], p_bits[1]);
+        for (auto& index: indices) {
+            index = 15U - index;
+        }
+    }
+
+    std::memset(block, 0, block_bytes);
+    block_bits bits { block };
+    bits.write(1U << 6U, 7U);
+    for (uint32_t channel { 0U }; channel < 4U; channel++) {
+        bits.write(endpoints[0][channel], 7U);
+        bits.write(endpoints[1][channel], 7U);
+    }
+    bits.write(p_bits[0], 1U);
+    bits.write(p_bits[1], 1U);
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        bits.write(indices[texel], texel == 0U ? 3U : 4U);
+    }
+}
+
+static void decode_bc7_block(const uint8_t* block, uint8_t texels[16][4]) {
+    block_bits bits { const_cast<uint8_t*>(block) };
+
+    uint32_t mode = 0U;
+    while (mode < 8U && bits.read(1U) == 0U) {
+        mode++;
+    }
+    assert(mode == 6U && "only the mode 6 blocks written by encode_bc7 are decoded");
+
+    uint32_t endpoints[2][4];
+    for (uint32_t channel { 0U }; channel < 4U; channel++) {
+        endpoints[0][channel] = bits.read(7U);
+        endpoints[1][channel] = bits.read(7U);
+    }
+    auto p_bit0 = bits.read(1U);
+    auto p_bit1 = bits.read(1U);
+
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        auto index = bits.read(texel == 0U ? 3U : 4U);
+        for (uint32_t channel { 0U }; channel < 4U; channel++) {
+            texels[texel][channel] = bc7_interpolate((endpoints[0][channel] << 1U) | p_bit0, (endpoints[1][channel] << 1U) | p_bit1, index);
+        }
+    }
+}
+
+// BC4 palette: 2 endpoints followed by 6 interpolated values when the first is the largest,
+// 4 interpolated values, 0 and 255 otherwise
+static void bc4_palette(uint32_t e0, uint32_t e1, uint8_t palette[8]) {
+    palette[0] = (uint8_t)e0;
+    palette[1] = (uint8_t)e1;
+    if (e0 > e1) {
+        for (uint32_t step { 1U }; step < 7U; step++) {
+            palette[step + 1U] = (uint8_t)(((7U - step) * e0 + step * e1 + 3U) / 7U);
+        }
+    } else {
+        for (uint32_t step { 1U }; step < 5U; step++) {
+            palette[step + 1U] = (uint8_t)(((5U - step) * e0 + step * e1 + 2U) / 5U);
+        }
+        palette[6] = 0U;
+        palette[7] = 255U;
+    }
+}
+
+static void encode_bc4_block(const uint8_t texels[16][4], uint32_t channel, uint8_t* block) {
+    uint32_t lowest = 255U;
+    uint32_t highest = 0U;
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        lowest = std::min(lowest, (uint32_t)texels[texel][channel]);
+        highest = std::max(highest, (uint32_t)texels[texel][channel]);
+    }
+
+    uint8_t palette[8];
+    bc4_palette(highest, lowest, palette);
+
+    std::memset(block, 0, block_bytes / 2U);
+    block_bits bits { block };
+    bits.write(highest, 8U);
+    bits.write(lowest, 8U);
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        uint32_t best_index = 0U;
+        uint32_t best_error = UINT32_MAX;
+        for (uint32_t index { 0U }; index < 8U; index++) {
+            auto error = (uint32_t)std::abs((int32_t)texels[texel][channel] - (int32_t)palette[index]);
+            if (error < best_error) {
+                best_error = error;
+                best_index = index;
+            }
+        }
+        bits.write(best_index, 3U);
+    }
+}
+
+static void decode_bc4_block(const uint8_t* block, uint32_t channel, uint8_t texels[16][4]) {
+    block_bits bits { const_cast<uint8_t*>(block) };
+
+    auto e0 = bits.read(8U);
+    auto e1 = bits.read(8U);
+    uint8_t palette[8];
+    bc4_palette(e0, e1, palette);
+
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        texels[texel][channel] = palette[bits.read(3U)];
+    }
+}
+
+size_t block_level_size(uint32_t width, uint32_t height) {
+    return (size_t)blocks_count(width) * blocks_count(height) * block_bytes;
+}
+
+void encode_bc7(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks) {
+    uint8_t texels[16][4];
+    for (uint32_t block_y { 0U }; block_y < blocks_count(height); block_y++) {
+        for (uint32_t block_x { 0U }; block_x < blocks_count(width); block_x++) {
+            load_block(rgba, width, height, block_x, block_y, texels);
+            encode_bc7_block(texels, blocks);
+            blocks += block_bytes;
+        }
+    }
+}
+
+void encode_bc5(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks) {
+    uint8_t texels[16][4];
+    for (uint32_t block_y { 0U }; block_y < blocks_count(height); block_y++) {
+        for (uint32_t block_x { 0U }; block_x < blocks_count(width); block_x++) {
+            load_block(rgba, width, height, block_x, block_y, texels);
+            encode_bc4_block(texels, 0U, blocks);
+            encode_bc4_block(texels, 1U, blocks + block_bytes / 2U);
+            blocks += block_bytes;
+        }
+    }
+}
+
+void decode_bc7(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba) {
+    uint8_t texels[16][4];
+    for (uint32_t block_y { 0U }; block_y < blocks_count(height); block_y++) {
+        for (uint32_t block_x { 0U }; block_x < blocks_count(width); block_x++) {
+            decode_bc7_block(blocks, texels);
+            store_block(texels, width, height, block_x, block_y, rgba);
+            blocks += block_bytes;
+        }
+    }
+}
+
+void decode_bc5(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba) {
+    uint8_t texels[16][4];
+    for (auto& texel: texels) {
+        texel[2] = 0U;
+        texel[3] = 255U;
+    }
+
+    for (uint32_t block_y { 0U }; block_y < blocks_count(height); block_y++) {
+        for (uint32_t block_x { 0U }; block_x < blocks_count(width); block_x++) {
+            decode_bc4_block(blocks, 0U, texels);
+            decode_bc4_block(blocks + block_bytes / 2U, 1U, texels);
+            store_block(texels, width, height, block_x, block_y, rgba);
+            blocks += block_bytes;
+        }
+    }
+}
+
+// Same 2x2 box filter as the vkCmdBlitImage chain of the GPU generated mips
+static std::vector<uint8_t> downsample(const uint8_t* level, uint32_t width, uint32_t height) {
+    auto next_width = std::max(width / 2U, 1U);
+    auto next_height = std::max(height / 2U, 1U);
+    std::vector<uint8_t> next((size_t)next_width * next_height * 4U);
+    for (uint32_t y { 0U }; y < next_height; y++) {
+        for (uint32_t x { 0U }; x < next_width; x++) {
+            for (uint32_t channel { 0U }; channel < 4U; channel++) {
+                uint32_t sum = 0U;
+                for (uint32_t tap { 0U }; tap < 4U; tap++) {
+                    auto parent_x = std::min(x * 2U + (tap & 1U), width - 1U);
+                    auto parent_y = std::min(y * 2U + (tap >> 1U), height - 1U);
+                    sum += level[((size_t)parent_y * width + parent_x) * 4U + channel];
+                }
+                next[((size_t)y * next_width + x) * 4U + channel] = (uint8_t)((sum + 2U) / 4U);
+            }
+        }
+    }
+
+    return next;
+}
+
+encoded_image encode_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height, BLOCK_FORMAT format) {
+    encoded_image image {
+        .format = format,
+        .width = width,
+        .height = height,
+        .levels = 0U,
+        .blocks = {},
+    };
+
+    std::vector<uint8_t> level { rgba, rgba + (size_t)width * height * 4U };
+    while (true) {
+        auto offset = image.blocks.size();
+        image.blocks.resize(offset + block_level_size(width, height));
+        if (format == BLOCK_FORMAT::BC7) {
+            encode_bc7(level.data(), width, height, image.blocks.data() + offset);
+        } else {
+            encode_bc5(level.data(), width, height, image.blocks.data() + offset);
+        }
+        image.levels++;
+
+        if (width == 1U && height == 1U) {
+            break;
+        }
+
+        level = downsample(level.data(), width, height);
+        width = std::max(width / 2U, 1U);
+        height = std::max(height / 2U, 1U);
+    }
+
+    return image;
+}
+
+std::vector<uint8_t> rgba_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height) {
+    std::vector<uint8_t> chain { rgba, rgba + (size_t)width * height * 4U };
+
+    size_t level_offset = 0U;
+    while (width > 1U || height > 1U) {
+        auto next = downsample(chain.data() + level_offset, width, height);
+        level_offset = chain.size();
+        chain.insert(chain.end(), next.begin(), next.end());
+        width = std::max(width / 2U, 1U);
+        height = std::max(height / 2U, 1U);
+    }
+
+    return chain;
+}
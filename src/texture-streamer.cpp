@@ -0,0 +1,197 @@
+#include "texture-streamer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "vk-renderer.hpp"
+
+texture_streamer::texture_streamer()
+    : slots(1)
+{
+}
+
+Texture* texture_streamer::create_texture(size_t width, size_t height, VkFormat format, Sampler* sampler, void* data, bool owns_data) {
+    assert(table_buffer == nullptr && "textures are created before the first update");
+
+    auto mip_levels = Texture::full_mip_levels(width, height);
+
+    // Coarsest level still over coarse_size, the ones below it stay resident
+    uint32_t coarse_level = 0;
+    while (coarse_level + 1 < mip_levels && std::max(Texture::level_extent(width, coarse_level), Texture::level_extent(height, coarse_level)) > coarse_size) {
+        coarse_level++;
+    }
+
+    auto* texture = new Texture(width, height, 1, format, sampler, mip_levels, coarse_level);
+    texture->data_levels = mip_levels;
+    texture->async_upload = true;
+    texture->update(data, owns_data);
+
+    slot_indices[texture] = (uint32_t)slots.size();
+    slots.push_back({
+        .texture = texture,
+        .live_image = texture->device_image,
+        .live_first_level = coarse_level,
+        .pending = false,
+        .coarse_level = coarse_level,
+        .requested_level = coarse_level,
+        .last_used_frame = 0,
+    });
+
+    return texture;
+}
+
+uint32_t texture_streamer::slot(const Texture* texture) const {
+    auto found = slot_indices.find(texture);
+    return found != slot_indices.end() ? found->second : 0U;
+}
+
+void texture_streamer::create_buffers() {
+    table_buffer = vkrenderer::create_buffer(slots.size() * sizeof(streamed_texture) * vkrenderer::virtual_frames_count);
+    feedback_buffer = vkrenderer::create_buffer(slots.size() * sizeof(uint32_t) * vkrenderer::virtual_frames_count);
+
+    auto* feedback = (uint32_t*)vkrenderer::api.get_buffer(feedback_buffer->device_buffer).device_ptr;
+    std::fill(feedback, feedback + slots.size() * vkrenderer::virtual_frames_count, no_request);
+}
+
+void texture_streamer::update(uint32_t frame_index, uint64_t frame_number) {
+    if (table_buffer == nullptr) {
+        create_buffers();
+    }
+
+    // Written by the frame that last used this slice, begin_frame waited for it
+    auto* feedback = (uint32_t*)vkrenderer::api.get_buffer(feedback_buffer->device_buffer).device_ptr + slots.size() * frame_index;
+    for (uint32_t slot_index { 1U }; slot_index < slots.size(); slot_index++) {
+        auto& state = slots[slot_index];
+
+        if (feedback[slot_index] != no_request) {
+            state.requested_level = std::min(feedback[slot_index], state.coarse_level);
+            state.last_used_frame = frame_number;
+        }
+        feedback[slot_index] = no_request;
+
+        // Acquired by the command buffer submitted before this frame's passes, the table can switch
+        if (state.pending && !state.texture->upload_pending) {
+            retired_images.push_back({ state.live_image, frame_number });
+            state.live_image = state.texture->device_image;
+            state.live_first_level = state.texture->first_level;
+            state.pending = false;
+        }
+    }
+
+    // The frames in flight when an image was replaced are done with it
+    std::erase_if(retired_images, [&](const retired_image& retired) {
+        if (retired.frame_number + vkrenderer::virtual_frames_count > frame_number) {
+            return false;
+        }
+        vkrenderer::api.destroy_image(retired.image);
+        return true;
+    });
+
+    // Most recently used textures first
+    std::vector<uint32_t> order;
+    for (uint32_t slot_index { 1U }; slot_index < slots.size(); slot_index++) {
+        const auto& state = slots[slot_index];
+        if (!state.pending && wanted_level(state, frame_number) < state.live_first_level) {
+            order.push_back(slot_index);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return slots[lhs].last_used_frame > slots[rhs].last_used_frame;
+    });
+
+    queued_bytes = 0;
+    for (auto slot_index: order) {
+        auto& state = slots[slot_index];
+        auto first_level = wanted_level(state, frame_number);
+        auto bytes = image_bytes(state, first_level);
+        if (queued_bytes + bytes > upload_bytes_per_frame && queued_bytes > 0) {
+            break;
+        }
+
+        if (budget > 0) {
+            while (resident_bytes() + bytes > budget && evict(state, frame_number)) {}
+            if (resident_bytes() + bytes > budget) {
+                continue;
+            }
+        }
+
+        restream(state, first_level);
+    }
+
+    auto* table = (streamed_texture*)vkrenderer::api.get_buffer(table_buffer->device_buffer).device_ptr + slots.size() * frame_index;
+    table[0] = {};
+    for (uint32_t slot_index { 1U }; slot_index < slots.size(); slot_index++) {
+        const auto& state = slots[slot_index];
+        table[slot_index] = {
+            .image_index = vkrenderer::api.get_image(state.live_image).bindless_sampled_index,
+            .first_level = state.live_first_level,
+            .lod_offset = 0.5f * std::log2((float)(state.texture->width * state.texture->height)),
+            .padding = 0,
+        };
+    }
+}
+
+uint64_t texture_streamer::table_address(uint32_t frame_index) const {
+    return vkrenderer::api.get_buffer(table_buffer->device_buffer).device_address + slots.size() * sizeof(streamed_texture) * frame_index;
+}
+
+uint64_t texture_streamer::feedback_address(uint32_t frame_index) const {
+    return vkrenderer::api.get_buffer(feedback_buffer->device_buffer).device_address + slots.size() * sizeof(uint32_t) * frame_index;
+}
+
+size_t texture_streamer::resident_bytes() const {
+    size_t bytes = 0;
+    for (uint32_t slot_index { 1U }; slot_index < slots.size(); slot_index++) {
+        const auto& state = slots[slot_index];
+        // Pending images count in place of the ones they replace
+        bytes += image_bytes(state, state.texture->first_level);
+    }
+    return bytes;
+}
+
+uint32_t texture_streamer::wanted_level(const slot_state& state, uint64_t frame_number) const {
+    if (state.last_used_frame + idle_frames < frame_number) {
+        return state.coarse_level;
+    }
+    return state.requested_level;
+}
+
+size_t texture_streamer::image_bytes(const slot_state& state, uint32_t first_level) const {
+    const auto& image = vkrenderer::api.get_image(state.texture->device_image);
+    return state.texture->data_offset(image.format, state.texture->mip_levels) - state.texture->data_offset(image.format, first_level);
+}
+
+void texture_streamer::restream(slot_state& state, uint32_t first_level) {
+    auto* texture = state.texture;
+    auto format = vkrenderer::api.get_image(texture->device_image).format;
+
+    texture->first_level = first_level;
+    texture->device_image = texture->create_resident_image(format);
+    vkrenderer::queue_image_update(texture);
+
+    state.pending = true;
+    queued_bytes += image_bytes(state, first_level);
+}
+
+bool texture_streamer::evict(const slot_state& keep, uint64_t frame_number) {
+    slot_state* victim = nullptr;
+    for (uint32_t slot_index { 1U }; slot_index < slots.size(); slot_index++) {
+        auto& state = slots[slot_index];
+        if (&state == &keep || state.pending || wanted_level(state, frame_number) <= state.live_first_level) {
+            continue;
+        }
+        if (victim == nullptr || state.last_used_frame < victim->last_used_frame) {
+            victim = &state;
+        }
+    }
+
+    if (victim == nullptr) {
+        return false;
+    }
+
+    // The smaller image replaces the current one once uploaded
+    restream(*victim, wanted_level(*victim, frame_number));
+    return true;
+}
@@ -0,0 +1,215 @@
+#include "upload-engine.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "vk-renderer.hpp"
+
+#ifdef _DEBUG
+#define VKRESULT(result) assert(result == VK_SUCCESS);
+#else
+#define VKRESULT(result) result;
+#endif
+
+// Data holding level 0 only gets its other levels blitted on the graphics queue
+static bool generates_mips(const Texture* texture) {
+    return texture->data_levels == 1 && vkrenderer::api.get_image(texture->device_image).subresource_range.levelCount > 1;
+}
+
+void upload_engine::init() {
+    command_pool = vkrenderer::api.create_command_pool(vkrenderer::context.transfer_queue.index);
+    timeline_semaphore = vkrenderer::api.create_timeline_semaphore(0);
+
+    for (auto& current_batch: batches) {
+        vkrenderer::api.allocate_command_buffers(command_pool, &current_batch.command_buffer, 1);
+        current_batch.staging_buffer = new RingBuffer(batch_size);
+    }
+}
+
+void upload_engine::destroy() {
+    vkrenderer::api.wait_semaphore(timeline_semaphore, submitted);
+
+    for (auto& current_batch: batches) {
+        vkFreeCommandBuffers(vkrenderer::context.device, command_pool, 1, &current_batch.command_buffer);
+        vkrenderer::api.destroy_buffer(current_batch.staging_buffer->device_buffer);
+        delete current_batch.staging_buffer;
+    }
+
+    vkDestroyCommandPool(vkrenderer::context.device, command_pool, nullptr);
+    vkrenderer::api.destroy_semaphore(timeline_semaphore);
+}
+
+void upload_engine::queue_image(Texture* texture) {
+    assert(vkrenderer::api.get_image(texture->device_image).previous_layout == VK_IMAGE_LAYOUT_UNDEFINED && "only new images are uploaded on the transfer queue");
+
+    texture->upload_pending = true;
+    image_queue.push_back({ texture });
+}
+
+void upload_engine::queue_buffer(const Buffer* buffer, const void* data, size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    const auto* bytes = (const uint8_t*)data;
+    buffer_queue.push_back({ buffer, std::vector<uint8_t>(bytes, bytes + size), offset, 0 });
+}
+
+void upload_engine::update(VkCommandBuffer command_buffer) {
+    auto completed = vkrenderer::api.semaphore_value(timeline_semaphore);
+    for (auto& current_batch: batches) {
+        if (current_batch.value != 0 && current_batch.value <= completed) {
+            acquire(command_buffer, current_batch);
+        }
+    }
+
+    for (auto& current_batch: batches) {
+        if (image_queue.empty() && buffer_queue.empty()) {
+            break;
+        }
+        if (current_batch.value == 0) {
+            fill(current_batch);
+        }
+    }
+}
+
+void upload_engine::wait() {
+    uint64_t oldest = 0;
+    for (const auto& current_batch: batches) {
+        if (current_batch.value != 0 && (oldest == 0 || current_batch.value < oldest)) {
+            oldest = current_batch.value;
+        }
+    }
+
+    if (oldest != 0) {
+        vkrenderer::api.wait_semaphore(timeline_semaphore, oldest);
+    }
+}
+
+bool upload_engine::idle() const {
+    if (!image_queue.empty() || !buffer_queue.empty()) {
+        return false;
+    }
+
+    return std::all_of(std::begin(batches), std::end(batches), [](const batch& current_batch) {
+        return current_batch.value == 0;
+    });
+}
+
+void upload_engine::fill(batch& current_batch) {
+    const auto& context = vkrenderer::context;
+    auto* staging_buffer = current_batch.staging_buffer;
+    staging_buffer->reset();
+
+    auto command_buffer = current_batch.command_buffer;
+    vkrenderer::api.start_record(command_buffer);
+
+    // Buffers first, in the order they were written. Chunks keep whole blocks for the texture copies after them
+    while (!buffer_queue.empty()) {
+        auto& upload = buffer_queue.front();
+        auto chunk_size = std::min(upload.data.size() - upload.uploaded, staging_buffer->available() & ~(size_t)15);
+        if (chunk_size == 0) {
+            break;
+        }
+
+        auto offset = staging_buffer->alloc((chunk_size + 15) & ~(size_t)15);
+        auto dst_offset = upload.offset + upload.uploaded;
+        staging_buffer->write(upload.data.data() + upload.uploaded, offset, chunk_size);
+        vkrenderer::api.copy_buffer_range(command_buffer, staging_buffer->device_buffer, upload.buffer->device_buffer, offset, dst_offset, chunk_size);
+        vkrenderer::api.release_buffer(command_buffer, upload.buffer->device_buffer, dst_offset, chunk_size, context.transfer_queue.index, context.graphics_queue.index);
+        current_batch.buffer_ranges.push_back({ upload.buffer->device_buffer, dst_offset, chunk_size });
+
+        upload.uploaded += chunk_size;
+        if (upload.uploaded < upload.data.size()) {
+            break;
+        }
+        buffer_queue.pop_front();
+    }
+
+    while (!image_queue.empty() && copy_rows(current_batch, image_queue.front())) {
+        image_queue.pop_front();
+    }
+
+    vkrenderer::api.end_record(command_buffer);
+
+    current_batch.value = ++submitted;
+    VKRESULT(vkrenderer::api.submit_transfer(command_buffer, timeline_semaphore, current_batch.value))
+}
+
+bool upload_engine::copy_rows(batch& current_batch, image_upload& upload) {
+    const auto& context = vkrenderer::context;
+    auto* texture = upload.texture;
+    auto* staging_buffer = current_batch.staging_buffer;
+    auto command_buffer = current_batch.command_buffer;
+    const auto& image = vkrenderer::api.get_image(texture->device_image);
+
+    auto copied_levels = generates_mips(texture) ? 1U : image.subresource_range.levelCount;
+    // Compressed levels are copied in whole block rows
+    auto unit_rows = Texture::is_block_compressed(image.format) ? 4U : 1U;
+
+    while (upload.level < copied_levels) {
+        // Image level 0 is the level first_level of the chain held by data
+        auto chain_level = texture->first_level + upload.level;
+        auto level_width = Texture::level_extent(texture->width, chain_level);
+        auto level_height = (uint32_t)Texture::level_extent(texture->height, chain_level);
+
+        auto unit_size = Texture::level_size(image.format, level_width, unit_rows);
+        auto units = std::min<size_t>((level_height - upload.row + unit_rows - 1) / unit_rows, (staging_buffer->available() & ~(size_t)15) / unit_size);
+        if (units == 0) {
+            return false;
+        }
+
+        if (upload.level == 0 && upload.layer == 0 && upload.row == 0) {
+            vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, texture->device_image);
+        }
+
+        // Each level holds its layers one after the other
+        auto bytes = units * unit_size;
+        auto offset = staging_buffer->alloc((bytes + 15) & ~(size_t)15);
+        auto data_offset = texture->data_offset(image.format, chain_level) + Texture::level_size(image.format, level_width, level_height) * upload.layer + upload.row / unit_rows * unit_size;
+        staging_buffer->write((uint8_t*)texture->data + data_offset, offset, bytes);
+
+        auto row_count = std::min((uint32_t)units * unit_rows, level_height - upload.row);
+        vkrenderer::api.copy_buffer_rows(command_buffer, staging_buffer->device_buffer, texture->device_image, offset, upload.level, upload.layer, upload.row, row_count);
+
+        upload.row += row_count;
+        if (upload.row == level_height) {
+            upload.row = 0;
+            if (++upload.layer == texture->layers) {
+                upload.layer = 0;
+                upload.level++;
+            }
+        }
+    }
+
+    auto layout = generates_mips(texture) ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkrenderer::api.image_barrier(command_buffer, layout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, texture->device_image, context.transfer_queue.index, context.graphics_queue.index);
+    current_batch.textures.push_back(texture);
+
+    return true;
+}
+
+void upload_engine::acquire(VkCommandBuffer command_buffer, batch& done_batch) {
+    const auto& context = vkrenderer::context;
+
+    for (const auto& range: done_batch.buffer_ranges) {
+        vkrenderer::api.acquire_buffer(command_buffer, range.buffer, range.offset, range.size, context.transfer_queue.index, context.graphics_queue.index, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    for (auto* texture: done_batch.textures) {
+        if (generates_mips(texture)) {
+            vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, texture->device_image, context.transfer_queue.index, context.graphics_queue.index);
+            vkrenderer::api.generate_mipmaps(command_buffer, texture->device_image);
+            vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, texture->device_image);
+        } else {
+            vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, texture->device_image, context.transfer_queue.index, context.graphics_queue.index);
+        }
+        texture->upload_pending = false;
+    }
+
+    acquired = std::max(acquired, done_batch.value);
+
+    done_batch.value = 0;
+    done_batch.textures.clear();
+    done_batch.buffer_ranges.clear();
+}
@@ -1,5 +1,6 @@
 #include "vk-api.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <cassert>
 
@@ -20,29 +21,38 @@
 
 vkapi::vkapi(vkcontext& context)
     : context(context) {
+    VkPhysicalDeviceProperties physical_device_properties = {};
+    vkGetPhysicalDeviceProperties(context.physical_device, &physical_device_properties);
+    timestamp_period = physical_device_properties.limits.timestampPeriod;
+
+    // Bindless tables as large as the update after bind limits allow, shared by every stage
+    const auto& indexing_properties = context.descriptor_indexing_properties;
+    auto per_binding_resources = indexing_properties.maxPerStageUpdateAfterBindResources / 3U;
+    bindless_descriptor.init(
+        std::min({ indexing_properties.maxDescriptorSetUpdateAfterBindSamplers, indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers, per_binding_resources, global_descriptor::max_samplers }),
+        std::min({ indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages, indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages, per_binding_resources, global_descriptor::max_images }),
+        std::min({ indexing_properties.maxDescriptorSetUpdateAfterBindStorageImages, indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageImages, per_binding_resources, global_descriptor::max_images })
+    );
+
     VkDescriptorPoolSize descriptor_pools_sizes[] = {
-        {
-            .type                               = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount                    = (uint32_t)global_descriptor::pool_size,
-        },
         {
             .type                               = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .descriptorCount                    = (uint32_t)global_descriptor::pool_size,
+            .descriptorCount                    = bindless_descriptor.capacities[2],
         },
         {
             .type                               = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            .descriptorCount                    = (uint32_t)global_descriptor::pool_size,
+            .descriptorCount                    = bindless_descriptor.capacities[1],
         },
         {
             .type                               = VK_DESCRIPTOR_TYPE_SAMPLER,
-            .descriptorCount                    = (uint32_t)global_descriptor::pool_size,
+            .descriptorCount                    = bindless_descriptor.capacities[0],
         }
     };
 
     VkDescriptorPoolCreateInfo descriptor_pool_create_info  = {};
     descriptor_pool_create_info.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     descriptor_pool_create_info.pNext                       = nullptr;
-    descriptor_pool_create_info.flags                       = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    descriptor_pool_create_info.flags                       = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
     descriptor_pool_create_info.maxSets                     = 0xff;
     descriptor_pool_create_info.poolSizeCount               = sizeof(descriptor_pools_sizes) / sizeof(descriptor_pools_sizes[0]);
     descriptor_pool_create_info.pPoolSizes                  = descriptor_pools_sizes;
@@ -54,27 +64,27 @@ vkapi::vkapi(vkcontext& context)
             {
                 .binding = 0,
                 .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
-                .descriptorCount = global_descriptor::pool_size,
+                .descriptorCount = bindless_descriptor.capacities[0],
                 .stageFlags = VK_SHADER_STAGE_ALL,
             },
             {
                 .binding = 1,
                 .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-                .descriptorCount = global_descriptor::pool_size,
+                .descriptorCount = bindless_descriptor.capacities[1],
                 .stageFlags = VK_SHADER_STAGE_ALL,
             },
             {
                 .binding = 2,
                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                .descriptorCount = global_descriptor::pool_size,
+                .descriptorCount = bindless_descriptor.capacities[2],
                 .stageFlags = VK_SHADER_STAGE_ALL,
             },
     };
 
     VkDescriptorBindingFlags flags[] = {
-        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
-        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
-        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
     };
     VkDescriptorSetLayoutBindingFlagsCreateInfo descriptor_set_layout_binding_flags = {};
     descriptor_set_layout_binding_flags.sType           = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
@@ -85,7 +95,7 @@ vkapi::vkapi(vkcontext& context)
     VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
     descriptor_set_layout_create_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptor_set_layout_create_info.pNext         = &descriptor_set_layout_binding_flags;
-    descriptor_set_layout_create_info.flags         = 0;
+    descriptor_set_layout_create_info.flags         = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
     descriptor_set_layout_create_info.bindingCount  = sizeof(bindless_layout_bindings) / sizeof(VkDescriptorSetLayoutBinding);
     descriptor_set_layout_create_info.pBindings     = bindless_layout_bindings;
 
@@ -167,6 +177,15 @@ handle vkapi::create_buffer(size_t data_size, VkBufferUsageFlags buffer_usage, u
     buffer_info.sType               = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_info.size                = data_size;
     buffer_info.usage               = buffer_usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    buffer_info.sharingMode         = VK_SHARING_MODE_EXCLUSIVE;
+    // Host visible storage holds per frame data the post passes read on the compute queue too,
+    // the staging buffers of the transfer queue stay exclusive
+    uint32_t queue_families[] = { context.graphics_queue.index, context.compute_queue.index };
+    if (mem_usage == VMA_MEMORY_USAGE_CPU_TO_GPU && queue_families[0] != queue_families[1]) {
+        buffer_info.sharingMode             = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount   = 2;
+        buffer_info.pQueueFamilyIndices     = queue_families;
+    }
 
     VmaAllocationCreateInfo alloc_create_info = {};
     alloc_create_info.usage = (VmaMemoryUsage)mem_usage;
@@ -200,15 +219,24 @@ void vkapi::copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t
     vkCmdCopyBuffer(cmd_buf, buffers[src]->handle, buffers[dst]->handle, 1, &buffer_copy);
 }
 
+void vkapi::copy_buffer_range(VkCommandBuffer cmd_buf, handle src, handle dst, size_t src_offset, size_t dst_offset, size_t size) {
+    VkBufferCopy buffer_copy = {};
+    buffer_copy.srcOffset = src_offset;
+    buffer_copy.dstOffset = dst_offset;
+    buffer_copy.size = size;
+
+    vkCmdCopyBuffer(cmd_buf, buffers[src]->handle, buffers[dst]->handle, 1, &buffer_copy);
+}
+
 // TODO: Change handle type, here we don't know what type of ressources we are working with
-void vkapi::copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t size, size_t buffer_offset) {
+void vkapi::copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t size, size_t buffer_offset, uint32_t mip_level) {
     auto& dst_image = images[dst];
 
     VkImageSubresourceLayers image_subresource_layers   = {};
     image_subresource_layers.aspectMask                 = dst_image->subresource_range.aspectMask;
-    image_subresource_layers.mipLevel                   = 0;
+    image_subresource_layers.mipLevel                   = mip_level;
     image_subresource_layers.baseArrayLayer             = 0;
-    image_subresource_layers.layerCount                 = 1;
+    image_subresource_layers.layerCount                 = dst_image->subresource_range.layerCount;
 
     VkBufferImageCopy buffer_to_image_copy  = {};
     buffer_to_image_copy.bufferOffset       = buffer_offset;
@@ -216,11 +244,61 @@ void vkapi::copy_buffer(VkCommandBuffer cmd_buf, handle src, handle dst, size_t
     buffer_to_image_copy.bufferImageHeight  = 0;
     buffer_to_image_copy.imageSubresource   = image_subresource_layers;
     buffer_to_image_copy.imageOffset        = { 0, 0, 0 };
-    buffer_to_image_copy.imageExtent        = dst_image->size;
+    buffer_to_image_copy.imageExtent        = {
+        std::max(dst_image->size.width >> mip_level, 1U),
+        std::max(dst_image->size.height >> mip_level, 1U),
+        dst_image->size.depth,
+    };
+
+    vkCmdCopyBufferToImage(cmd_buf, buffers[src]->handle, dst_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_to_image_copy);
+}
+
+void vkapi::copy_buffer_rows(VkCommandBuffer cmd_buf, handle src, handle dst, size_t buffer_offset, uint32_t mip_level, uint32_t layer, uint32_t first_row, uint32_t row_count) {
+    auto& dst_image = images[dst];
+
+    VkBufferImageCopy buffer_to_image_copy  = {};
+    buffer_to_image_copy.bufferOffset       = buffer_offset;
+    buffer_to_image_copy.bufferRowLength    = 0;
+    buffer_to_image_copy.bufferImageHeight  = 0;
+    buffer_to_image_copy.imageSubresource   = {
+        .aspectMask     = dst_image->subresource_range.aspectMask,
+        .mipLevel       = mip_level,
+        .baseArrayLayer = layer,
+        .layerCount     = 1,
+    };
+    buffer_to_image_copy.imageOffset        = { 0, (int32_t)first_row, 0 };
+    buffer_to_image_copy.imageExtent        = {
+        std::max(dst_image->size.width >> mip_level, 1U),
+        row_count,
+        dst_image->size.depth,
+    };
 
     vkCmdCopyBufferToImage(cmd_buf, buffers[src]->handle, dst_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_to_image_copy);
 }
 
+void vkapi::copy_image(VkCommandBuffer command_buffer, handle src, handle dst) {
+    auto *src_image = images[src];
+    auto *dst_image = images[dst];
+
+    assert(src_image->size.width == dst_image->size.width && src_image->size.height == dst_image->size.height);
+
+    VkImageSubresourceLayers subresource_layers = {
+        .aspectMask     = src_image->subresource_range.aspectMask,
+        .mipLevel       = 0,
+        .baseArrayLayer = 0,
+        .layerCount     = src_image->subresource_range.layerCount,
+    };
+
+    VkImageCopy image_copy  = {};
+    image_copy.srcSubresource = subresource_layers;
+    image_copy.srcOffset    = { 0, 0, 0 };
+    image_copy.dstSubresource = subresource_layers;
+    image_copy.dstOffset    = { 0, 0, 0 };
+    image_copy.extent       = src_image->size;
+
+    vkCmdCopyImage(command_buffer, src_image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+}
+
 void vkapi::destroy_buffer(handle buffer) {
     vmaDestroyBuffer(context.allocator, buffers[buffer]->handle, buffers[buffer]->alloc);
 
@@ -229,16 +307,16 @@ void vkapi::destroy_buffer(handle buffer) {
 }
 
 
-handle vkapi::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usages) {
+handle vkapi::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usages, VkImageViewType view_type, uint32_t layer_count, uint32_t mip_levels) {
     auto* image = new struct image();
 
     image->size = size;
 
     image->subresource_range.aspectMask      = VK_IMAGE_ASPECT_COLOR_BIT;
     image->subresource_range.baseMipLevel    = 0;
-    image->subresource_range.levelCount      = 1;
+    image->subresource_range.levelCount      = mip_levels;
     image->subresource_range.baseArrayLayer  = 0;
-    image->subresource_range.layerCount      = 1;
+    image->subresource_range.layerCount      = layer_count;
 
     VkImageCreateInfo img_create_info       = {};
     img_create_info.sType                   = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -247,8 +325,8 @@ handle vkapi::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags u
     img_create_info.imageType               = VK_IMAGE_TYPE_2D;
     img_create_info.format                  = format;
     img_create_info.extent                  = size;
-    img_create_info.mipLevels               = 1;
-    img_create_info.arrayLayers             = 1;
+    img_create_info.mipLevels               = mip_levels;
+    img_create_info.arrayLayers             = layer_count;
     img_create_info.samples                 = VK_SAMPLE_COUNT_1_BIT;
     img_create_info.tiling                  = VK_IMAGE_TILING_OPTIMAL;
     img_create_info.usage                   = usages;
@@ -269,7 +347,7 @@ handle vkapi::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags u
     image_view_create_info.pNext                    = nullptr;
     image_view_create_info.flags                    = 0;
     image_view_create_info.image                    = image->handle;
-    image_view_create_info.viewType                 = VK_IMAGE_VIEW_TYPE_2D;
+    image_view_create_info.viewType                 = view_type;
     image_view_create_info.format                   = format;
     image_view_create_info.components               = {
         VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -304,6 +382,11 @@ handle vkapi::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags u
 void vkapi::destroy_image(handle image) {
     auto* current_image = images[image];
 
+    // Textures destroy their image before the api destroys what is left
+    if (current_image->handle == VK_NULL_HANDLE) {
+        return;
+    }
+
     if (current_image->bindless_storage_index != 0U) {
         bindless_descriptor.free(current_image->bindless_storage_index, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
     }
@@ -315,6 +398,10 @@ void vkapi::destroy_image(handle image) {
     vmaDestroyImage(context.allocator, current_image->handle, current_image->alloc);
     vkDestroyImageView(context.device, current_image->view, nullptr);
 
+    current_image->handle = VK_NULL_HANDLE;
+    current_image->bindless_storage_index = 0U;
+    current_image->bindless_sampled_index = 0U;
+
     // TODO: Free once using freelist
     // images.erase(image.handle);
 
@@ -370,6 +457,44 @@ void vkapi::destroy_fences(VkFence fences[], size_t fences_count) const {
 }
 
 
+VkQueryPool vkapi::create_timestamp_pool(uint32_t query_count) const {
+    VkQueryPool query_pool;
+    VkQueryPoolCreateInfo create_info   = {};
+    create_info.sType                   = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    create_info.pNext                   = nullptr;
+    create_info.flags                   = 0;
+    create_info.queryType               = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount              = query_count;
+
+    VKRESULT(vkCreateQueryPool(context.device, &create_info, nullptr, &query_pool))
+
+    return query_pool;
+}
+
+void vkapi::destroy_query_pool(VkQueryPool query_pool) const {
+    vkDestroyQueryPool(context.device, query_pool, nullptr);
+}
+
+void vkapi::reset_queries(VkCommandBuffer command_buffer, VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) const {
+    vkCmdResetQueryPool(command_buffer, query_pool, first_query, query_count);
+}
+
+void vkapi::write_timestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage, VkQueryPool query_pool, uint32_t query) const {
+    vkCmdWriteTimestamp(command_buffer, stage, query_pool, query);
+}
+
+bool vkapi::get_elapsed_time(VkQueryPool query_pool, uint32_t first_query, float& elapsed_ms) const {
+    uint64_t timestamps[2];
+    auto result = vkGetQueryPoolResults(context.device, query_pool, first_query, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    elapsed_ms = (float)(timestamps[1] - timestamps[0]) * timestamp_period / 1e6f;
+    return true;
+}
+
+
 VkSemaphore vkapi::create_semaphore() const {
     VkSemaphore semaphore;
     VkSemaphoreCreateInfo create_info   = {};
@@ -402,24 +527,61 @@ void vkapi::destroy_semaphores(VkSemaphore semaphores[], size_t semaphores_count
     }
 }
 
+VkSemaphore vkapi::create_timeline_semaphore(uint64_t initial_value) const {
+    VkSemaphoreTypeCreateInfo type_create_info  = {};
+    type_create_info.sType                      = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_create_info.pNext                      = nullptr;
+    type_create_info.semaphoreType              = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_create_info.initialValue               = initial_value;
+
+    VkSemaphore semaphore;
+    VkSemaphoreCreateInfo create_info   = {};
+    create_info.sType                   = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    create_info.pNext                   = &type_create_info;
+    create_info.flags                   = 0;
+
+    VKRESULT(vkCreateSemaphore(context.device, &create_info, nullptr, &semaphore))
+
+    return semaphore;
+}
+
+uint64_t vkapi::semaphore_value(VkSemaphore timeline_semaphore) const {
+    uint64_t value = 0;
+    VKRESULT(vkGetSemaphoreCounterValue(context.device, timeline_semaphore, &value))
+
+    return value;
+}
+
+void vkapi::wait_semaphore(VkSemaphore timeline_semaphore, uint64_t value) const {
+    VkSemaphoreWaitInfo wait_info   = {};
+    wait_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.pNext                 = nullptr;
+    wait_info.flags                 = 0;
+    wait_info.semaphoreCount        = 1;
+    wait_info.pSemaphores           = &timeline_semaphore;
+    wait_info.pValues               = &value;
+
+    VKRESULT(vkWaitSemaphores(context.device, &wait_info, UINT64_MAX))
+}
 
-handle vkapi::create_sampler(VkFilter filter, VkSamplerAddressMode address_mode) {
+
+handle vkapi::create_sampler(const sampler_settings& settings) {
     VkSamplerCreateInfo sampler_create_info     = {};
     sampler_create_info.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     sampler_create_info.pNext                   = VK_NULL_HANDLE;
     sampler_create_info.flags                   = 0;
-    sampler_create_info.magFilter               = filter;
-    sampler_create_info.minFilter               = filter;
-    sampler_create_info.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-    sampler_create_info.addressModeU            = address_mode;
-    sampler_create_info.addressModeV            = address_mode;
-    sampler_create_info.addressModeW            = address_mode;
+    sampler_create_info.magFilter               = settings.mag_filter;
+    sampler_create_info.minFilter               = settings.min_filter;
+    sampler_create_info.mipmapMode              = settings.mipmap_mode;
+    sampler_create_info.addressModeU            = settings.address_mode_u;
+    sampler_create_info.addressModeV            = settings.address_mode_v;
+    sampler_create_info.addressModeW            = settings.address_mode_u;
     sampler_create_info.mipLodBias              = 0.f;
     sampler_create_info.anisotropyEnable        = VK_FALSE;
     sampler_create_info.compareEnable           = VK_FALSE;
     sampler_create_info.compareOp               = VK_COMPARE_OP_ALWAYS;
     sampler_create_info.minLod                  = 0.f;
-    sampler_create_info.maxLod                  = 0.f;
+    sampler_create_info.maxLod                  = VK_LOD_CLAMP_NONE;
     sampler_create_info.borderColor             = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
     sampler_create_info.unnormalizedCoordinates = VK_FALSE;
 
@@ -447,11 +609,15 @@ void vkapi::destroy_sampler(handle sampler) {
 
 
 VkCommandPool vkapi::create_command_pool() const {
+    return create_command_pool(context.graphics_queue.index);
+}
+
+VkCommandPool vkapi::create_command_pool(uint32_t queue_family_index) const {
     VkCommandPoolCreateInfo cmd_pool_create_info    = {};
     cmd_pool_create_info.sType                      = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     cmd_pool_create_info.pNext                      = nullptr;
     cmd_pool_create_info.flags                      = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    cmd_pool_create_info.queueFamilyIndex           = context.graphics_queue.index;
+    cmd_pool_create_info.queueFamilyIndex           = queue_family_index;
 
     VkCommandPool command_pool;
     VKRESULT(vkCreateCommandPool(context.device, &cmd_pool_create_info, nullptr, &command_pool))
@@ -620,7 +786,7 @@ void vkapi::destroy_framebuffers(std::vector<framebuffer>& framebuffers) const {
 }
 
 
-pipeline vkapi::create_compute_pipeline(const char* shader_name) const {
+pipeline vkapi::create_compute_pipeline(const char* shader_name, const std::vector<uint32_t>& specialization_constants) const {
     pipeline pipeline {
         .bind_point = VK_PIPELINE_BIND_POINT_COMPUTE
     };
@@ -641,6 +807,21 @@ pipeline vkapi::create_compute_pipeline(const char* shader_name) const {
 
     VKRESULT(vkCreateShaderModule(context.device, &shader_create_info, VK_NULL_HANDLE, (pipeline.shader_modules).data()))
 
+    std::vector<VkSpecializationMapEntry> specialization_entries(specialization_constants.size());
+    for (uint32_t constant_id { 0U }; constant_id < specialization_constants.size(); constant_id++) {
+        specialization_entries[constant_id] = {
+            .constantID                             = constant_id,
+            .offset                                 = constant_id * (uint32_t)sizeof(uint32_t),
+            .size                                   = sizeof(uint32_t),
+        };
+    }
+
+    VkSpecializationInfo specialization_info        = {};
+    specialization_info.mapEntryCount               = (uint32_t)specialization_entries.size();
+    specialization_info.pMapEntries                 = specialization_entries.data();
+    specialization_info.dataSize                    = specialization_constants.size() * sizeof(uint32_t);
+    specialization_info.pData                       = specialization_constants.data();
+
     VkPipelineShaderStageCreateInfo stage_create_info = {};
     stage_create_info.sType                         = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     stage_create_info.pNext                         = VK_NULL_HANDLE;
@@ -648,7 +829,7 @@ pipeline vkapi::create_compute_pipeline(const char* shader_name) const {
     stage_create_info.stage                         = VK_SHADER_STAGE_COMPUTE_BIT;
     stage_create_info.module                        = pipeline.shader_modules[0];
     stage_create_info.pName                         = "main";
-    stage_create_info.pSpecializationInfo           = VK_NULL_HANDLE;
+    stage_create_info.pSpecializationInfo           = specialization_constants.empty() ? VK_NULL_HANDLE : &specialization_info;
 
 
     VkComputePipelineCreateInfo create_info         = {};
@@ -898,6 +1079,13 @@ swapchain vkapi::create_swapchain(VkSurfaceKHR surface, size_t min_image_count,
     create_info.imageArrayLayers            = 1;
     create_info.imageUsage                  = usages;
     create_info.imageSharingMode            = VK_SHARING_MODE_EXCLUSIVE;
+    // The compute queue writes the images the graphics queue presents
+    uint32_t queue_families[] = { context.graphics_queue.index, context.compute_queue.index };
+    if (queue_families[0] != queue_families[1]) {
+        create_info.imageSharingMode        = VK_SHARING_MODE_CONCURRENT;
+        create_info.queueFamilyIndexCount   = 2;
+        create_info.pQueueFamilyIndices     = queue_families;
+    }
     create_info.preTransform                = caps.currentTransform;
     create_info.compositeAlpha              = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode                 = supported_present_modes[0];
@@ -985,106 +1173,79 @@ void vkapi::destroy_swapchain(swapchain& swapchain) {
         bindless_descriptor.free(images[image]->bindless_sampled_index, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
 
         vkDestroyImageView(context.device, images[image]->view, nullptr);
+
+        // Owned by the swapchain, the api does not destroy it
+        images[image]->handle = VK_NULL_HANDLE;
+        images[image]->bindless_storage_index = 0U;
+        images[image]->bindless_sampled_index = 0U;
     }
     vkDestroySwapchainKHR(context.device, swapchain.handle, nullptr);
 }
 
 
 void vkapi::update_descriptor_image(handle img, VkDescriptorType type) {
-    VkDescriptorImageInfo descriptor_image_info;
-    VkWriteDescriptorSet write_descriptor;
-
     auto* current_image = images[img];
+    auto index = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? current_image->bindless_storage_index : current_image->bindless_sampled_index;
+
+    pending_descriptor_writes.push_back({
+        .type       = type,
+        .index      = index,
+        .generation = bindless_descriptor.generation(index, type),
+        .view       = current_image->view,
+        .sampler    = VK_NULL_HANDLE,
+    });
+}
 
-    descriptor_image_info.sampler         = VK_NULL_HANDLE;
-    descriptor_image_info.imageView       = current_image->view;
-    descriptor_image_info.imageLayout     = VK_IMAGE_LAYOUT_GENERAL;
-
-    write_descriptor.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor.pNext                = nullptr;
-    write_descriptor.dstSet               = bindless_descriptor.set;
-    write_descriptor.dstBinding           = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? 2 : 1;
-    write_descriptor.dstArrayElement      = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? current_image->bindless_storage_index : current_image->bindless_sampled_index;
-    write_descriptor.descriptorCount      = 1;
-    write_descriptor.descriptorType       = type;
-    write_descriptor.pImageInfo           = &descriptor_image_info;
-    write_descriptor.pBufferInfo          = VK_NULL_HANDLE;
-    write_descriptor.pTexelBufferView     = VK_NULL_HANDLE;
-
-    vkUpdateDescriptorSets(context.device, 1, &write_descriptor, 0, nullptr);
-}
-
-void vkapi::update_descriptor_images(std::vector<handle> &handles, VkDescriptorType type) {
-    std::vector<VkDescriptorImageInfo> descriptor_images_info   { images.size() };
-    std::vector<VkWriteDescriptorSet> writes_descriptor         { images.size() };
-
-    for (size_t image_index = 0; image_index < images.size(); image_index++) {
-        auto image = images[handles[image_index]];
-        descriptor_images_info[image_index].sampler         = VK_NULL_HANDLE;
-        descriptor_images_info[image_index].imageView       = image->view;
-        descriptor_images_info[image_index].imageLayout     = VK_IMAGE_LAYOUT_GENERAL;
-
-        writes_descriptor[image_index].sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writes_descriptor[image_index].pNext                = nullptr;
-        writes_descriptor[image_index].dstSet               = bindless_descriptor.set;
-        writes_descriptor[image_index].dstBinding           = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? 2 : 1;
-        writes_descriptor[image_index].dstArrayElement      = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? image->bindless_storage_index : image->bindless_sampled_index;
-        writes_descriptor[image_index].descriptorCount      = 1;
-        writes_descriptor[image_index].descriptorType       = type;
-        writes_descriptor[image_index].pImageInfo           = &descriptor_images_info[image_index];
-        writes_descriptor[image_index].pBufferInfo          = VK_NULL_HANDLE;
-        writes_descriptor[image_index].pTexelBufferView     = VK_NULL_HANDLE;
-    }
+void vkapi::update_descriptor_sampler(handle sampler) {
+    auto* current_sampler = samplers[sampler];
 
-    vkUpdateDescriptorSets(context.device, writes_descriptor.size(), writes_descriptor.data(), 0, nullptr);
+    pending_descriptor_writes.push_back({
+        .type       = VK_DESCRIPTOR_TYPE_SAMPLER,
+        .index      = current_sampler->bindless_index,
+        .generation = bindless_descriptor.generation(current_sampler->bindless_index, VK_DESCRIPTOR_TYPE_SAMPLER),
+        .view       = VK_NULL_HANDLE,
+        .sampler    = current_sampler->handle,
+    });
 }
 
-void vkapi::update_descriptor_sampler(handle sampler) {
-    VkDescriptorImageInfo descriptor_image_info;
-    VkWriteDescriptorSet write_descriptor;
-    auto current_sampler = samplers[sampler];
-
-    descriptor_image_info.sampler         = current_sampler->handle;
-    descriptor_image_info.imageView       = VK_NULL_HANDLE;
-    descriptor_image_info.imageLayout     = VK_IMAGE_LAYOUT_GENERAL;
-
-    write_descriptor.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor.pNext                = nullptr;
-    write_descriptor.dstSet               = bindless_descriptor.set;
-    write_descriptor.dstBinding           = 0;
-    write_descriptor.dstArrayElement      = current_sampler->bindless_index;
-    write_descriptor.descriptorCount      = 1;
-    write_descriptor.descriptorType       = VK_DESCRIPTOR_TYPE_SAMPLER;
-    write_descriptor.pImageInfo           = &descriptor_image_info;
-    write_descriptor.pBufferInfo          = VK_NULL_HANDLE;
-    write_descriptor.pTexelBufferView     = VK_NULL_HANDLE;
-
-    vkUpdateDescriptorSets(context.device, 1, &write_descriptor, 0, nullptr);
-}
-
-void vkapi::update_descriptor_samplers(std::vector<handle> &handles) {
-    std::vector<VkDescriptorImageInfo> descriptor_images_info   { samplers.size() };
-    std::vector<VkWriteDescriptorSet> writes_descriptor         { samplers.size() };
-
-    for (size_t sampler_index = 0; sampler_index < samplers.size(); sampler_index++) {
-        auto sampler = samplers[handles[sampler_index]];
-        descriptor_images_info[sampler_index].sampler         = sampler->handle;
-        descriptor_images_info[sampler_index].imageView       = VK_NULL_HANDLE;
-        descriptor_images_info[sampler_index].imageLayout     = VK_IMAGE_LAYOUT_GENERAL;
-
-        writes_descriptor[sampler_index].sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writes_descriptor[sampler_index].pNext                = nullptr;
-        writes_descriptor[sampler_index].dstSet               = bindless_descriptor.set;
-        writes_descriptor[sampler_index].dstBinding           = 0;
-        writes_descriptor[sampler_index].dstArrayElement      = sampler->bindless_index;
-        writes_descriptor[sampler_index].descriptorCount      = 1;
-        writes_descriptor[sampler_index].descriptorType       = VK_DESCRIPTOR_TYPE_SAMPLER;
-        writes_descriptor[sampler_index].pImageInfo           = &descriptor_images_info[sampler_index];
-        writes_descriptor[sampler_index].pBufferInfo          = VK_NULL_HANDLE;
-        writes_descriptor[sampler_index].pTexelBufferView     = VK_NULL_HANDLE;
+void vkapi::flush_descriptor_writes() {
+    if (pending_descriptor_writes.empty()) {
+        return;
     }
 
-    vkUpdateDescriptorSets(context.device, writes_descriptor.size(), writes_descriptor.data(), 0, nullptr);
+    std::vector<VkDescriptorImageInfo> descriptor_images_info;
+    std::vector<VkWriteDescriptorSet> writes_descriptor;
+    descriptor_images_info.reserve(pending_descriptor_writes.size());
+    writes_descriptor.reserve(pending_descriptor_writes.size());
+
+    for (const auto& pending_write: pending_descriptor_writes) {
+        if (pending_write.index == 0U || pending_write.generation != bindless_descriptor.generation(pending_write.index, pending_write.type)) {
+            continue;
+        }
+
+        descriptor_images_info.push_back({
+            .sampler        = pending_write.sampler,
+            .imageView      = pending_write.view,
+            .imageLayout    = VK_IMAGE_LAYOUT_GENERAL,
+        });
+
+        VkWriteDescriptorSet write_descriptor   = {};
+        write_descriptor.sType                  = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_descriptor.pNext                  = nullptr;
+        write_descriptor.dstSet                 = bindless_descriptor.set;
+        write_descriptor.dstBinding             = (uint32_t)global_descriptor::descriptor_type_binding(pending_write.type);
+        write_descriptor.dstArrayElement        = pending_write.index;
+        write_descriptor.descriptorCount        = 1;
+        write_descriptor.descriptorType         = pending_write.type;
+        write_descriptor.pImageInfo             = &descriptor_images_info.back();
+        write_descriptor.pBufferInfo            = VK_NULL_HANDLE;
+        write_descriptor.pTexelBufferView       = VK_NULL_HANDLE;
+        writes_descriptor.push_back(write_descriptor);
+    }
+
+    vkUpdateDescriptorSets(context.device, (uint32_t)writes_descriptor.size(), writes_descriptor.data(), 0, nullptr);
+
+    pending_descriptor_writes.clear();
 }
 
 void vkapi::update_constants(VkCommandBuffer command_buffer, VkShaderStageFlagBits shader_stage, off_t offset, size_t size, void* data) {
@@ -1101,7 +1262,7 @@ void vkapi::start_record(VkCommandBuffer command_buffer) {
     vkBeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
 }
 
-void vkapi::image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layout, VkPipelineStageFlagBits dst_stage, VkAccessFlags dst_access, handle image) {
+void vkapi::image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, handle image, uint32_t src_family, uint32_t dst_family) {
     auto *current_image = images[image];
 
     VkImageMemoryBarrier image_barrier   = {};
@@ -1116,9 +1277,35 @@ void vkapi::image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layo
     image_barrier.image                  = current_image->handle;
     image_barrier.subresourceRange       = current_image->subresource_range;
 
+    auto src_stage = current_image->previous_stage;
+
+    if (src_family != dst_family) {
+        image_barrier.srcQueueFamilyIndex = src_family;
+        image_barrier.dstQueueFamilyIndex = dst_family;
+
+        if (!current_image->ownership_released) {
+            // The release only makes the writes available, the semaphore the acquire waits on orders them
+            image_barrier.dstAccessMask = 0;
+
+            vkCmdPipelineBarrier(command_buffer, src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+            current_image->ownership_released = true;
+            current_image->released_layout = current_image->previous_layout;
+            current_image->previous_layout = dst_layout;
+            current_image->previous_access = 0;
+            current_image->previous_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            return;
+        }
+
+        image_barrier.srcAccessMask = 0;
+        image_barrier.oldLayout = current_image->released_layout;
+        src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        current_image->ownership_released = false;
+    }
+
     vkCmdPipelineBarrier(
         command_buffer,
-        current_image->previous_stage,
+        src_stage,
         dst_stage,
         0,
         0,
@@ -1134,6 +1321,85 @@ void vkapi::image_barrier(VkCommandBuffer command_buffer, VkImageLayout dst_layo
     current_image->previous_stage = dst_stage;
 }
 
+void vkapi::release_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t src_family, uint32_t dst_family) {
+    if (src_family == dst_family) {
+        return;
+    }
+
+    VkBufferMemoryBarrier release_barrier   = {};
+    release_barrier.sType                   = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    release_barrier.pNext                   = nullptr;
+    release_barrier.srcAccessMask           = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release_barrier.dstAccessMask           = 0;
+    release_barrier.srcQueueFamilyIndex     = src_family;
+    release_barrier.dstQueueFamilyIndex     = dst_family;
+    release_barrier.buffer                  = buffers[buffer]->handle;
+    release_barrier.offset                  = offset;
+    release_barrier.size                    = size;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release_barrier, 0, nullptr);
+}
+
+void vkapi::acquire_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+    if (src_family == dst_family) {
+        return;
+    }
+
+    VkBufferMemoryBarrier acquire_barrier   = {};
+    acquire_barrier.sType                   = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    acquire_barrier.pNext                   = nullptr;
+    acquire_barrier.srcAccessMask           = 0;
+    acquire_barrier.dstAccessMask           = dst_access;
+    acquire_barrier.srcQueueFamilyIndex     = src_family;
+    acquire_barrier.dstQueueFamilyIndex     = dst_family;
+    acquire_barrier.buffer                  = buffers[buffer]->handle;
+    acquire_barrier.offset                  = offset;
+    acquire_barrier.size                    = size;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0, 0, nullptr, 1, &acquire_barrier, 0, nullptr);
+}
+
+void vkapi::discard_image(handle image) {
+    auto *current_image = images[image];
+
+    assert(!current_image->ownership_released);
+
+    current_image->previous_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    current_image->previous_access = 0;
+    current_image->previous_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+}
+
+void vkapi::memory_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+    VkMemoryBarrier memory_barrier  = {};
+    memory_barrier.sType            = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.pNext            = nullptr;
+    memory_barrier.srcAccessMask    = src_access;
+    memory_barrier.dstAccessMask    = dst_access;
+
+    vkCmdPipelineBarrier(
+        command_buffer,
+        src_stage,
+        dst_stage,
+        0,
+        1,
+        &memory_barrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+}
+
+void vkapi::update_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, const void* data) {
+    assert(size <= 65536 && size % 4 == 0 && offset % 4 == 0);
+
+    vkCmdUpdateBuffer(command_buffer, buffers[buffer]->handle, offset, size, data);
+}
+
+void vkapi::fill_buffer(VkCommandBuffer command_buffer, handle buffer, size_t offset, size_t size, uint32_t value) {
+    vkCmdFillBuffer(command_buffer, buffers[buffer]->handle, offset, size, value);
+}
+
 
 void vkapi::begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass render_pass, std::vector<VkImageView>& attachments, framebuffer framebuffer, VkExtent2D size) {
     VkRect2D render_area = {
@@ -1176,6 +1442,14 @@ void vkapi::run_compute_pipeline(VkCommandBuffer command_buffer, pipeline& pipel
     vkCmdDispatch(command_buffer, group_count_x, group_count_y, group_count_z);
 }
 
+void vkapi::run_compute_pipeline_indirect(VkCommandBuffer command_buffer, pipeline& pipeline, handle arguments_buffer, size_t arguments_offset) {
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bindless_descriptor.pipeline_layout, 0, 1, &bindless_descriptor.set, 0, nullptr);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+
+    vkCmdDispatchIndirect(command_buffer, buffers[arguments_buffer]->handle, arguments_offset);
+}
+
 void vkapi::draw(VkCommandBuffer command_buffer, pipeline& pipeline, uint32_t vertex_count, uint32_t vertex_offset) {
     vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bindless_descriptor.pipeline_layout, 0, 1, &bindless_descriptor.set, 0, nullptr);
     vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
@@ -1195,53 +1469,239 @@ void vkapi::blit_full(VkCommandBuffer command_buffer, handle src, handle dst) {
     auto *src_image = images[src];
     auto *dst_image = images[dst];
 
-    VkImageSubresourceLayers images_subres_layers {
-        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-        .mipLevel       = 0,
-        .baseArrayLayer = 0,
-        .layerCount     = 1,
-    };
+    // Array layers are laid out side by side, each one keeping its own size
+    auto layer_count = src_image->subresource_range.layerCount;
+    auto region_width = layer_count > 1 ? src_image->size.width : dst_image->size.width;
+    auto region_height = layer_count > 1 ? src_image->size.height : dst_image->size.height;
 
-    VkOffset3D start_offset {
-        .x  = 0,
-        .y  = 0,
-        .z  = 0,
-    };
-    VkOffset3D end_offset {
-        .x  = (int32_t)dst_image->size.width,
-        .y  = (int32_t)dst_image->size.height,
-        .z  = (int32_t)dst_image->size.depth,
-    };
+    assert(region_width * layer_count <= dst_image->size.width && region_height <= dst_image->size.height);
 
-    VkImageBlit blit_region {
-        .srcSubresource = images_subres_layers,
-        .srcOffsets     = { start_offset, end_offset },
-        .dstSubresource = images_subres_layers,
-        .dstOffsets     = { start_offset, end_offset },
-    };
+    std::vector<VkImageBlit> blit_regions(layer_count);
+
+    for (uint32_t layer = 0; layer < layer_count; layer++) {
+        VkImageSubresourceLayers src_subres_layers {
+            .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel       = 0,
+            .baseArrayLayer = layer,
+            .layerCount     = 1,
+        };
+
+        VkImageSubresourceLayers dst_subres_layers {
+            .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel       = 0,
+            .baseArrayLayer = 0,
+            .layerCount     = 1,
+        };
+
+        VkOffset3D src_start_offset {
+            .x  = 0,
+            .y  = 0,
+            .z  = 0,
+        };
+        VkOffset3D src_end_offset {
+            .x  = (int32_t)region_width,
+            .y  = (int32_t)region_height,
+            .z  = (int32_t)dst_image->size.depth,
+        };
+
+        VkOffset3D dst_start_offset {
+            .x  = (int32_t)(layer * region_width),
+            .y  = 0,
+            .z  = 0,
+        };
+        VkOffset3D dst_end_offset {
+            .x  = (int32_t)((layer + 1) * region_width),
+            .y  = (int32_t)region_height,
+            .z  = (int32_t)dst_image->size.depth,
+        };
+
+        blit_regions[layer] = {
+            .srcSubresource = src_subres_layers,
+            .srcOffsets     = { src_start_offset, src_end_offset },
+            .dstSubresource = dst_subres_layers,
+            .dstOffsets     = { dst_start_offset, dst_end_offset },
+        };
+    }
+
+    vkCmdBlitImage(command_buffer, src_image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, blit_regions.size(), blit_regions.data(), VK_FILTER_NEAREST);
+}
+
+void vkapi::generate_mipmaps(VkCommandBuffer command_buffer, handle image) {
+    auto *mip_image = images[image];
+
+    assert(mip_image->previous_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    VkImageMemoryBarrier level_barrier   = {};
+    level_barrier.sType                  = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    level_barrier.pNext                  = nullptr;
+    level_barrier.srcAccessMask          = VK_ACCESS_TRANSFER_WRITE_BIT;
+    level_barrier.dstAccessMask          = VK_ACCESS_TRANSFER_READ_BIT;
+    level_barrier.oldLayout              = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    level_barrier.newLayout              = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    level_barrier.srcQueueFamilyIndex    = VK_QUEUE_FAMILY_IGNORED;
+    level_barrier.dstQueueFamilyIndex    = VK_QUEUE_FAMILY_IGNORED;
+    level_barrier.image                  = mip_image->handle;
+    level_barrier.subresourceRange       = mip_image->subresource_range;
+    level_barrier.subresourceRange.levelCount = 1;
+
+    auto level_count = mip_image->subresource_range.levelCount;
+    auto level_width = (int32_t)mip_image->size.width;
+    auto level_height = (int32_t)mip_image->size.height;
+
+    for (uint32_t level { 1U }; level < level_count; level++) {
+        // The previous level is complete, it becomes the source of this one
+        level_barrier.subresourceRange.baseMipLevel = level - 1;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &level_barrier);
+
+        auto next_width = level_width > 1 ? level_width / 2 : 1;
+        auto next_height = level_height > 1 ? level_height / 2 : 1;
+
+        VkImageBlit level_blit {
+            .srcSubresource = {
+                .aspectMask     = mip_image->subresource_range.aspectMask,
+                .mipLevel       = level - 1,
+                .baseArrayLayer = 0,
+                .layerCount     = mip_image->subresource_range.layerCount,
+            },
+            .srcOffsets     = { { 0, 0, 0 }, { level_width, level_height, 1 } },
+            .dstSubresource = {
+                .aspectMask     = mip_image->subresource_range.aspectMask,
+                .mipLevel       = level,
+                .baseArrayLayer = 0,
+                .layerCount     = mip_image->subresource_range.layerCount,
+            },
+            .dstOffsets     = { { 0, 0, 0 }, { next_width, next_height, 1 } },
+        };
+
+        vkCmdBlitImage(command_buffer, mip_image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mip_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &level_blit, VK_FILTER_LINEAR);
+
+        level_width = next_width;
+        level_height = next_height;
+    }
+
+    // The last level was only written, every level now shares one layout for the next image_barrier
+    level_barrier.subresourceRange.baseMipLevel = level_count - 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &level_barrier);
 
-    vkCmdBlitImage(command_buffer, src_image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit_region, VK_FILTER_NEAREST);
+    mip_image->previous_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    mip_image->previous_access = VK_ACCESS_TRANSFER_READ_BIT;
+    mip_image->previous_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 }
 
 void vkapi::end_record(VkCommandBuffer command_buffer) {
     VKRESULT(vkEndCommandBuffer(command_buffer))
 }
 
-VkResult vkapi::submit(VkCommandBuffer command_buffers[], size_t command_buffers_count, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, VkFence submission_fence) const {
-    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+VkResult vkapi::submit(VkCommandBuffer command_buffers[], size_t command_buffers_count, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, timeline_point timeline_wait, timeline_point timeline_signal) const {
+    VkSemaphore wait_semaphores[2];
+    VkPipelineStageFlags wait_stages[2];
+    uint64_t wait_values[2];
+    uint32_t wait_count = 0;
+
+    if (wait_semaphore != nullptr) {
+        wait_semaphores[wait_count] = wait_semaphore;
+        wait_stages[wait_count] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        wait_values[wait_count++] = 0;
+    }
+    if (timeline_wait.semaphore != nullptr) {
+        wait_semaphores[wait_count] = timeline_wait.semaphore;
+        wait_stages[wait_count] = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        wait_values[wait_count++] = timeline_wait.value;
+    }
+
+    VkSemaphore signal_semaphores[2];
+    uint64_t signal_values[2];
+    uint32_t signal_count = 0;
+
+    if (signal_semaphore != nullptr) {
+        signal_semaphores[signal_count] = signal_semaphore;
+        signal_values[signal_count++] = 0;
+    }
+    if (timeline_signal.semaphore != nullptr) {
+        signal_semaphores[signal_count] = timeline_signal.semaphore;
+        signal_values[signal_count++] = timeline_signal.value;
+    }
+
+    // Binary semaphores ignore their value
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext                         = nullptr;
+    timeline_info.waitSemaphoreValueCount       = wait_count;
+    timeline_info.pWaitSemaphoreValues          = wait_values;
+    timeline_info.signalSemaphoreValueCount     = signal_count;
+    timeline_info.pSignalSemaphoreValues        = signal_values;
 
     VkSubmitInfo submit_info            = {};
     submit_info.sType                   = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext                   = nullptr;
-    submit_info.waitSemaphoreCount      = wait_semaphore != nullptr ? 1 : 0;
-    submit_info.pWaitSemaphores         = &wait_semaphore;
-    submit_info.pWaitDstStageMask       = wait_semaphore != nullptr ? &wait_stage : VK_NULL_HANDLE;
-    submit_info.signalSemaphoreCount    = signal_semaphore != nullptr ? 1 : 0;
-    submit_info.pSignalSemaphores       = &signal_semaphore;
+    submit_info.pNext                   = &timeline_info;
+    submit_info.waitSemaphoreCount      = wait_count;
+    submit_info.pWaitSemaphores         = wait_semaphores;
+    submit_info.pWaitDstStageMask       = wait_stages;
+    submit_info.signalSemaphoreCount    = signal_count;
+    submit_info.pSignalSemaphores       = signal_semaphores;
     submit_info.commandBufferCount      = command_buffers_count;
     submit_info.pCommandBuffers         = command_buffers;
 
-    return vkQueueSubmit(context.graphics_queue.handle, 1, &submit_info, submission_fence);
+    return vkQueueSubmit(context.graphics_queue.handle, 1, &submit_info, VK_NULL_HANDLE);
+}
+
+VkResult vkapi::submit_transfer(VkCommandBuffer command_buffer, VkSemaphore timeline_semaphore, uint64_t signal_value) const {
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext                         = nullptr;
+    timeline_info.signalSemaphoreValueCount     = 1;
+    timeline_info.pSignalSemaphoreValues        = &signal_value;
+
+    VkSubmitInfo submit_info            = {};
+    submit_info.sType                   = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext                   = &timeline_info;
+    submit_info.waitSemaphoreCount      = 0;
+    submit_info.signalSemaphoreCount    = 1;
+    submit_info.pSignalSemaphores       = &timeline_semaphore;
+    submit_info.commandBufferCount      = 1;
+    submit_info.pCommandBuffers         = &command_buffer;
+
+    return vkQueueSubmit(context.transfer_queue.handle, 1, &submit_info, VK_NULL_HANDLE);
+}
+
+VkResult vkapi::submit_compute(VkCommandBuffer command_buffer, const VkSemaphore wait_semaphores[], uint32_t wait_semaphores_count, VkSemaphore signal_semaphore, timeline_point timeline_signal) const {
+    std::vector<VkPipelineStageFlags> wait_stages(wait_semaphores_count, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    std::vector<uint64_t> wait_values(wait_semaphores_count, 0);
+
+    VkSemaphore signal_semaphores[2];
+    uint64_t signal_values[2];
+    uint32_t signal_count = 0;
+
+    if (signal_semaphore != nullptr) {
+        signal_semaphores[signal_count] = signal_semaphore;
+        signal_values[signal_count++] = 0;
+    }
+    if (timeline_signal.semaphore != nullptr) {
+        signal_semaphores[signal_count] = timeline_signal.semaphore;
+        signal_values[signal_count++] = timeline_signal.value;
+    }
+
+    // The waits are on binary semaphores, their values are ignored
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext                         = nullptr;
+    timeline_info.waitSemaphoreValueCount       = wait_semaphores_count;
+    timeline_info.pWaitSemaphoreValues          = wait_values.data();
+    timeline_info.signalSemaphoreValueCount     = signal_count;
+    timeline_info.pSignalSemaphoreValues        = signal_values;
+
+    VkSubmitInfo submit_info            = {};
+    submit_info.sType                   = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext                   = &timeline_info;
+    submit_info.waitSemaphoreCount      = wait_semaphores_count;
+    submit_info.pWaitSemaphores         = wait_semaphores;
+    submit_info.pWaitDstStageMask       = wait_stages.data();
+    submit_info.signalSemaphoreCount    = signal_count;
+    submit_info.pSignalSemaphores       = signal_semaphores;
+    submit_info.commandBufferCount      = 1;
+    submit_info.pCommandBuffers         = &command_buffer;
+
+    return vkQueueSubmit(context.compute_queue.handle, 1, &submit_info, VK_NULL_HANDLE);
 }
 
 VkResult vkapi::present(swapchain& swapchain, uint32_t image_index, VkSemaphore wait_semaphore) const {
@@ -152,7 +152,9 @@ void vkcontext::create_device() {
     };
     auto queue_priority = 1.f;
     graphics_queue.index = select_queue(graphics_queue.usages);
-    auto queue_create_info  = VkDeviceQueueCreateInfo {
+    VkDeviceQueueCreateInfo queue_create_infos[3] = {};
+    uint32_t queue_create_info_count = 0;
+    queue_create_infos[queue_create_info_count++] = VkDeviceQueueCreateInfo {
         .sType              = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
         .queueFamilyIndex   = graphics_queue.index,
         .queueCount         = 1,
@@ -160,6 +162,49 @@ void vkcontext::create_device() {
         .pQueuePriorities   = &queue_priority
     };
 
+    transfer_queue = {
+        .usages = VK_QUEUE_TRANSFER_BIT,
+    };
+    transfer_queue.index = select_queue(transfer_queue.usages, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if (transfer_queue.index == UINT_MAX) {
+        transfer_queue.index = graphics_queue.index;
+    } else {
+        queue_create_infos[queue_create_info_count++] = VkDeviceQueueCreateInfo {
+            .sType              = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex   = transfer_queue.index,
+            .queueCount         = 1,
+
+            .pQueuePriorities   = &queue_priority
+        };
+    }
+
+    compute_queue = {
+        .usages = VK_QUEUE_COMPUTE_BIT,
+    };
+    compute_queue.index = select_queue(compute_queue.usages, VK_QUEUE_GRAPHICS_BIT);
+    if (compute_queue.index == UINT_MAX) {
+        compute_queue.index = graphics_queue.index;
+    } else {
+        queue_create_infos[queue_create_info_count++] = VkDeviceQueueCreateInfo {
+            .sType              = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex   = compute_queue.index,
+            .queueCount         = 1,
+
+            .pQueuePriorities   = &queue_priority
+        };
+    }
+
+    VkPhysicalDeviceVulkan12Features supported_12_features                  = {};
+    supported_12_features.sType                                             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supported_features                            = {};
+    supported_features.sType                                                = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features.pNext                                                = &supported_12_features;
+
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+    supports_shader_float16 = supported_12_features.shaderFloat16 == VK_TRUE;
+    supports_texture_compression_bc = supported_features.features.textureCompressionBC == VK_TRUE;
+
     VkPhysicalDeviceVulkan12Features physical_device_12_features            = {};
     physical_device_12_features.sType                                       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     physical_device_12_features.pNext                                       = VK_NULL_HANDLE;
@@ -170,11 +215,18 @@ void vkcontext::create_device() {
     physical_device_12_features.descriptorBindingPartiallyBound             = VK_TRUE;
     physical_device_12_features.descriptorBindingPartiallyBound             = VK_TRUE;
     physical_device_12_features.descriptorBindingUpdateUnusedWhilePending   = VK_TRUE;
+    physical_device_12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    physical_device_12_features.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
     physical_device_12_features.imagelessFramebuffer                        = VK_TRUE;
+    physical_device_12_features.timelineSemaphore                           = VK_TRUE;
+    physical_device_12_features.shaderFloat16                               = supports_shader_float16 ? VK_TRUE : VK_FALSE;
 
     VkPhysicalDeviceFeatures2 device_features   = {};
     device_features.sType                       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     device_features.pNext                       = &physical_device_12_features;
+    // The tonemapping pass writes the swapchain images whatever their format
+    device_features.features.shaderStorageImageWriteWithoutFormat = VK_TRUE;
+    device_features.features.textureCompressionBC = supports_texture_compression_bc ? VK_TRUE : VK_FALSE;
 
     const char* device_ext[]                    = {
         "VK_KHR_swapchain",
@@ -183,8 +235,8 @@ void vkcontext::create_device() {
     VkDeviceCreateInfo device_create_info       = {};
     device_create_info.sType                    = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     device_create_info.pNext                    = &device_features;
-    device_create_info.pQueueCreateInfos        = &queue_create_info;
-    device_create_info.queueCreateInfoCount     = 1;
+    device_create_info.pQueueCreateInfos        = queue_create_infos;
+    device_create_info.queueCreateInfoCount     = queue_create_info_count;
     device_create_info.ppEnabledExtensionNames  = device_ext;
     device_create_info.enabledExtensionCount    = sizeof(device_ext) / sizeof(device_ext[0]);
     device_create_info.enabledLayerCount        = 0; // Deprecated https://www.khronos.org/registry/vulkan/specs/1.2/html/chap31.html#extendingvulkan-layers-devicelayerdeprecation
@@ -194,6 +246,15 @@ void vkcontext::create_device() {
     load_device_functions(device);
 
     vkGetDeviceQueue(device, graphics_queue.index, 0, &graphics_queue.handle);
+    vkGetDeviceQueue(device, transfer_queue.index, 0, &transfer_queue.handle);
+    vkGetDeviceQueue(device, compute_queue.index, 0, &compute_queue.handle);
+
+    if (transfer_queue.index != graphics_queue.index) {
+        std::cerr << "Uploading on the transfer queue family " << transfer_queue.index << std::endl;
+    }
+    if (compute_queue.index != graphics_queue.index) {
+        std::cerr << "Post processing on the compute queue family " << compute_queue.index << std::endl;
+    }
 
     std::cerr << "Device ready" << std::endl;
 }
@@ -229,9 +290,33 @@ void vkcontext::select_physical_device() {
     }
 
     assert(physical_device != VK_NULL_HANDLE);
+
+    descriptor_indexing_properties              = {};
+    descriptor_indexing_properties.sType        = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+    id_properties                               = {};
+    id_properties.sType                         = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    id_properties.pNext                         = &descriptor_indexing_properties;
+
+    subgroup_properties                         = {};
+    subgroup_properties.sType                   = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    subgroup_properties.pNext                   = &id_properties;
+
+    VkPhysicalDeviceProperties2 properties      = {};
+    properties.sType                            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext                            = &subgroup_properties;
+
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    limits = properties.properties.limits;
+}
+
+bool vkcontext::supports_compute_subgroup_operations(VkSubgroupFeatureFlags operations) const {
+    return (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0U &&
+           (subgroup_properties.supportedOperations & operations) == operations;
 }
 
-uint32_t vkcontext::select_queue(VkQueueFlags queue_usage) const {
+uint32_t vkcontext::select_queue(VkQueueFlags queue_usage, VkQueueFlags excluded_usage) const {
     uint32_t queue_properties_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_properties_count, nullptr);
 
@@ -239,12 +324,12 @@ uint32_t vkcontext::select_queue(VkQueueFlags queue_usage) const {
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_properties_count, queue_properties.data());
 
     for (uint32_t properties_index = 0; properties_index < queue_properties_count; properties_index++) {
-        if ((queue_properties[properties_index].queueFlags & queue_usage) != 0U) {
+        if ((queue_properties[properties_index].queueFlags & queue_usage) != 0U &&
+            (queue_properties[properties_index].queueFlags & excluded_usage) == 0U) {
             return properties_index;
         }
     }
 
-    assert(true);
     return UINT_MAX;
 }
 
@@ -301,14 +386,18 @@ bool vkcontext::support_required_features(VkPhysicalDevice physical_device) {
 
     vkGetPhysicalDeviceFeatures2(physical_device, &physical_device_features);
 
-    if (vulkan_12_features.bufferDeviceAddress == VK_TRUE &&
+    if (physical_device_features.features.shaderStorageImageWriteWithoutFormat == VK_TRUE &&
+        vulkan_12_features.bufferDeviceAddress == VK_TRUE &&
         vulkan_12_features.runtimeDescriptorArray == VK_TRUE &&
         vulkan_12_features.shaderStorageImageArrayNonUniformIndexing == VK_TRUE &&
         vulkan_12_features.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
         vulkan_12_features.descriptorBindingPartiallyBound == VK_TRUE &&
         vulkan_12_features.descriptorBindingPartiallyBound == VK_TRUE &&
         vulkan_12_features.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
-        vulkan_12_features.imagelessFramebuffer == VK_TRUE) {
+        vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+        vulkan_12_features.descriptorBindingStorageImageUpdateAfterBind == VK_TRUE &&
+        vulkan_12_features.imagelessFramebuffer == VK_TRUE &&
+        vulkan_12_features.timelineSemaphore == VK_TRUE) {
         std::cerr << "Using physical device " << physical_device_properties.deviceName << std::endl;
         return true;
     }
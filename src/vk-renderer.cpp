@@ -1,5 +1,7 @@
 #include "vk-renderer.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <cassert>
 
@@ -9,6 +11,7 @@
 
 #include "compute-renderpass.hpp"
 #include "primitive-renderpass.hpp"
+#include "wavefront-renderpass.hpp"
 
 #include "window.hpp"
 
@@ -21,6 +24,12 @@
 auto vkrenderer::context = vkcontext();
 auto vkrenderer::api = vkapi(vkrenderer::context);
 auto vkrenderer::upload_queue = std::vector<Texture*>();
+upload_engine vkrenderer::uploads;
+uint32_t vkrenderer::virtual_frames_count = 2;
+bool vkrenderer::device_local_scene_data = true;
+bool vkrenderer::async_post = false;
+texture_streamer vkrenderer::streamer;
+auto vkrenderer::sampler_cache = std::unordered_map<sampler_settings, Sampler*, sampler_settings::hash>();
 
 vkrenderer::vkrenderer(window& wnd) {
     platform_surface = api.create_surface(wnd);
@@ -38,51 +47,79 @@ vkrenderer::vkrenderer(window& wnd) {
         swapchain_textures[index] = new Texture(swapchain.images[index]);
     }
 
-    tonemapping_pipeline = api.create_compute_pipeline("tonemapping");
+    assert(virtual_frames_count > 0);
+
+    graphics_command_buffers.resize(virtual_frames_count);
+    copy_command_buffers.resize(virtual_frames_count);
+    staging_buffers.resize(virtual_frames_count);
+    compute_command_buffers.resize(virtual_frames_count);
+    traced_semaphores.resize(virtual_frames_count);
+    post_inputs.resize(virtual_frames_count, nullptr);
+    frame_numbers.resize(virtual_frames_count, 0);
+    execution_semaphores.resize(virtual_frames_count);
+    acquire_semaphores.resize(virtual_frames_count);
+    copy_command_pools.resize(virtual_frames_count);
 
     graphics_command_pool = api.create_command_pool();
-    api.allocate_command_buffers(graphics_command_pool, graphics_command_buffers, virtual_frames_count);
+    api.allocate_command_buffers(graphics_command_pool, graphics_command_buffers.data(), virtual_frames_count);
+
+    compute_command_pool = api.create_command_pool(context.compute_queue.index);
+    api.allocate_command_buffers(compute_command_pool, compute_command_buffers.data(), virtual_frames_count);
+
+    frame_semaphore = api.create_timeline_semaphore(0);
 
     for(size_t index { 0 }; index < virtual_frames_count; index++) {
-        submission_fences[index] = api.create_fence();
         execution_semaphores[index] = api.create_semaphore();
         acquire_semaphores[index] = api.create_semaphore();
+        traced_semaphores[index] = api.create_semaphore();
 
         copy_command_pools[index] = api.create_command_pool();
         api.allocate_command_buffers(copy_command_pools[index], &copy_command_buffers[index], 1);
 
         // staging_buffers[index] = create_staging_buffer(4096 * 4096 * sizeof(uint32_t));
-        staging_buffers[index] = new RingBuffer(4096ULL * 4096ULL * sizeof(uint32_t));
+        staging_buffers[index] = new RingBuffer(staging_buffer_size);
     }
+
+    uploads.init();
 }
 
 vkrenderer::~vkrenderer() {
-    VKRESULT(vkWaitForFences(context.device, virtual_frames_count, submission_fences, VK_TRUE, UINT64_MAX))
+    api.wait_semaphore(frame_semaphore, submitted_frames);
+
+    uploads.destroy();
 
     for (auto& renderpass : renderpasses) {
         delete renderpass;
     }
 
+    for (auto& renderpass : post_renderpasses) {
+        delete renderpass;
+    }
+
     for(size_t index { 0 }; index < virtual_frames_count; index++) {
         vkFreeCommandBuffers(context.device, copy_command_pools[index], 1, &copy_command_buffers[index]);
         vkDestroyCommandPool(context.device, copy_command_pools[index], nullptr);
+
+        delete post_inputs[index];
     }
 
-    api.destroy_fences(submission_fences, virtual_frames_count);
-    api.destroy_semaphores(execution_semaphores, virtual_frames_count);
-    api.destroy_semaphores(acquire_semaphores, virtual_frames_count);
+    api.destroy_semaphore(frame_semaphore);
+    api.destroy_semaphores(execution_semaphores.data(), virtual_frames_count);
+    api.destroy_semaphores(acquire_semaphores.data(), virtual_frames_count);
+    api.destroy_semaphores(traced_semaphores.data(), virtual_frames_count);
 
-    vkFreeCommandBuffers(context.device, graphics_command_pool, virtual_frames_count, graphics_command_buffers);
+    vkFreeCommandBuffers(context.device, graphics_command_pool, virtual_frames_count, graphics_command_buffers.data());
     vkDestroyCommandPool(context.device, graphics_command_pool, nullptr);
 
+    vkFreeCommandBuffers(context.device, compute_command_pool, virtual_frames_count, compute_command_buffers.data());
+    vkDestroyCommandPool(context.device, compute_command_pool, nullptr);
 
-    api.destroy_pipeline(tonemapping_pipeline);
 
     api.destroy_swapchain(swapchain);
     api.destroy_surface(platform_surface);
 }
 void vkrenderer::recreate_swapchain() {
-    VKRESULT(vkWaitForFences(context.device, vkrenderer::virtual_frames_count, submission_fences, VK_TRUE, UINT64_MAX))
+    api.wait_semaphore(frame_semaphore, submitted_frames);
 
     auto swapchain_image_usages = api.get_image(swapchain.images[0]).usages;
     struct swapchain old_swapchain = swapchain;
@@ -102,34 +139,79 @@ void vkrenderer::recreate_swapchain() {
 }
 
 void vkrenderer::queue_image_update(Texture* texture) {
+    if (texture->async_upload) {
+        uploads.queue_image(texture);
+        return;
+    }
+
+    texture->upload_pending = true;
     upload_queue.push_back(texture);
 }
 
+void vkrenderer::cancel_image_update(const Texture* texture) {
+    std::erase(upload_queue, texture);
+}
+
+void vkrenderer::queue_buffer_update(const Buffer* buffer, const void* data, size_t offset, size_t size) {
+    uploads.queue_buffer(buffer, data, offset, size);
+}
+
+void vkrenderer::flush_uploads() {
+    // Each round acquires the batches done and refills them, the ring of batches stays busy
+    while (!uploads.idle()) {
+        begin_frame();
+        frame_numbers[virtual_frame_index] = ++submitted_frames;
+        VKRESULT(api.submit(recorded_command_buffers.data(), recorded_command_buffers.size(), VK_NULL_HANDLE, VK_NULL_HANDLE, { uploads.semaphore(), uploads.acquired_value() }, { frame_semaphore, submitted_frames }))
+        virtual_frame_index = (virtual_frame_index + 1) % virtual_frames_count;
+
+        uploads.wait();
+    }
+}
+
 void vkrenderer::update_images() {
-    if(upload_queue.empty())
+    if(upload_queue.empty() && uploads.idle())
         return;
 
-    auto* staging_buffer = staging_buffers[virtual_frame_index];
-    staging_buffer->reset();
-
     VkCommandBuffer command_buffer = copy_command_buffers[virtual_frame_index];
     vkrenderer::api.start_record(command_buffer);
 
+    // Hands the batches done on the transfer queue to this frame, and keeps it fed
+    uploads.update(command_buffer);
+
+    auto* staging_buffer = staging_buffers[virtual_frame_index];
+    staging_buffer->reset();
+
     while(!upload_queue.empty()) {
         auto* texture = upload_queue.back();
         auto texture_size = texture->size();
-        auto offset = staging_buffer->alloc(texture_size);
+        // Copies of compressed images start on a whole block
+        auto offset = staging_buffer->alloc((texture_size + 15) & ~(size_t)15);
 
         if (offset == RingBuffer::invalid_alloc)
             break;
 
         upload_queue.pop_back();
 
-        staging_buffer->write(texture->data, offset, texture_size);
-
-        vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, texture->device_image);
-        vkrenderer::api.copy_buffer(command_buffer, staging_buffer->device_buffer, texture->device_image, 0, offset);
-        vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, texture->device_image);
+        const auto& image = vkrenderer::api.get_image(texture->device_image);
+        staging_buffer->write((uint8_t*)texture->data + texture->data_offset(image.format, texture->first_level), offset, texture_size);
+
+        vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, texture->device_image);
+        if (texture->data_levels > 1) {
+            // Image level 0 is the level first_level of the chain held by data
+            auto level_offset = offset;
+            for (uint32_t level { 0U }; level < image.subresource_range.levelCount; level++) {
+                vkrenderer::api.copy_buffer(command_buffer, staging_buffer->device_buffer, texture->device_image, 0, level_offset, level);
+                auto chain_level = texture->first_level + level;
+                level_offset += Texture::level_size(image.format, Texture::level_extent(texture->width, chain_level), Texture::level_extent(texture->height, chain_level)) * texture->layers;
+            }
+        } else {
+            vkrenderer::api.copy_buffer(command_buffer, staging_buffer->device_buffer, texture->device_image, 0, offset);
+            if (image.subresource_range.levelCount > 1) {
+                vkrenderer::api.generate_mipmaps(command_buffer, texture->device_image);
+            }
+        }
+        vkrenderer::api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, texture->device_image);
+        texture->upload_pending = false;
     }
 
     vkrenderer::api.end_record(command_buffer);
@@ -149,15 +231,47 @@ Buffer* vkrenderer::create_staging_buffer(size_t size) {
     return new Buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
 }
 
-Texture* vkrenderer::create_2d_texture(size_t width, size_t height, VkFormat format, Sampler *sampler) {
-    return new Texture(width, height, 1, format, sampler);
+Buffer* vkrenderer::create_counter_buffer(size_t size) {
+    return new Buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+}
+
+Buffer* vkrenderer::create_scene_buffer(size_t size) {
+    return new Buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, device_local_scene_data);
+}
+
+Texture* vkrenderer::create_2d_texture(size_t width, size_t height, VkFormat format, Sampler *sampler, uint32_t mip_levels) {
+    return new Texture(width, height, 1, format, sampler, mip_levels);
+}
+
+Texture* vkrenderer::create_2d_texture_array(size_t width, size_t height, size_t layers, VkFormat format) {
+    auto image = api.create_image(
+        { .width = (uint32_t)width, .height = (uint32_t)height, .depth = 1 },
+        format,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+        (uint32_t)layers
+    );
+
+    return new Texture(image);
 }
 
-// TODO: Check if a similar sampler has been allocated
 Sampler* vkrenderer::create_sampler(VkFilter filter, VkSamplerAddressMode address_mode) {
-    auto* sampler = new Sampler();
+    return create_sampler({
+        .mag_filter = filter,
+        .min_filter = filter,
+        .mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .address_mode_u = address_mode,
+        .address_mode_v = address_mode,
+    });
+}
 
-    sampler->device_sampler = api.create_sampler(filter, address_mode);
+Sampler* vkrenderer::create_sampler(const sampler_settings& settings) {
+    auto& sampler = sampler_cache[settings];
+    if (sampler == nullptr) {
+        sampler = new Sampler();
+        sampler->device_sampler = api.create_sampler(settings);
+        sampler->settings = settings;
+    }
 
     return sampler;
 }
@@ -168,6 +282,38 @@ ComputeRenderpass* vkrenderer::create_compute_renderpass() {
     return (ComputeRenderpass*)renderpasses.back();
 }
 
+ComputeRenderpass* vkrenderer::create_post_renderpass() {
+    post_renderpasses.push_back(new ComputeRenderpass(api));
+
+    return (ComputeRenderpass*)post_renderpasses.back();
+}
+
+Texture* vkrenderer::post_input(Texture* traced) {
+    if (!async_post_processing()) {
+        return traced;
+    }
+
+    traced_texture = traced;
+
+    auto*& input = post_inputs[virtual_frame_index];
+    auto format = api.get_image(traced->device_image).format;
+    if (input == nullptr || input->width != traced->width || input->height != traced->height || input->layers != traced->layers || api.get_image(input->device_image).format != format) {
+        // The frame that last read it is the one begin_frame waited for
+        api.wait_semaphore(frame_semaphore, frame_numbers[virtual_frame_index]);
+
+        delete input;
+        input = create_2d_texture_array(traced->width, traced->height, traced->layers, format);
+    }
+
+    return input;
+}
+
+WavefrontRenderpass* vkrenderer::create_wavefront_renderpass() {
+    renderpasses.push_back(new WavefrontRenderpass(api));
+
+    return (WavefrontRenderpass*)renderpasses.back();
+}
+
 PrimitiveRenderpass* vkrenderer::create_primitive_renderpass() {
     renderpasses.push_back(new PrimitiveRenderpass(api));
 
@@ -183,45 +329,102 @@ void vkrenderer::render() {
     auto acquire_result = vkAcquireNextImageKHR(context.device, swapchain.handle, UINT64_MAX, acquire_semaphores[virtual_frame_index], VK_NULL_HANDLE, &swapchain_image_index);
     handle_swapchain_result(acquire_result);
 
+    // Descriptors of the resources created since the last frame, before the passes index them
+    api.flush_descriptor_writes();
+
     api.start_record(graphics_command_buffers[virtual_frame_index]);
 
     auto* cmd_buf = graphics_command_buffers[virtual_frame_index];
 
+    // The present pass stores the displayed image straight into the swapchain
+    assert(present_pass != nullptr);
+    present_pass->set_ouput_texture(back_buffer());
+
     // wait for transfer operations
 
     for (auto& renderpass: renderpasses) {
         renderpass->execute(*this, cmd_buf);
+    }
 
-        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, ((ComputeRenderpass*)renderpass)->output_texture->device_image);
+    // api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, swapchain.images[swapchain_image_index]);
 
-        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, swapchain.images[swapchain_image_index]);
+    // renderpasses[1]->execute(*this, cmd_buf);
 
-        api.blit_full(cmd_buf, ((ComputeRenderpass*)renderpass)->output_texture->device_image, swapchain.images[swapchain_image_index]);
-    }
+    post_recorded = async_post_processing() && !post_renderpasses.empty();
+    if (!post_recorded) {
+        for (auto& renderpass: post_renderpasses) {
+            renderpass->execute(*this, cmd_buf);
+        }
 
+        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, swapchain.images[swapchain_image_index]);
 
-    // api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, swapchain.images[swapchain_image_index]);
+        api.end_record(cmd_buf);
 
-    // renderpasses[1]->execute(*this, cmd_buf);
+        recorded_command_buffers.push_back(cmd_buf);
+        return;
+    }
 
-    api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, swapchain.images[swapchain_image_index]);
+    auto graphics_family = context.graphics_queue.index;
+    auto compute_family = context.compute_queue.index;
+    auto* input = post_inputs[virtual_frame_index];
+
+    // The post passes read a copy, the next frame can trace over the original. The frame that read the copy
+    // before is the one begin_frame waited for, its contents are dropped
+    if (traced_texture != nullptr) {
+        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, traced_texture->device_image);
+        api.discard_image(input->device_image);
+        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, input->device_image);
+        api.copy_image(cmd_buf, traced_texture->device_image, input->device_image);
+        api.image_barrier(cmd_buf, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, input->device_image, graphics_family, compute_family);
+    }
 
     api.end_record(cmd_buf);
 
     recorded_command_buffers.push_back(cmd_buf);
+
+    auto* post_cmd_buf = compute_command_buffers[virtual_frame_index];
+    api.start_record(post_cmd_buf);
+
+    if (traced_texture != nullptr) {
+        api.image_barrier(post_cmd_buf, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, input->device_image, graphics_family, compute_family);
+        traced_texture = nullptr;
+    }
+
+    for (auto& renderpass: post_renderpasses) {
+        renderpass->execute(*this, post_cmd_buf);
+    }
+
+    // The swapchain images are shared by both families
+    api.image_barrier(post_cmd_buf, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, swapchain.images[swapchain_image_index]);
+
+    api.end_record(post_cmd_buf);
 }
 
 void vkrenderer::begin_frame() {
     recorded_command_buffers.clear();
 
-    VKRESULT(vkWaitForFences(context.device, 1, &submission_fences[virtual_frame_index], VK_TRUE, UINT64_MAX))
-    VKRESULT(vkResetFences(context.device, 1, &submission_fences[virtual_frame_index]))
+    // Only blocks once the frames in flight are all still running on the GPU
+    auto wait_start = std::chrono::high_resolution_clock::now();
+    api.wait_semaphore(frame_semaphore, frame_numbers[virtual_frame_index]);
+    frame_wait_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - wait_start).count();
 
     update_images();
 }
 
 void vkrenderer::finish_frame() {
-    api.submit(recorded_command_buffers.data(), recorded_command_buffers.size(), acquire_semaphores[virtual_frame_index], execution_semaphores[virtual_frame_index], submission_fences[virtual_frame_index]);
+    frame_numbers[virtual_frame_index] = ++submitted_frames;
+    timeline_point frame_done { frame_semaphore, submitted_frames };
+
+    if (post_recorded) {
+        // The frame is done once the compute queue is, its submission waits for the graphics one
+        api.submit(recorded_command_buffers.data(), recorded_command_buffers.size(), VK_NULL_HANDLE, traced_semaphores[virtual_frame_index], { uploads.semaphore(), uploads.acquired_value() });
+
+        VkSemaphore post_wait_semaphores[] = { traced_semaphores[virtual_frame_index], acquire_semaphores[virtual_frame_index] };
+        api.submit_compute(compute_command_buffers[virtual_frame_index], post_wait_semaphores, 2, execution_semaphores[virtual_frame_index], frame_done);
+        post_recorded = false;
+    } else {
+        api.submit(recorded_command_buffers.data(), recorded_command_buffers.size(), acquire_semaphores[virtual_frame_index], execution_semaphores[virtual_frame_index], { uploads.semaphore(), uploads.acquired_value() }, frame_done);
+    }
 
     auto present_result = api.present(swapchain, swapchain_image_index, execution_semaphores[virtual_frame_index]);
     handle_swapchain_result(present_result);
@@ -245,9 +448,9 @@ void vkrenderer::handle_swapchain_result(VkResult function_result) {
 
 
 
-Buffer::Buffer(size_t size, VkBufferUsageFlagBits usage)
-    : buffer_size(size), usage(usage) {
-    device_buffer = vkrenderer::api.create_buffer(size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+Buffer::Buffer(size_t size, VkBufferUsageFlags usage, bool device_local)
+    : buffer_size(size), usage(usage), device_local(device_local) {
+    device_buffer = vkrenderer::api.create_buffer(size, usage, device_local ? VMA_MEMORY_USAGE_GPU_ONLY : VMA_MEMORY_USAGE_CPU_TO_GPU);
 }
 
 Buffer::~Buffer() {
@@ -255,12 +458,18 @@ Buffer::~Buffer() {
 }
 
 void Buffer::write(void* data, off_t alloc_offset, size_t data_size) const {
+    if (device_local) {
+        vkrenderer::queue_buffer_update(this, data, alloc_offset, data_size);
+        return;
+    }
+
     auto api_buffer = vkrenderer::api.get_buffer(device_buffer);
 
     std::memcpy((uint8_t*)api_buffer.device_ptr + alloc_offset, data, data_size);
 }
 
 void Buffer::resize(size_t new_size) {
+    assert(!device_local && "device local buffers are not mapped");
     auto old_device_buffer = device_buffer;
     new_size = static_cast<uint32_t>(exp2(ceil(log2((double)new_size))));
 
@@ -0,0 +1,173 @@
+#include "wavefront-renderpass.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include <vk_mem_alloc.h>
+
+#include "vk-renderer.hpp"
+
+// Layouts of path, path_hit and the radiance in shaders/include/wavefront.h
+static constexpr size_t path_size = 64;
+static constexpr size_t hit_size = 16;
+static constexpr size_t radiance_size = 16;
+
+static constexpr uint32_t rays_group_size = 64;
+
+static constexpr VkPipelineStageFlags stage_flags = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+static constexpr VkAccessFlags access_flags = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+WavefrontRenderpass::WavefrontRenderpass(vkapi& api)
+    : Renderpass(api)
+{
+    raygen_pipeline = api.create_compute_pipeline("wavefront_raygen");
+    extend_pipeline = api.create_compute_pipeline("wavefront_extend");
+    shade_pipeline = api.create_compute_pipeline("wavefront_shade");
+    bin_count_pipeline = api.create_compute_pipeline("wavefront_bin_count");
+    bin_scatter_pipeline = api.create_compute_pipeline("wavefront_bin_scatter");
+    advance_pipeline = api.create_compute_pipeline("wavefront_advance");
+    accumulate_pipeline = api.create_compute_pipeline("wavefront_accumulate");
+
+    state_buffer = api.create_buffer(sizeof(wavefront_state), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const auto address = api.get_buffer(state_buffer).device_address;
+    memcpy(constants + 56, &address, sizeof(VkDeviceAddress));
+}
+
+WavefrontRenderpass::~WavefrontRenderpass() {
+    destroy_queues();
+    api.destroy_buffer(state_buffer);
+
+    api.destroy_pipeline(raygen_pipeline);
+    api.destroy_pipeline(extend_pipeline);
+    api.destroy_pipeline(shade_pipeline);
+    api.destroy_pipeline(bin_count_pipeline);
+    api.destroy_pipeline(bin_scatter_pipeline);
+    api.destroy_pipeline(advance_pipeline);
+    api.destroy_pipeline(accumulate_pipeline);
+}
+
+void WavefrontRenderpass::resize(size_t width, size_t height, size_t view_count) {
+    destroy_queues();
+
+    path_capacity = (uint32_t)(width * height * view_count);
+    set_render_extent(width, height, view_count);
+
+    paths_buffers[0] = api.create_buffer(path_capacity * path_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    paths_buffers[1] = api.create_buffer(path_capacity * path_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    hits_buffer = api.create_buffer(path_capacity * hit_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    keys_buffer = api.create_buffer(path_capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    order_buffer = api.create_buffer(path_capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    radiance_buffer = api.create_buffer(path_capacity * radiance_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    has_queues = true;
+}
+
+void WavefrontRenderpass::set_render_extent(size_t width, size_t height, size_t view_count) {
+    assert(width * height * view_count <= path_capacity);
+
+    group_count_x = (width + 7) / 8;
+    group_count_y = (height + 7) / 8;
+    group_count_z = view_count;
+    path_count = (uint32_t)(width * height * view_count);
+}
+
+void WavefrontRenderpass::destroy_queues() {
+    if (!has_queues)
+        return;
+
+    api.destroy_buffer(paths_buffers[0]);
+    api.destroy_buffer(paths_buffers[1]);
+    api.destroy_buffer(hits_buffer);
+    api.destroy_buffer(keys_buffer);
+    api.destroy_buffer(order_buffer);
+    api.destroy_buffer(radiance_buffer);
+    has_queues = false;
+}
+
+void WavefrontRenderpass::set_ouput_texture(Texture* out_texture) {
+    this->output_texture = out_texture;
+}
+
+void WavefrontRenderpass::set_constant(off_t offset, Buffer* buffer, size_t buffer_offset) {
+    auto device_buffer = api.get_buffer(buffer->device_buffer);
+    VkDeviceAddress address = device_buffer.device_address + buffer_offset;
+    memcpy(constants + offset, (void*)&address, sizeof(VkDeviceAddress));
+}
+
+void WavefrontRenderpass::add_input_texture(Texture* texture) {
+    input_textures.push_back(texture);
+}
+
+void WavefrontRenderpass::stage_barrier(VkCommandBuffer command_buffer) {
+    api.memory_barrier(command_buffer, stage_flags, access_flags, stage_flags, access_flags);
+}
+
+void WavefrontRenderpass::dispatch_rays(VkCommandBuffer command_buffer, pipeline& stage) {
+    api.run_compute_pipeline_indirect(command_buffer, stage, state_buffer, offsetof(wavefront_state, dispatch_args));
+    stage_barrier(command_buffer);
+}
+
+void WavefrontRenderpass::sort_rays(VkCommandBuffer command_buffer) {
+    dispatch_rays(command_buffer, bin_count_pipeline);
+    dispatch_rays(command_buffer, bin_scatter_pipeline);
+}
+
+void WavefrontRenderpass::execute(vkrenderer&, VkCommandBuffer command_buffer) {
+    assert(has_queues);
+
+    api.update_constants(command_buffer, VK_SHADER_STAGE_COMPUTE_BIT, 0, 64, (void*)&constants);
+
+    for (auto& texture: input_textures) {
+        api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, texture->device_image);
+    }
+
+    api.image_barrier(command_buffer, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, output_texture->device_image);
+
+    // Every path is alive after raygen. The state lives in device memory, so it is
+    // reset from the command buffer once the previous frame's stages are done with it
+    wavefront_state state {
+        .dispatch_args = { (path_count + rays_group_size - 1U) / rays_group_size, 1U, 1U },
+        .ray_count = path_count,
+        .next_ray_count = 0U,
+        .path_count = path_count,
+        .accumulation_image_index = api.get_image(output_texture->device_image).bindless_storage_index,
+        .bin_mode = (uint32_t)bin_mode,
+        .bin_counts = {},
+        .bin_cursors = {},
+        .current = api.get_buffer(paths_buffers[0]).device_address,
+        .next = api.get_buffer(paths_buffers[1]).device_address,
+        .hits = api.get_buffer(hits_buffer).device_address,
+        .keys = api.get_buffer(keys_buffer).device_address,
+        .order = api.get_buffer(order_buffer).device_address,
+        .radiance = api.get_buffer(radiance_buffer).device_address,
+    };
+
+    api.memory_barrier(command_buffer, stage_flags, access_flags, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    api.update_buffer(command_buffer, state_buffer, 0, sizeof(state), &state);
+    api.memory_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, stage_flags, access_flags);
+
+    api.run_compute_pipeline(command_buffer, raygen_pipeline, group_count_x, group_count_y, group_count_z);
+    stage_barrier(command_buffer);
+
+    for (uint32_t bounce { 0U }; bounce < bounce_count; bounce++) {
+        if (bin_mode == BIN_MODE::DIRECTION) {
+            sort_rays(command_buffer);
+        }
+
+        dispatch_rays(command_buffer, extend_pipeline);
+
+        if (bin_mode == BIN_MODE::MATERIAL) {
+            sort_rays(command_buffer);
+        }
+
+        dispatch_rays(command_buffer, shade_pipeline);
+
+        api.run_compute_pipeline(command_buffer, advance_pipeline, 1, 1, 1);
+        stage_barrier(command_buffer);
+    }
+
+    api.run_compute_pipeline(command_buffer, accumulate_pipeline, group_count_x, group_count_y, group_count_z);
+
+    input_textures.clear();
+}
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "brdf-lanes.hpp"
+#include "brdf.hpp"
+#include "utils.hpp"
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* message, size_t lane) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << " (lane " << lane << ")" << std::endl;
+        failures++;
+    }
+}
+
+static bool close(float expected, float value) {
+    return std::abs(expected - value) <= 1e-4f * std::max(1.f, std::abs(expected));
+}
+
+// Hit shaded in tangent space and the sample the bounce loop of integrator.h takes for it
+struct reference_sample {
+    float       view[3];
+    float       base_color[3];
+    float       metalness;
+    float       roughness;
+    float       random[3];
+
+    BRDF_TYPE   type;
+    float       direction[3];
+    float       weight[3];
+};
+
+// Worked out by hand from the formulas of shaders/include/brdf.h and integrator.h
+static const reference_sample references[] = {
+    // Diffuse lobe picked over a specular probability of 0.1044: weight is the base color over 1 - p,
+    // direction the hemisphere sample at (0.5, 0.25)
+    {
+        { 0.f, 0.f, 1.f }, { 0.5f, 0.25f, 1.f }, 0.f, 1.f, { 0.95f, 0.5f, 0.25f },
+        DIFFUSE, { 0.f, 0.70710678f, 0.70710678f }, { 0.55830768f, 0.27915384f, 1.11661536f },
+    },
+    // Smooth dielectric, specular lobe at the 0.1 probability floor: mirror direction and Schlick
+    // fresnel at H.L = 0.8 over p, G1 is 1 without roughness
+    {
+        { 0.6f, 0.f, 0.8f }, { 0.8f, 0.6f, 0.4f }, 0.f, 0.f, { 0.05f, 0.3f, 0.7f },
+        SPECULAR, { -0.6f, 0.f, 0.8f }, { 8.00064f, 6.00128f, 4.00192f },
+    },
+    // Rough half metal, specular lobe of probability 0.6056: the VNDF half vector at (0.3, 0.7) with alpha 0.25
+    {
+        { 0.6f, 0.f, 0.8f }, { 0.9f, 0.5f, 0.2f }, 0.5f, 0.5f, { 0.05f, 0.3f, 0.7f },
+        SPECULAR, { -0.20574654f, -0.10188433f, 0.97328718f }, { 0.74245704f, 0.41248053f, 0.16499815f },
+    },
+    // Seen from below the surface, the path ends
+    {
+        { 0.6f, 0.f, -0.8f }, { 0.5f, 0.5f, 0.5f }, 0.f, 0.5f, { 0.5f, 0.5f, 0.5f },
+        SPECULAR, { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f },
+    },
+};
+
+static constexpr size_t reference_count = sizeof(references) / sizeof(references[0]);
+
+static brdf_lanes reference_lanes() {
+    brdf_lanes lanes;
+    lanes.resize(reference_count);
+
+    // The kernels run on whole SIMD widths, padding lanes repeat the last reference
+    for (size_t lane { 0U }; lane < brdf_lanes::width; lane++) {
+        const auto& sample = references[std::min(lane, reference_count - 1U)];
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            lanes.view[axis][lane] = sample.view[axis];
+            lanes.base_color[axis][lane] = sample.base_color[axis];
+            lanes.random[axis][lane] = sample.random[axis];
+        }
+        lanes.metalness[lane] = sample.metalness;
+        lanes.roughness[lane] = sample.roughness;
+    }
+
+    return lanes;
+}
+
+static void check_references(const brdf_lanes& lanes, const char* kernel) {
+    for (size_t lane { 0U }; lane < reference_count; lane++) {
+        const auto& sample = references[lane];
+
+        auto has_weight = false;
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            check(close(sample.weight[axis], lanes.weight[axis][lane]), kernel, lane);
+            has_weight |= sample.weight[axis] != 0.f;
+        }
+
+        // A path ending has no direction nor lobe worth comparing
+        if (!has_weight) {
+            continue;
+        }
+
+        check(sample.type == lanes.type[lane], kernel, lane);
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            check(close(sample.direction[axis], lanes.direction[axis][lane]), kernel, lane);
+        }
+    }
+}
+
+// Random hits through both kernels, they have to agree wherever the reference values do not reach
+static void check_kernels_agree(size_t count, uint32_t seed) {
+    brdf_lanes scalar;
+    scalar.resize(count);
+    for (size_t lane { 0U }; lane < count; lane++) {
+        // Mostly above the hemisphere, sometimes grazing or below it
+        auto view_local = sample_hemisphere(randf(seed), randf(seed));
+        view_local.v[2] -= 0.1f * randf(seed);
+        view_local.normalize();
+
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            scalar.view[axis][lane] = view_local.v[axis];
+            scalar.base_color[axis][lane] = randf(seed);
+            scalar.random[axis][lane] = randf(seed);
+        }
+
+        // Exercise the pure mirror and the perfectly smooth dielectric paths too
+        auto material_kind = randf(seed);
+        scalar.metalness[lane] = material_kind < 0.1f ? 1.f : randf(seed);
+        scalar.roughness[lane] = material_kind < 0.2f ? 0.f : randf(seed);
+    }
+
+    auto simd = scalar;
+    sample_brdf_scalar(scalar, 0U, count);
+    for (size_t first { 0U }; first < count; first += brdf_lanes::width) {
+        sample_brdf_avx2(simd, first);
+    }
+
+    for (size_t lane { 0U }; lane < count; lane++) {
+        // Rounding may pick the other lobe when the random number sits on the probability
+        color base_color { scalar.base_color[0][lane], scalar.base_color[1][lane], scalar.base_color[2][lane] };
+        vec3 view_local { scalar.view[0][lane], scalar.view[1][lane], scalar.view[2][lane] };
+        auto brdf_probability = get_brdf_probability(base_color, scalar.metalness[lane], view_local, vec3 { 0.f, 0.f, 1.f });
+        if (std::abs(scalar.random[0][lane] - brdf_probability) < 1e-4f) {
+            continue;
+        }
+
+        check(scalar.type[lane] == simd.type[lane], "avx2 and scalar lobes", lane);
+
+        auto has_weight = false;
+        for (uint32_t axis { 0U }; axis < 3U; axis++) {
+            check(close(scalar.weight[axis][lane], simd.weight[axis][lane]), "avx2 and scalar weights", lane);
+            has_weight |= scalar.weight[axis][lane] != 0.f;
+        }
+
+        for (uint32_t axis { 0U }; has_weight && axis < 3U; axis++) {
+            check(close(scalar.direction[axis][lane], simd.direction[axis][lane]), "avx2 and scalar directions", lane);
+        }
+    }
+}
+
+int main() {
+    auto scalar = reference_lanes();
+    sample_brdf_scalar(scalar, 0U, scalar.count);
+    check_references(scalar, "scalar kernel against the reference values");
+
+    if (supports_avx2()) {
+        auto simd = reference_lanes();
+        sample_brdf_avx2(simd, 0U);
+        check_references(simd, "avx2 kernel against the reference values");
+
+        check_kernels_agree(4096U, 1U);
+    } else {
+        std::cout << "brdf lanes: no AVX2 on this CPU, only the scalar kernel was checked" << std::endl;
+    }
+
+    if (failures > 0U) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "brdf lanes: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
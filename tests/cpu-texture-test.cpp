@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "cpu-texture.hpp"
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+static bool close(const color& a, const color& b, float tolerance) {
+    return (a - b).length() <= tolerance;
+}
+
+// Texels that differ in every channel, so a texel read from the wrong place of a tile shows
+static std::vector<uint32_t> scrambled_texels(uint32_t width, uint32_t height) {
+    std::vector<uint32_t> rgba((size_t)width * height);
+    for (uint32_t y { 0U }; y < height; y++) {
+        for (uint32_t x { 0U }; x < width; x++) {
+            auto r = (x * 37U + y * 11U) & 0xffU;
+            auto g = (x * 5U + y * 53U + 17U) & 0xffU;
+            auto b = (x * y * 13U + 101U) & 0xffU;
+            rgba[(size_t)y * width + x] = r | (g << 8U) | (b << 16U) | (255U << 24U);
+        }
+    }
+    return rgba;
+}
+
+static color unpack(uint32_t texel) {
+    return { (float)(texel & 0xffU) / 255.f, (float)((texel >> 8U) & 0xffU) / 255.f, (float)((texel >> 16U) & 0xffU) / 255.f };
+}
+
+// Reads one texel of a level through the nearest filters, at the center of the texel
+static color texel(const cpu_texture& texture, uint32_t level, uint32_t width, uint32_t height, int64_t x, int64_t y) {
+    const cpu_sampler nearest { .nearest_mag = true, .nearest_min = true, .nearest_mip = true };
+    return texture.sample(((float)x + 0.5f) / (float)width, ((float)y + 0.5f) / (float)height, (float)level, nearest);
+}
+
+static uint32_t repeat(int64_t x, uint32_t size) {
+    auto wrapped = x % (int64_t)size;
+    return (uint32_t)(wrapped < 0 ? wrapped + size : wrapped);
+}
+
+// Bilinear lookup of a level built from its texels, with repeat addressing
+static color reference_bilinear(const cpu_texture& texture, uint32_t level, uint32_t width, uint32_t height, float u, float v) {
+    auto x = u * (float)width - 0.5f;
+    auto y = v * (float)height - 0.5f;
+    auto x0 = (int64_t)std::floor(x);
+    auto y0 = (int64_t)std::floor(y);
+    auto fx = x - std::floor(x);
+    auto fy = y - std::floor(y);
+
+    auto at = [&](int64_t tap_x, int64_t tap_y) {
+        return texel(texture, level, width, height, repeat(tap_x, width), repeat(tap_y, height));
+    };
+    return lerp(lerp(at(x0, y0), at(x0 + 1, y0), fx), lerp(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx), fy);
+}
+
+static void check_texture(uint32_t width, uint32_t height) {
+    auto source = scrambled_texels(width, height);
+    cpu_texture texture { source.data(), width, height };
+
+    // Partial tiles on the right and bottom edges hold padding the lookups never reach
+    bool exact = true;
+    for (uint32_t y { 0U }; y < height; y++) {
+        for (uint32_t x { 0U }; x < width; x++) {
+            exact = exact && close(texel(texture, 0U, width, height, x, y), unpack(source[(size_t)y * width + x]), 0.f);
+        }
+    }
+    check(exact, "every texel of level 0 is the source texel");
+
+    // Each level averages 2x2 texels of the one above, the last row and column repeated on odd sizes
+    std::vector<uint32_t> level_widths { width };
+    std::vector<uint32_t> level_heights { height };
+    while (level_widths.back() > 1U || level_heights.back() > 1U) {
+        level_widths.push_back(std::max(level_widths.back() / 2U, 1U));
+        level_heights.push_back(std::max(level_heights.back() / 2U, 1U));
+    }
+    check(texture.levels_count() == level_widths.size(), "every level down to 1x1 is built");
+
+    bool averaged = true;
+    for (uint32_t level { 1U }; level < level_widths.size(); level++) {
+        auto parent_width = level_widths[level - 1U];
+        auto parent_height = level_heights[level - 1U];
+        for (uint32_t y { 0U }; y < level_heights[level]; y++) {
+            for (uint32_t x { 0U }; x < level_widths[level]; x++) {
+                uint32_t sum[3] = {};
+                for (uint32_t tap { 0U }; tap < 4U; tap++) {
+                    auto parent_x = std::min(x * 2U + (tap & 1U), parent_width - 1U);
+                    auto parent_y = std::min(y * 2U + (tap >> 1U), parent_height - 1U);
+                    auto parent = texel(texture, level - 1U, parent_width, parent_height, parent_x, parent_y);
+                    for (int channel { 0 }; channel < 3; channel++) {
+                        sum[channel] += (uint32_t)std::lround(parent[channel] * 255.f);
+                    }
+                }
+
+                color expected { (float)((sum[0] + 2U) / 4U) / 255.f, (float)((sum[1] + 2U) / 4U) / 255.f, (float)((sum[2] + 2U) / 4U) / 255.f };
+                averaged = averaged && close(texel(texture, level, level_widths[level], level_heights[level], x, y), expected, 1e-6f);
+            }
+        }
+    }
+    check(averaged, "every texel of a level is the 2x2 average of the level above");
+
+    // Inside the texture, on texel centers and across the repeated edges
+    const float coordinates[][2] = { { 0.5f, 0.5f }, { 0.13f, 0.71f }, { 0.f, 0.f }, { 0.99f, 0.02f }, { -0.27f, 1.38f }, { 2.61f, -3.4f } };
+    bool filtered = true;
+    for (uint32_t level { 0U }; level < level_widths.size(); level++) {
+        for (const auto& uv : coordinates) {
+            auto expected = reference_bilinear(texture, level, level_widths[level], level_heights[level], uv[0], uv[1]);
+            filtered = filtered && close(texture.sample(uv[0], uv[1], (float)level), expected, 1e-5f);
+        }
+    }
+    check(filtered, "sampling at an integer lod is the bilinear lookup of that level");
+    check(close(texture.sample(0.37f, 0.58f), texture.sample(0.37f, 0.58f, 0.f), 0.f), "the base level lookup is lod 0");
+}
+
+int main() {
+    // Odd sizes with partial tiles, one wider than two tiles and one shorter than a tile
+    check_texture(13U, 11U);
+    check_texture(21U, 3U);
+    check_texture(1U, 1U);
+
+    if (failures > 0U) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "cpu texture: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "bvh.hpp"
+#include "ray-query.hpp"
+#include "utils.hpp"
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+static bool close(float expected, float value) {
+    return std::abs(expected - value) <= 1e-4f * std::max(1.f, std::abs(expected));
+}
+
+// Triangles laid out like scene::scene builds them, three vertices each in the order of the triangles
+struct test_scene {
+    void add(const vec3& p1, const vec3& p2, const vec3& p3) {
+        for (const auto& p: { p1, p2, p3 }) {
+            indices.push_back((uint32_t)indices.size());
+            positions.insert(positions.end(), { p.v[0], p.v[1], p.v[2] });
+        }
+        triangles.emplace_back(p1, p2, p3);
+    }
+
+    void build() {
+        bvh builder(triangles, nodes);
+    }
+
+    std::vector<triangle>           triangles;
+    std::vector<packed_bvh_node>    nodes;
+    std::vector<uint32_t>           indices;
+    std::vector<float>              positions;
+};
+
+int main() {
+    test_scene geometry;
+
+    // 0 and 1: unit quad at z = 5, 2: large triangle behind it at z = 10
+    geometry.add({ -1.f, -1.f, 5.f }, { 1.f, -1.f, 5.f }, { 1.f, 1.f, 5.f });
+    geometry.add({ -1.f, -1.f, 5.f }, { 1.f, 1.f, 5.f }, { -1.f, 1.f, 5.f });
+    geometry.add({ -8.f, -8.f, 10.f }, { 8.f, -8.f, 10.f }, { 0.f, 8.f, 10.f });
+
+    // Small triangles scattered behind, so the BVH has more than a few levels
+    uint32_t seed = 7U;
+    for (uint32_t triangle_index { 0U }; triangle_index < 512U; triangle_index++) {
+        vec3 center { randf(seed) * 40.f - 20.f, randf(seed) * 40.f - 20.f, 20.f + randf(seed) * 20.f };
+        geometry.add(center, center + vec3 { 0.5f, 0.f, 0.2f }, center + vec3 { 0.f, 0.5f, -0.2f });
+    }
+    geometry.build();
+
+    ray_query query { geometry.nodes, geometry.indices, geometry.positions };
+    const point3 origin { 0.f, 0.f, 0.f };
+
+    hit_info info;
+    check(query.closest_hit(ray { origin, vec3 { 0.1f, 0.1f, 1.f }, 0.001f, 1e15f }, info), "the ray through the quad hits");
+    check(info.primitive_id <= 1U, "the quad is the closest hit");
+    check(close(5.f, info.point.v[2]), "the hit point lies on the quad");
+    check(close(1.f, info.barycentrics.v[0] + info.barycentrics.v[1] + info.barycentrics.v[2]), "the barycentrics sum to 1");
+    check(close(1.f, std::abs(info.geometry_normal.v[2])), "the quad normal is along z");
+
+    check(query.closest_hit(ray { origin, vec3 { 0.25f, 0.f, 1.f }, 0.001f, 1e15f }, info), "the ray beside the quad hits");
+    check(info.primitive_id == 2U, "the large triangle is hit beside the quad");
+    check(close(10.f, info.point.v[2]), "the large triangle is hit at z = 10");
+
+    check(!query.closest_hit(ray { origin, vec3 { 0.f, 0.f, -1.f }, 0.001f, 1e15f }, info), "the ray away from the scene misses");
+    check(!query.any_hit(ray { origin, vec3 { 0.f, 0.f, 1.f }, 0.001f, 4.f }), "the quad is past max_t");
+    check(query.any_hit(ray { origin, vec3 { 0.f, 0.f, 1.f }, 0.001f, 6.f }), "the quad occludes before max_t");
+    check(!query.any_hit(ray { origin, vec3 { 0.f, 0.f, 1.f }, 6.f, 9.f }), "nothing lies between the quad and the triangle");
+
+    // The packet traversal over many chunks finds the same hits as the scalar one mirroring the shaders
+    std::vector<ray> rays;
+    for (uint32_t y { 0U }; y < 64U; y++) {
+        for (uint32_t x { 0U }; x < 64U; x++) {
+            vec3 direction { (float)x / 63.f * 2.f - 1.f, (float)y / 63.f * 2.f - 1.f, 1.f };
+            rays.emplace_back(origin, direction, 0.001f, x % 7U == 0U ? 7.f : 1e15f);
+        }
+    }
+
+    std::vector<hit_info> hits;
+    query.closest_hit(rays, hits);
+    std::vector<uint8_t> occluded;
+    query.any_hit(rays, occluded);
+
+    uint32_t mismatches = 0;
+    for (size_t ray_index { 0U }; ray_index < rays.size(); ray_index++) {
+        hit_info reference;
+        auto reference_hit = query.closest_hit(rays[ray_index], reference);
+
+        if (reference_hit != hits[ray_index].hit() || reference_hit != (occluded[ray_index] != 0U)) {
+            mismatches++;
+            continue;
+        }
+
+        // Different triangles may be kept on ties, the distance has to match though
+        if (reference_hit && reference.primitive_id != hits[ray_index].primitive_id && !close(reference.t, hits[ray_index].t)) {
+            mismatches++;
+        }
+    }
+    check(mismatches == 0U, "the packet traversal matches the scalar one");
+
+    if (failures > 0U) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "ray query: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "texture-cache.hpp"
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+// Payload filled from the seed, so each texture can be told apart after a reload
+static std::vector<uint8_t> payload(uint32_t seed, size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (size_t byte { 0U }; byte < size; byte++) {
+        bytes[byte] = (uint8_t)(seed * 31U + byte * 7U);
+    }
+    return bytes;
+}
+
+static void add(texture_cache& cache, uint32_t seed, const std::vector<uint8_t>& bytes) {
+    cache.add(seed, bytes.size(), {
+        .encoding = TEXTURE_ENCODING::BC7,
+        .width = seed,
+        .height = seed * 2U,
+        .levels = 3U,
+        .payload = bytes.data(),
+        .payload_size = bytes.size(),
+    });
+}
+
+// The texture of the seed is found with its size and payload
+static bool finds(const texture_cache& cache, uint32_t seed, const std::vector<uint8_t>& bytes) {
+    cached_texture texture {};
+    if (!cache.find(seed, bytes.size(), TEXTURE_ENCODING::BC7, texture)) {
+        return false;
+    }
+
+    return texture.width == seed && texture.height == seed * 2U && texture.levels == 3U &&
+           texture.payload_size == bytes.size() && std::equal(bytes.begin(), bytes.end(), texture.payload);
+}
+
+int main() {
+    auto path = std::filesystem::temp_directory_path() / "texture-cache-test.ptxc";
+    auto pending = path;
+    pending += ".pending";
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(pending);
+
+    // Odd sizes, so the payloads need the alignment padding
+    const auto first = payload(1U, 100U);
+    const auto second = payload(2U, 37U);
+    const auto third = payload(3U, 250U);
+    const auto fourth = payload(4U, 16U);
+
+    {
+        // Like the glTF loader, one cache saved after each scene load
+        texture_cache cache { path };
+        check(!finds(cache, 1U, first), "an empty cache finds nothing");
+
+        add(cache, 1U, first);
+        add(cache, 2U, second);
+        check(!finds(cache, 1U, first), "added textures are found once saved");
+        cache.save();
+        check(finds(cache, 1U, first) && finds(cache, 2U, second), "saved textures are found");
+
+        add(cache, 3U, third);
+        cache.save();
+        check(finds(cache, 1U, first) && finds(cache, 2U, second) && finds(cache, 3U, third), "a second save keeps every texture");
+    }
+
+    {
+        texture_cache cache { path };
+        check(finds(cache, 1U, first), "the first texture of the first save is mapped back");
+        check(finds(cache, 2U, second), "the second texture of the first save is mapped back");
+        check(finds(cache, 3U, third), "the texture of the second save is mapped back");
+        check(!finds(cache, 4U, fourth), "textures never added are not found");
+
+        // The pending container cannot be written where a directory stands
+        std::filesystem::create_directory(pending);
+        add(cache, 4U, fourth);
+        cache.save();
+        check(!finds(cache, 4U, fourth), "a failed save does not find the added texture");
+    }
+
+    {
+        texture_cache cache { path };
+        check(finds(cache, 1U, first) && finds(cache, 2U, second) && finds(cache, 3U, third), "a failed save keeps the container");
+        check(!finds(cache, 4U, fourth), "a failed save writes nothing");
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(pending);
+
+    if (failures > 0U) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "texture cache: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
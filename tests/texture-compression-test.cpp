@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "texture-compression.hpp"
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+struct image {
+    uint32_t                width;
+    uint32_t                height;
+    std::vector<uint8_t>    rgba;
+};
+
+static image flat_image(uint32_t width, uint32_t height) {
+    image flat { width, height, {} };
+    for (size_t texel { 0U }; texel < (size_t)width * height; texel++) {
+        flat.rgba.insert(flat.rgba.end(), { 200, 100, 50, 255 });
+    }
+    return flat;
+}
+
+// Ramp along the diagonal, the colors of a block stay on a line like mode 6 and BC4 fit them
+static image gradient_image(uint32_t width, uint32_t height) {
+    image gradient { width, height, {} };
+    for (uint32_t y { 0U }; y < height; y++) {
+        for (uint32_t x { 0U }; x < width; x++) {
+            auto t = (x + y) * 255U / std::max(width + height - 2U, 1U);
+            gradient.rgba.insert(gradient.rgba.end(), { (uint8_t)t, (uint8_t)(255U - t), (uint8_t)(t / 2U), 255U });
+        }
+    }
+    return gradient;
+}
+
+// Checkerboard of two colors, each block holds both
+static image two_color_image(uint32_t width, uint32_t height) {
+    image two_color { width, height, {} };
+    for (uint32_t y { 0U }; y < height; y++) {
+        for (uint32_t x { 0U }; x < width; x++) {
+            if ((x + y) % 2U == 0U) {
+                two_color.rgba.insert(two_color.rgba.end(), { 240, 30, 60, 255 });
+            } else {
+                two_color.rgba.insert(two_color.rgba.end(), { 20, 180, 90, 128 });
+            }
+        }
+    }
+    return two_color;
+}
+
+// Largest difference over the channels the format keeps, red and green only for BC5
+static uint32_t max_error(const uint8_t* expected, const uint8_t* decoded, uint32_t width, uint32_t height, BLOCK_FORMAT format) {
+    auto channels = format == BLOCK_FORMAT::BC7 ? 4U : 2U;
+    uint32_t error = 0U;
+    for (size_t texel { 0U }; texel < (size_t)width * height; texel++) {
+        for (uint32_t channel { 0U }; channel < channels; channel++) {
+            error = std::max(error, (uint32_t)std::abs((int32_t)expected[texel * 4U + channel] - (int32_t)decoded[texel * 4U + channel]));
+        }
+    }
+    return error;
+}
+
+// Encodes the mip chain, then decodes every level and compares it with the box filtered one
+static void check_round_trip(const image& source, BLOCK_FORMAT format, uint32_t tolerance, const char* message) {
+    auto encoded = encode_mip_chain(source.rgba.data(), source.width, source.height, format);
+    auto expected = rgba_mip_chain(source.rgba.data(), source.width, source.height);
+
+    auto width = source.width;
+    auto height = source.height;
+    size_t block_offset = 0U;
+    size_t rgba_offset = 0U;
+    for (uint32_t level { 0U }; level < encoded.levels; level++) {
+        std::vector<uint8_t> decoded((size_t)width * height * 4U);
+        if (format == BLOCK_FORMAT::BC7) {
+            decode_bc7(encoded.blocks.data() + block_offset, width, height, decoded.data());
+        } else {
+            decode_bc5(encoded.blocks.data() + block_offset, width, height, decoded.data());
+        }
+
+        auto error = max_error(expected.data() + rgba_offset, decoded.data(), width, height, format);
+        if (error > tolerance) {
+            std::cerr << "level " << level << " of " << width << "x" << height << ": error " << error << std::endl;
+            check(false, message);
+        }
+
+        block_offset += block_level_size(width, height);
+        rgba_offset += (size_t)width * height * 4U;
+        width = std::max(width / 2U, 1U);
+        height = std::max(height / 2U, 1U);
+    }
+
+    check(block_offset == encoded.blocks.size(), "the levels fill the encoded chain");
+}
+
+int main() {
+    // Partial blocks on the edges are padded to whole blocks
+    check(block_level_size(4U, 4U) == 16U, "a 4x4 level is one block");
+    check(block_level_size(1U, 1U) == 16U, "a 1x1 level takes a whole block");
+    check(block_level_size(5U, 3U) == 32U, "a 5x3 level is two blocks");
+    check(block_level_size(13U, 9U) == 192U, "a 13x9 level is 4x3 blocks");
+
+    // Every level down to 1x1
+    auto gradient = gradient_image(13U, 9U);
+    auto chain = encode_mip_chain(gradient.rgba.data(), gradient.width, gradient.height, BLOCK_FORMAT::BC7);
+    check(chain.levels == 4U, "13x9, 6x4, 3x2 and 1x1 are encoded");
+    check(chain.width == 13U && chain.height == 9U && chain.format == BLOCK_FORMAT::BC7, "the chain keeps the size and format of level 0");
+    auto wide = encode_mip_chain(gradient_image(256U, 64U).rgba.data(), 256U, 64U, BLOCK_FORMAT::BC5);
+    check(wide.levels == 9U, "256x64 has 9 levels");
+
+    // A flat block is only off by the shared p-bit for BC7, exact for BC5
+    check_round_trip(flat_image(8U, 8U), BLOCK_FORMAT::BC7, 1U, "flat BC7 round trip");
+    check_round_trip(flat_image(8U, 8U), BLOCK_FORMAT::BC5, 0U, "flat BC5 round trip");
+
+    // Both colors are the endpoints, only quantized to 7 bits and a p-bit
+    check_round_trip(two_color_image(8U, 8U), BLOCK_FORMAT::BC7, 2U, "two colors BC7 round trip");
+    check_round_trip(two_color_image(8U, 8U), BLOCK_FORMAT::BC5, 0U, "two colors BC5 round trip");
+
+    // Ramps are fitted by the palettes of 16 and 8 entries. The coarse levels hold the whole ramp
+    // in one block, off by up to half a palette step: 255 / 30 and 255 / 14
+    check_round_trip(gradient_image(32U, 32U), BLOCK_FORMAT::BC7, 9U, "gradient BC7 round trip");
+    check_round_trip(gradient_image(32U, 32U), BLOCK_FORMAT::BC5, 19U, "gradient BC5 round trip");
+
+    // Sizes that are not multiples of 4, on every level of the chain
+    check_round_trip(gradient, BLOCK_FORMAT::BC7, 24U, "13x9 BC7 round trip");
+    check_round_trip(gradient, BLOCK_FORMAT::BC5, 16U, "13x9 BC5 round trip");
+
+    // Mode 6 block written by hand: R0 R1 G0 G1 B0 B1 A0 A1 = 127 0 0 64 10 20 127 127, p-bits 0 and 1,
+    // index 0 for texel 0 in 3 bits, 15 for texel 1 and 5 for the others
+    const uint8_t bc7_block[16] = { 0xc0, 0x3f, 0x00, 0x00, 0x54, 0x50, 0xfe, 0x7f, 0xf1, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55 };
+    uint8_t bc7_texels[16 * 4];
+    decode_bc7(bc7_block, 4U, 4U, bc7_texels);
+    const uint8_t bc7_expected[3][4] = { { 254, 0, 20, 254 }, { 1, 129, 41, 255 }, { 171, 42, 27, 254 } };
+    check(std::equal(bc7_texels, bc7_texels + 4, bc7_expected[0]), "BC7 index 0 is the first endpoint with its p-bit");
+    check(std::equal(bc7_texels + 4, bc7_texels + 8, bc7_expected[1]), "BC7 index 15 is the second endpoint with its p-bit");
+    check(std::equal(bc7_texels + 8, bc7_texels + 12, bc7_expected[2]), "BC7 index 5 interpolates the endpoints");
+
+    // BC4 blocks written by hand: red has 200 > 60, 6 interpolated values; green has 60 <= 200,
+    // 4 interpolated values then 0 and 255. Texels 0 to 3 use red indices 0 1 2 7 and green indices 6 7 2 5
+    const uint8_t bc5_block[16] = {
+        0xc8, 0x3c, 0x88, 0x0e, 0x00, 0x00, 0x00, 0x00,
+        0x3c, 0xc8, 0xbe, 0x0a, 0x00, 0x00, 0x00, 0x00,
+    };
+    uint8_t bc5_texels[16 * 4];
+    decode_bc5(bc5_block, 4U, 4U, bc5_texels);
+    const uint8_t bc5_expected[4][4] = { { 200, 0, 0, 255 }, { 60, 255, 0, 255 }, { 180, 88, 0, 255 }, { 80, 172, 0, 255 } };
+    for (uint32_t texel { 0U }; texel < 4U; texel++) {
+        check(std::equal(bc5_texels + texel * 4U, bc5_texels + texel * 4U + 4U, bc5_expected[texel]), "BC5 palettes of both BC4 modes");
+    }
+
+    // The encoder stores the first index in 3 bits by swapping the endpoints: a block starting
+    // with the brightest texel still decodes to it
+    image swapped { 4U, 4U, {} };
+    for (uint32_t texel { 0U }; texel < 16U; texel++) {
+        auto value = (uint8_t)(texel == 0U ? 250U : 10U + texel * 4U);
+        swapped.rgba.insert(swapped.rgba.end(), { value, value, value, 255 });
+    }
+    check_round_trip(swapped, BLOCK_FORMAT::BC7, 12U, "BC7 anchor index with swapped endpoints");
+
+    if (failures > 0U) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "texture compression: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}